@@ -0,0 +1,15 @@
+#ifndef DEPTH_FLIGHT_CONTROLLER_ALLOCATION_COUNTER_H
+#define DEPTH_FLIGHT_CONTROLLER_ALLOCATION_COUNTER_H
+
+namespace depth_flight_controller
+{
+    // Number of global operator new calls of the calling thread so far. Only available in
+    // executables that compile src/allocation_counter.cpp, which replaces operator new.
+    // Allocations of worker threads (e.g. of the parallel expansion mode) are not counted.
+    // The stage library compiles src/allocation_counter_unavailable.cpp instead (always 0).
+    // OpenCV allocates a UMatData through operator new for every cv::Mat buffer, so
+    // temporary masks and images show up here as well.
+    unsigned long heapAllocationCount();
+}
+
+#endif //DEPTH_FLIGHT_CONTROLLER_ALLOCATION_COUNTER_H
@@ -6,6 +6,7 @@
 #define DEPTH_FLIGHT_CONTROLLER_C_SPACE_EXPANDER_H
 
 #include <ros/ros.h>
+#include <ros/topic.h>
 #include <iostream>
 #include <image_transport/image_transport.h>
 #include <cv_bridge/cv_bridge.h>
@@ -18,6 +19,14 @@
 #include "quad_common/geometry_eigen_conversions.h"
 #include "quad_msgs/QuadStateEstimate.h"
 #include "quad_common/quad_state.h"
+#include "depth_flight_controller_msgs/ExpansionStats.h"
+#include "c_space_expansion_engine.h"
+#include "camera_info_lookup_config.h"
+#include "depth_image.h"
+#include "depth_prepass.h"
+#include "depth_smoothing.h"
+#include "image_message_buffer.h"
+#include "heap_allocation_check.h"
 
 namespace depth_flight_controller
 {
@@ -27,38 +36,60 @@ namespace depth_flight_controller
     class CSpaceExpander
     {
     public:
-        CSpaceExpander();
+        // Without connect_topics only the CameraInfo is subscribed: frames are handed to
+        // expandDepthImage by the owner (see DepthPipeline)
+        CSpaceExpander(const ros::NodeHandle& nh = ros::NodeHandle(), const ros::NodeHandle& pnh = ros::NodeHandle("~"),
+                       bool connect_topics = true);
         ~CSpaceExpander();
 
         void imageCb(const sensor_msgs::ImageConstPtr& msg);
+
+        // Expands a depth frame, CV_32FC1 in [m] or, with ~depth_encoding 16UC1, also CV_16UC1
+        // in [mm] (0 := invalid), into depth_img_expanded of the depthEncoding()
+        bool expandDepthImage(const cv::Mat& depth_img, cv::Mat& depth_img_expanded);
+        const std::string& depthEncoding() const; // Of the expanded image
+        void cameraInfoCallback(const sensor_msgs::CameraInfoConstPtr& msg);
+        void cameraInfoTimeoutCallback(const ros::TimerEvent& event);
+        void loadLookupTables(const LookupTableConfig& config);
+        void prepareRangeMin();
         void depthToCV8UC1(const cv::Mat& float_img, cv::Mat& mono8_img);
         void stateEstimateCallback(const quad_msgs::QuadStateEstimate::ConstPtr &msg);
-        float roundToPrecision(float val,int precision);
-        void changeImagePrecision(cv::Mat& IO, cv::Mat& IR);
         void expandImage(cv::Mat& IO, cv::Mat& IR);
+        const int* depthHistogram(const cv::Mat& IR) const;
+        void publishExpansionStats(const std_msgs::Header& header); // Of the last expandImage call
 
     protected:
         ros::NodeHandle nh_;
         image_transport::ImageTransport it_;
 
         ros::Subscriber state_estimate_sub_;
+        ros::Subscriber camera_info_sub_;
+        ros::Timer camera_info_timer_;
         ros::Publisher state_estimate_original_img_pub_;
+        ros::Publisher expansion_stats_pub_;
 
         image_transport::Subscriber image_sub_;
         image_transport::Publisher image_pub_;
 
     private:
-        cv::Mat depth_float_img_original_;
-        cv::Mat depth_float_img_rounded_;
+        cv::Mat depth_img_original_; // Header over the data of expanded_msg_, expanded in place
+        ImageMessageBuffer expanded_msg_;
+        cv::Mat depth_img_rounded_; // [cm], CV_16UC1 for the depth-ordered modes, else CV_32FC1
         cv::Mat depth_float_img_expanded_;
         cv::Mat depth_mono8_img_original_;
         cv::Mat depth_mono8_img_expanded_;
-        static const int max_depth_ = 500;
-        int utable_[160][max_depth_][2]; // Image width 160, depth 0-300 cm
-        int vtable_[120][max_depth_][2];
-        float reduced_depth_[max_depth_];
+        CSpaceExpansionEngine engine_;
+        DepthSmoother smoother_;
+        std::string expansion_mode_; // "separable" (default), "pruned", "pyramid", "incremental", "range_min", "sphere", "parallel", "row_pointers" or "stamp"
+        bool is_depth_ordered_mode_; // All but parallel, row_pointers and stamp: the modes that take a uint16 image
+        std::string depth_encoding_; // "32FC1" [m] (default) or "16UC1" [mm]: uint16 from the rounding to the output
+        depth_flight_controller_msgs::ExpansionStats expansion_stats_msg_;
+        std::vector<int> depth_histogram_; // Of depth_img_rounded_, filled by the pre-pass
+        HeapAllocationCheck expansion_allocations_;
         double focal_length_;
         double drone_radius_;
+        double max_depth_; // Range of the lookup tables [m]
+        std::string lookup_table_cache_; // Empty: always build the tables
         static const int precision_ = 100; // 1 := [m]; 1000 := [mm]
         double min_depth_img_, max_depth_img_;
         cv::Point min_depth_loc_, max_depth_loc_;
@@ -2,26 +2,36 @@
 // Created by nilsiism on 19.11.17.
 //
 
-#ifndef DEPTH_FLIGHT_CONTROLLER_C_SPACE_EXPANDER_H
-#define DEPTH_FLIGHT_CONTROLLER_C_SPACE_EXPANDER_H
+#ifndef DEPTH_FLIGHT_CONTROLLER_C_SPACE_EXPANDER_HORIZON_H
+#define DEPTH_FLIGHT_CONTROLLER_C_SPACE_EXPANDER_HORIZON_H
 
 #include <ros/ros.h>
+#include <ros/topic.h>
 #include <iostream>
 #include <image_transport/image_transport.h>
 #include <cv_bridge/cv_bridge.h>
 #include <sensor_msgs/image_encodings.h>
 #include "opencv2/core/core.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
-#include "opencv2/calib3d/calib3d.hpp"
 #include "opencv2/highgui/highgui.hpp"
 #include "quad_common/geometry_eigen_conversions.h"
 #include "quad_common/math_common.h"
 #include <math.h>
 #include <algorithm>
 #include <fstream>
+#include <limits>
 #include "quad_common/geometry_eigen_conversions.h"
 #include "quad_msgs/QuadStateEstimate.h"
 #include "quad_common/quad_state.h"
+#include "depth_flight_controller_msgs/HorizonBand.h"
+#include "depth_flight_controller_msgs/ExpansionStats.h"
+#include "c_space_expansion_engine.h"
+#include "camera_info_lookup_config.h"
+#include "horizon_geometry.h"
+#include "depth_prepass.h"
+#include "depth_smoothing.h"
+#include "image_message_buffer.h"
+#include "heap_allocation_check.h"
 
 namespace depth_flight_controller
 {
@@ -31,20 +41,24 @@ namespace depth_flight_controller
     class CSpaceExpanderHorizon
     {
     public:
-        CSpaceExpanderHorizon();
+        CSpaceExpanderHorizon(const ros::NodeHandle& nh = ros::NodeHandle(), const ros::NodeHandle& pnh = ros::NodeHandle("~"));
         ~CSpaceExpanderHorizon();
 
         void imageCallback(const sensor_msgs::ImageConstPtr& msg);
+        void cameraInfoCallback(const sensor_msgs::CameraInfoConstPtr& msg);
+        void cameraInfoTimeoutCallback(const ros::TimerEvent& event);
+        void loadLookupTables(const LookupTableConfig& config);
         void depthToCV8UC1(const cv::Mat& float_img, cv::Mat& mono8_img);
         void stateEstimateCallback(const quad_msgs::QuadStateEstimate::ConstPtr &msg);
-        float roundToPrecision(float val,int precision);
-        void changeImagePrecision(cv::Mat& IO, cv::Mat& IR);
         void expandImage(cv::Mat& IO, cv::Mat& IR, std::vector<cv::Point> horizon_points);
+        void expandBand(cv::Mat& IO, cv::Mat& IR, const std::vector<cv::Point>& horizon_points,
+                        const std_msgs::Header& header);
+        void buildBand(const cv::Mat& IO, const std::vector<cv::Point>& horizon_points, int row_margin, int col_margin);
+        void publishExpansionStats(const std_msgs::Header& header); // Of the last expansion
         void writeMapU(std::ostream& os);
         void writeMapV(std::ostream& os);
 
         Eigen::Matrix3d tiltCalculator(const QuadState &state_estimate);
-        Eigen::Vector3d toEulerAngle(const Eigen::Quaterniond& q);
         double Slope(int x0, int y0, int x1, int y1);
         std::vector<cv::Point> fullLine(cv::Point a, cv::Point b, cv::Point center_pos);
         std::vector<cv::Point> buildHorizon(const QuadState state_estimate);
@@ -54,23 +68,42 @@ namespace depth_flight_controller
         image_transport::ImageTransport it_;
 
         ros::Subscriber state_estimate_sub_;
+        ros::Subscriber camera_info_sub_;
+        ros::Timer camera_info_timer_;
         ros::Publisher state_estimate_original_img_pub_;
+        ros::Publisher horizon_band_pub_;
+        ros::Publisher expansion_stats_pub_;
 
         image_transport::Subscriber image_sub_;
         image_transport::Publisher image_pub_;
 
     private:
-        cv::Mat depth_float_img_original_;
-        cv::Mat depth_float_img_rounded_;
+        cv::Mat depth_float_img_original_; // Header over the data of expanded_msg_, expanded in place
+        ImageMessageBuffer expanded_msg_;
+        cv::Mat depth_img_rounded_; // [cm], CV_16UC1 for the depth-ordered modes, else CV_32FC1
         cv::Mat depth_float_img_expanded_;
         cv::Mat depth_mono8_img_original_;
         cv::Mat depth_mono8_img_expanded_;
-        static const int max_depth_ = 500;
-        int utable_[160][max_depth_][2]; // Image width 160, depth 0-300 cm
-        int vtable_[120][max_depth_][2];
-        float reduced_depth_[max_depth_];
+        CSpaceExpansionEngine engine_;
+        std::string expansion_mode_; // "row_pointers" (default), "sphere" or "stamp"
+        bool is_band_output_;        // ~output_mode "band": publish HorizonBand instead of the image
+        bool is_band_smoothing_;     // ~smoothing "horizon_band": smooth only the rows TargetFinder reads
+        DepthSmoother smoother_;
+
+        // Band output: the horizon line, the pixels to expand (or smooth) per row and the outgoing message
+        int band_margin_;
+        std::vector<cv::Point> band_line_;
+        std::vector<int> band_begin_;
+        std::vector<int> band_end_;
+        std::vector<int> depth_histogram_;
+        cv::Mat depth_float_img_band_;
+        depth_flight_controller_msgs::HorizonBandPtr horizon_band_msg_;
+        HeapAllocationCheck expansion_allocations_;
+        depth_flight_controller_msgs::ExpansionStats expansion_stats_msg_;
         double focal_length_;
         double drone_radius_;
+        double max_depth_; // Range of the lookup tables [m]
+        std::string lookup_table_cache_; // Empty: always build the tables
         static const int precision_ = 100; // 1 := [m]; 1000 := [mm]
         double min_depth_img_, max_depth_img_;
         cv::Point min_depth_loc_, max_depth_loc_;
@@ -78,24 +111,12 @@ namespace depth_flight_controller
         quad_msgs::QuadStateEstimate state_estimate_msg_;
 
         // Camera intrinsic and extrinsic information
-        cv::Mat K;
-        cv::Mat rvecR;
-        cv::Mat T;
-        cv::Mat distCoeffs;
-
-        Eigen::Matrix3d body_cam_rot_;
-        Eigen::Vector3d horizon_center_point_world_;
-        Eigen::Vector3d horizon_left_point_world_;
-        Eigen::Vector3d horizon_right_point_world_;
-        cv::Mat rvec;
+        HorizonGeometry horizon_geometry_;
 
         // Horizon build information
         cv::Point pt1_; // Horizon point left edge
         cv::Point pt2_; // Horizon point right edge
-        std::vector<cv::Point3f> horizon_points;
-        std::vector<cv::Point2f> projected_horizon_points;
-        double yaw_;
     };
 }
 
-#endif //DEPTH_FLIGHT_CONTROLLER_C_SPACE_EXPANDER_H
+#endif //DEPTH_FLIGHT_CONTROLLER_C_SPACE_EXPANDER_HORIZON_H
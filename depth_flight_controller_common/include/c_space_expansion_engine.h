@@ -0,0 +1,362 @@
+#ifndef DEPTH_FLIGHT_CONTROLLER_C_SPACE_EXPANSION_ENGINE_H
+#define DEPTH_FLIGHT_CONTROLLER_C_SPACE_EXPANSION_ENGINE_H
+
+#include <opencv2/core/core.hpp>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <limits>
+#include "span_min_kernel.h"
+#include "compact_span_table.h"
+#include "lookup_table_file.h"
+#include "depth_smoothing.h"
+#include "depth_image.h"
+
+namespace depth_flight_controller
+{
+    // Everything the lookup tables depend on. Defaults to the 160x120 depth camera of the
+    // hummingbird vi_sensor.
+    struct LookupTableConfig
+    {
+        LookupTableConfig();
+
+        bool operator==(const LookupTableConfig& other) const;
+        bool operator!=(const LookupTableConfig& other) const;
+
+        int image_width;
+        int image_height;
+        double focal_length_u;
+        double focal_length_v;
+        double center_u;
+        double center_v;
+        double drone_radius;
+        int max_depth; // [cm], exclusive
+    };
+
+    // Owns the (u,z) / (v,z) lookup tables and the algorithms that stamp the
+    // c-space of every depth pixel into the image. Free of ROS so that the
+    // expander nodes can share one implementation.
+    class CSpaceExpansionEngine
+    {
+    public:
+        CSpaceExpansionEngine();
+        ~CSpaceExpansionEngine();
+
+        // Sizes the tables and all per-frame buffers for the given camera. The rows of the
+        // tables are computed concurrently.
+        void buildLookupTables(const LookupTableConfig& config);
+        void buildLookupTables(double focal_length, double drone_radius); // Default camera
+        const LookupTableConfig& lookupTableConfig() const;
+
+        // Same tables as buildLookupTables. Maps them from the file at cache_path if that was
+        // written for the same configuration, otherwise builds them and (re)writes the file.
+        enum LookupTableSource { TABLES_MAPPED, TABLES_BUILT_AND_CACHED, TABLES_BUILT };
+        LookupTableSource loadLookupTables(const LookupTableConfig& config, const std::string& cache_path);
+
+        // Serve the v-spans from the u-table where that reproduces the v-table (equal focal
+        // lengths, the u-range covering the v-range). Leaves only the near rows of the v-table.
+        void setSharedTables(bool enabled);
+        size_t lookupTableBytes() const; // Size of the tables the fast paths read
+
+        // Span lookups of the int tables and of the compact tables the fast paths use
+        void lookupInt(int u, int v, int z_cm, int& x, int& w, int& y, int& h) const;
+        void lookupCompact(int u, int v, int z_cm, int& x, int& w, int& y, int& h) const;
+
+        // Chooses the span-min kernel of the rectangle stamps (AVX2/NEON if available)
+        void setSimdEnabled(bool enabled);
+        const char* spanMinKernelName() const;
+
+        // The separable, pruned and range-min modes run a version compiled for the image size
+        // and depth range if the tables were built for one of the prebuilt sensor shapes
+        // (160x120, 320x240 or 640x480, 5 m), the generic version otherwise. Same results.
+        void setPrebuiltShapesEnabled(bool enabled); // Default true
+        bool hasPrebuiltShape() const; // The tables match a prebuilt shape and it is enabled
+
+        // Like expandImageRowPointers, but every stamp covers only the pixels of its rectangle
+        // that the drone sphere around the source point projects onto (an ellipse, computed per
+        // row of the stamp), so the corners of the rectangle are not inflated. Never writes a
+        // pixel expandImageRowPointers does not write. Sources nearer than the drone radius
+        // keep the full rectangle. Stamps are applied in depth order like in expandImagePruned.
+        void expandImageSpherical(cv::Mat& IO, const cv::Mat& IR, int v_min, int v_max);
+
+        // Image pixels written by the rectangle (or spherical) stamps of the rows [v_min, v_max)
+        long stampedPixels(const cv::Mat& IR, int v_min, int v_max, bool spherical);
+
+        // Reference implementation: one rectangle per source pixel of the rows [v_min, v_max).
+        // IO is CV_32FC1 in [m] or, for the stamping, separable, pruned and range-min modes,
+        // CV_16UC1 in [mm]; the reduced depths of the uint16 image are clamped to 0.
+        void expandImageStamping(cv::Mat& IO, const cv::Mat& IR, int v_min, int v_max);
+
+        // Same result as expandImageStamping, writing through the preallocated row pointers
+        // with a plain min per covered pixel. Does not touch the heap.
+        void expandImageRowPointers(cv::Mat& IO, const cv::Mat& IR, int v_min, int v_max);
+
+        // Same result as expandImageRowPointers. The source rows are split into bands that
+        // are stamped concurrently into band-local buffers and merged with an elementwise min,
+        // both only over the rows the stamps of a band reach.
+        void expandImageParallel(cv::Mat& IO, const cv::Mat& IR, int v_min, int v_max);
+        void setParallelBands(int n_bands);
+
+        // Same result as expandImageStamping over the full image, computed with one
+        // horizontal and one vertical running-minimum pass over depth slices.
+        // The depth-ordered modes (separable, pruned, spherical) also take a CV_16UC1 IR.
+        // A depth_histogram of that IR (see prepareDepthImage) saves them a pass over it.
+        void expandImageSeparable(cv::Mat& IO, const cv::Mat& IR, const int* depth_histogram = NULL);
+
+        // Same result as expandImageStamping over the full image. Stamps are applied from
+        // near to far and only write image pixels no earlier stamp has reached, so stamps
+        // covered by nearer ones cost (almost) nothing
+        void expandImagePruned(cv::Mat& IO, const cv::Mat& IR, const int* depth_histogram = NULL);
+        int prunedStamps() const; // Stamps skipped by the last expandImagePruned call
+
+        // Same result as expandImageStamping over the full image, but only at the pixels
+        // [band_begin[v], band_end[v]) of every row v; all other pixels of IO are left as they
+        // are. Stamps are applied in depth order until every band pixel holds its nearest one,
+        // so the work follows the size of the band rather than that of the image.
+        void expandImageBand(cv::Mat& IO, const cv::Mat& IR, const int* band_begin, const int* band_end,
+                             const int* depth_histogram = NULL);
+
+        // Same result as expandImagePruned, reusing the result of the last call. IR is compared
+        // with the last IR in tiles; only the tiles that the last or current stamps of changed
+        // tiles reach are recomputed, all others are copied from the last result. Pixels no stamp
+        // reaches (very close to the camera) may keep the depth of an earlier frame with the
+        // same rounded depth.
+        void expandImageIncremental(cv::Mat& IO, const cv::Mat& IR, const int* depth_histogram = NULL);
+        void setIncrementalTileSize(int tile_size); // [px], default 16
+        void resetIncremental(); // The next expandImageIncremental call recomputes every tile
+
+        struct IncrementalStats
+        {
+            int tiles;
+            int changed_tiles;    // Tiles whose rounded depth differs from the last frame
+            int recomputed_tiles; // Tiles reached by the stamps of the changed ones
+        };
+        const IncrementalStats& incrementalStats() const; // Of the last expandImageIncremental call
+
+        // Conservative approximation of expandImagePruned. Sources nearer than
+        // pyramidSplitDepth() are merged into blocks of factor x factor pixels that are stamped
+        // on a grid downsampled by factor, farther ones at full resolution, and both are merged
+        // with a min. A block stamps the union of the stamps of its pixels at their nearest
+        // depth, so a pixel is never reported farther than by expandImagePruned; a stamp grows
+        // by less than factor px per side, which the split depth keeps below max_error of the
+        // stamp size.
+        void expandImagePyramid(cv::Mat& IO, const cv::Mat& IR, const int* depth_histogram = NULL);
+        void setPyramid(int factor, double max_error); // Default 2, 0.1
+        int pyramidSplitDepth() const; // [cm]
+
+        // Same result as expandImageStamping over the full image, computed per image pixel: a
+        // sparse table of square blocks over the source depths answers "nearest source among
+        // those whose stamp at depth z covers the pixel" with a handful of lookups, and a pixel
+        // needs only a few of these queries. The cost does not depend on the stamp sizes. Sources nearer than the depth
+        // from which the tables are nested are stamped directly. With smooth, every finished
+        // row is handed to the 5x3 smoothing (see DepthSmoother) within the same pass.
+        void expandImageRangeMin(cv::Mat& IO, const cv::Mat& IR, bool smooth = false);
+
+        // Builds the range-min tables ahead of the first expandImageRangeMin call and returns
+        // their size [bytes], about 0.8 MB at 160x120 and 8 MB at 640x480. The sparse table
+        // holds one uint16 plane per power of two up to the shorter image side and is rebuilt
+        // every frame with two min passes per plane.
+        size_t prepareRangeMin();
+
+        int imageWidth() const;
+        int imageHeight() const;
+        int maxDepth() const;
+
+        static const int precision_ = 100; // Table depth steps per metre
+
+    private:
+        class BandBody;
+        class MergeBody;
+        class LookupTableBody;
+
+        int clampDepth(float z_rounded) const;
+        int clampDepth(int z_rounded) const;
+        int clampDepth(unsigned short z_rounded) const; // -1 for invalid_depth_u16
+        int sourceDepth(const cv::Mat& IR, int u, int v) const;
+        void markReachedTiles(const cv::Mat& IR, int u_begin, int u_end, int v_begin, int v_end);
+        template <typename Shape>
+        void bucketByDepth(const Shape& shape, const cv::Mat& IR, int v_min, int v_max, const int* depth_histogram);
+        void bucketByDepth(const cv::Mat& IR, int v_min, int v_max, const int* depth_histogram);
+        template <typename Shape>
+        void resetRowLinks(const Shape& shape);
+        void resetRowLinks();
+        template <typename Shape>
+        bool isDominatedByNeighbour(const Shape& shape, int u, int v, int z_cm) const;
+        bool isDominatedByNeighbour(int u, int v, int z_cm) const;
+        void setRowPointers(cv::Mat& IO);
+        void stampRect(float* const* rows, int u, int v, int z_cm) const;
+        void stampRect(unsigned short* const* rows, int u, int v, int z_cm) const;
+        enum DepthOrderedPass { PASS_SEPARABLE, PASS_PRUNED, PASS_RANGE_MIN };
+        template <typename T>
+        void expandDepthOrdered(DepthOrderedPass pass, T* const* rows, const T* reduced_depth, const cv::Mat& IR,
+                                const int* depth_histogram, bool smooth);
+        template <typename Shape, typename T>
+        void runDepthOrdered(const Shape& shape, DepthOrderedPass pass, T* const* rows, const T* reduced_depth,
+                             const cv::Mat& IR, const int* depth_histogram, bool smooth);
+        template <typename Shape, typename T>
+        void expandSeparable(const Shape& shape, T* const* rows, const T* reduced_depth, const cv::Mat& IR,
+                             const int* depth_histogram);
+        template <typename Shape, typename T>
+        void expandPruned(const Shape& shape, T* const* rows, const T* reduced_depth, const cv::Mat& IR,
+                          const int* depth_histogram);
+        template <typename Shape, typename T>
+        void expandRangeMin(const Shape& shape, T* const* rows, const T* reduced_depth, const cv::Mat& IR,
+                            bool smooth);
+        void uSpan(int u, int z_cm, int& x, int& w) const;
+        void vSpan(int v, int z_cm, int& y, int& h) const;
+        void setConfig(const LookupTableConfig& config);
+        void computeSpanTables();
+        void finishLookupTables();
+        void buildCompactVTable();
+        void allocateBandBuffers();
+        void updatePyramid();
+        bool isNestedAndOrdered(int z_cm) const;
+        void buildCoverTables();
+        template <typename Shape>
+        int buildRangeMinTable(const Shape& shape, const cv::Mat& IR); // Returns the nearest entered depth
+        template <typename Shape>
+        int rangeMin(const Shape& shape, int u_begin, int u_end, int v_begin, int v_end) const;
+        static int findNext(int* next, int i);
+
+        LookupTableConfig config_;
+        int image_width_;
+        int image_height_;
+        int max_depth_;
+
+        // Span tables, either computed into the storage vectors or mapped from table_file_
+        const int* utable_; // [u][z_cm] -> (u_low, width)
+        const int* vtable_; // [v][z_cm] -> (v_low, height)
+        std::vector<int> utable_storage_;
+        std::vector<int> vtable_storage_;
+        LookupTableFile table_file_;
+        std::vector<float> reduced_depth_;
+        std::vector<unsigned short> reduced_depth_mm_; // Same in [mm] for CV_16UC1 images
+
+        // Copies of the tables above read by all but the reference path
+        CompactSpanTable compact_utable_;
+        CompactSpanTable compact_vtable_;
+        bool share_tables_;
+        int shared_offset_;     // v + shared_offset_ is the u with the same distance to the principal point
+        int shared_min_depth_;  // From here on the u-table reproduces the v-table
+
+        // Depths below this value do not have nested v-intervals (the tables saturate close
+        // to the camera), so the separable passes hand them to stampRect instead
+        int separable_min_depth_;
+
+        // Row pointers into the image being expanded, set once per frame
+        std::vector<float*> row_ptr_;
+        std::vector<unsigned short*> row_ptr_mm_;
+        SpanMinKernel span_min_;
+
+        // Prebuilt shape the tables were built for, see setPrebuiltShapesEnabled
+        enum PrebuiltShape { SHAPE_DYNAMIC, SHAPE_160x120, SHAPE_320x240, SHAPE_640x480 };
+        PrebuiltShape prebuilt_shape_;
+        bool prebuilt_shapes_enabled_;
+
+        // Parallel mode: one buffer (and its row pointers) per band, and the rows [begin, end)
+        // of it the stamps of the band reached in the last frame
+        int n_bands_;
+        std::vector<cv::Mat> band_img_;
+        std::vector<std::vector<float*> > band_rows_;
+        std::vector<int> band_reach_;
+
+        int pruned_stamps_;
+
+        // Incremental mode: IR and result of the last call, and per tile 0 (clean), TILE_REACHED
+        // or TILE_CHANGED
+        enum TileState { TILE_CLEAN = 0, TILE_REACHED = 1, TILE_CHANGED = 2 };
+        int tile_size_;
+        cv::Mat last_IR_;
+        cv::Mat last_IO_;
+        std::vector<unsigned char> tile_state_;
+        IncrementalStats incremental_stats_;
+
+        // Pyramid mode: per block of the coarse grid the nearest source depth below the split
+        // depth (or max_depth_) and the span (x, x_end, y, y_end) of its stamp in coarse pixels
+        int pyramid_factor_;
+        double pyramid_max_error_;
+        int pyramid_split_depth_;
+        int coarse_width_;
+        int coarse_height_;
+        std::vector<int> coarse_depth_;
+        std::vector<int> coarse_span_;
+        std::vector<int> coarse_count_;
+        std::vector<int> coarse_order_;
+        std::vector<int> coarse_next_;
+        std::vector<float> coarse_value_; // Depth of the nearest coarse stamp, NaN if none
+
+        // From this depth on, spans are nested in depth and ordered along the image axes
+        int nested_depth_;
+
+        // Range-min mode: per (z_cm, column) the source columns [begin, end) whose stamps
+        // cover it, same per row (see prepareRangeMin), and the sparse table of the source
+        // depths, plane k holding the minimum over the 2^k x 2^k sources from each pixel on
+        std::vector<unsigned short> cover_u_;
+        std::vector<unsigned short> cover_v_;
+        std::vector<unsigned short> range_min_;
+        std::vector<unsigned char> floor_log2_;
+        int range_min_levels_;
+        DepthSmoother smoother_;
+
+        // Depth-ordered pass buffers, sized with the lookup tables
+        std::vector<int> depth_count_;     // Bucket offsets per z_cm
+        std::vector<int> pixel_depth_;     // Clamped z_cm per source pixel, -1 if invalid
+        std::vector<int> depth_order_;     // Source pixels sorted by z_cm
+        std::vector<int> row_next_;        // Per row: next column not yet covered
+        std::vector<int> col_next_;        // Per column: next row not yet covered
+        std::vector<int> span_pixel_;      // Row-pass output (v*width+u), ascending in z_cm
+        std::vector<int> span_depth_;
+    };
+
+    inline int CSpaceExpansionEngine::imageWidth() const
+    {
+        return image_width_;
+    }
+
+    inline int CSpaceExpansionEngine::imageHeight() const
+    {
+        return image_height_;
+    }
+
+    inline int CSpaceExpansionEngine::maxDepth() const
+    {
+        return max_depth_;
+    }
+
+    inline void CSpaceExpansionEngine::uSpan(int u, int z_cm, int& x, int& w) const
+    {
+        compact_utable_.get(u, z_cm, x, w);
+    }
+
+    inline void CSpaceExpansionEngine::vSpan(int v, int z_cm, int& y, int& h) const
+    {
+        if (!share_tables_ || z_cm < shared_min_depth_)
+        {
+            compact_vtable_.get(v, z_cm, y, h);
+            return;
+        }
+
+        int low, extent;
+        compact_utable_.get(v + shared_offset_, z_cm, low, extent);
+        y = std::min(std::max(low - shared_offset_, 0), image_height_ - 1);
+        h = std::min(std::max(low + extent - 1 - shared_offset_, 0), image_height_ - 1) - y + 1;
+    }
+
+    inline void CSpaceExpansionEngine::lookupInt(int u, int v, int z_cm, int& x, int& w, int& y, int& h) const
+    {
+        const int* u_span = &utable_[2 * (u * max_depth_ + z_cm)];
+        const int* v_span = &vtable_[2 * (v * max_depth_ + z_cm)];
+        x = u_span[0];
+        w = u_span[1];
+        y = v_span[0];
+        h = v_span[1];
+    }
+
+    inline void CSpaceExpansionEngine::lookupCompact(int u, int v, int z_cm, int& x, int& w, int& y, int& h) const
+    {
+        uSpan(u, z_cm, x, w);
+        vSpan(v, z_cm, y, h);
+    }
+}
+
+#endif //DEPTH_FLIGHT_CONTROLLER_C_SPACE_EXPANSION_ENGINE_H
@@ -0,0 +1,50 @@
+#ifndef DEPTH_FLIGHT_CONTROLLER_CAMERA_INFO_LOOKUP_CONFIG_H
+#define DEPTH_FLIGHT_CONTROLLER_CAMERA_INFO_LOOKUP_CONFIG_H
+
+#include <math.h>
+#include <sensor_msgs/CameraInfo.h>
+#include <opencv2/core/core.hpp>
+#include "c_space_expansion_engine.h"
+
+namespace depth_flight_controller
+{
+    // Lookup table configuration of the camera described by a CameraInfo message
+    // (K = [fx 0 cx; 0 fy cy; 0 0 1]). max_depth in [m].
+    inline LookupTableConfig lookupTableConfigFromCameraInfo(const sensor_msgs::CameraInfo& info,
+                                                             double drone_radius, double max_depth)
+    {
+        LookupTableConfig config;
+        config.image_width = info.width;
+        config.image_height = info.height;
+        config.focal_length_u = info.K[0];
+        config.focal_length_v = info.K[4];
+        config.center_u = info.K[2];
+        config.center_v = info.K[5];
+        config.drone_radius = drone_radius;
+        config.max_depth = int(round(max_depth * 100));
+        return config;
+    }
+
+    // Lookup table configuration of the default camera (see LookupTableConfig), for nodes
+    // that get no CameraInfo
+    inline LookupTableConfig defaultLookupTableConfig(double drone_radius, double max_depth)
+    {
+        LookupTableConfig config;
+        config.drone_radius = drone_radius;
+        config.max_depth = int(round(max_depth * 100));
+        return config;
+    }
+
+    inline cv::Mat cameraMatrixFromCameraInfo(const sensor_msgs::CameraInfo& info)
+    {
+        return (cv::Mat_<double>(3,3) << info.K[0], 0.0, info.K[2], 0.0, info.K[4], info.K[5], 0.0, 0.0, 1.0);
+    }
+
+    // Intrinsics are usable once the camera driver has filled in the image size and K
+    inline bool hasIntrinsics(const sensor_msgs::CameraInfo& info)
+    {
+        return info.width > 0 && info.height > 0 && info.K[0] > 0 && info.K[4] > 0;
+    }
+}
+
+#endif //DEPTH_FLIGHT_CONTROLLER_CAMERA_INFO_LOOKUP_CONFIG_H
@@ -0,0 +1,82 @@
+#ifndef DEPTH_FLIGHT_CONTROLLER_COMPACT_SPAN_TABLE_H
+#define DEPTH_FLIGHT_CONTROLLER_COMPACT_SPAN_TABLE_H
+
+#include <stddef.h>
+#include <vector>
+
+namespace depth_flight_controller
+{
+    // (start, extent) pairs of all pixels of one image axis, stored as one interleaved
+    // row per depth: [z_cm][pixel][start, extent]. Axes of up to 255 pixels are stored in
+    // 8 bit (a 160 x 500 table takes 160 kB instead of the 640 kB of an int [pixel][z_cm][2]
+    // array), longer ones in 16 bit. The spans a frame needs for one depth sit next to each other.
+    class CompactSpanTable
+    {
+    public:
+        CompactSpanTable()
+                : n_pixels_(0), n_depths_(0), is_wide_(false)
+        {
+        }
+
+        void resize(int n_pixels, int n_depths)
+        {
+            n_pixels_ = n_pixels;
+            n_depths_ = n_depths;
+            is_wide_ = n_pixels > 255;
+
+            narrow_.clear();
+            wide_.clear();
+            if (is_wide_)
+                wide_.assign(2 * n_pixels * n_depths, 0);
+            else
+                narrow_.assign(2 * n_pixels * n_depths, 0);
+        }
+
+        void set(int pixel, int z_cm, int start, int extent)
+        {
+            size_t i = 2 * (size_t(z_cm) * n_pixels_ + pixel);
+            if (is_wide_)
+            {
+                wide_[i] = (unsigned short)start;
+                wide_[i + 1] = (unsigned short)extent;
+            } else
+            {
+                narrow_[i] = (unsigned char)start;
+                narrow_[i + 1] = (unsigned char)extent;
+            }
+        }
+
+        void get(int pixel, int z_cm, int& start, int& extent) const
+        {
+            size_t i = 2 * (size_t(z_cm) * n_pixels_ + pixel);
+            if (is_wide_)
+            {
+                start = wide_[i];
+                extent = wide_[i + 1];
+            } else
+            {
+                start = narrow_[i];
+                extent = narrow_[i + 1];
+            }
+        }
+
+        int depths() const
+        {
+            return n_depths_;
+        }
+
+        size_t bytes() const
+        {
+            return narrow_.size() * sizeof(unsigned char) + wide_.size() * sizeof(unsigned short);
+        }
+
+    private:
+        std::vector<unsigned char> narrow_;
+        std::vector<unsigned short> wide_;
+        int n_pixels_;
+        int n_depths_;
+        bool is_wide_;
+    };
+}
+
+#endif //DEPTH_FLIGHT_CONTROLLER_COMPACT_SPAN_TABLE_H
@@ -0,0 +1,43 @@
+#ifndef DEPTH_FLIGHT_CONTROLLER_DEPTH_IMAGE_H
+#define DEPTH_FLIGHT_CONTROLLER_DEPTH_IMAGE_H
+
+#include <opencv2/core/core.hpp>
+#include <string>
+
+namespace depth_flight_controller
+{
+    // Depth images travel between the nodes either as CV_32FC1 in [m] (encoding "32FC1", the
+    // default) or as CV_16UC1 in [mm] ("16UC1", selected with ~depth_encoding), which halves
+    // the size of every image message. The readers below accept both.
+
+    // Negative depths are invalid: they are no source of the c-space expansion and read as
+    // the NaN fill depth after the pre-pass (see depth_prepass.h). A CV_16UC1 image can not
+    // hold them, so this value marks them there, in [mm] as well as in the rounded [cm] image.
+    const unsigned short invalid_depth_u16 = 0xFFFF;
+
+    inline bool isDepthEncoding(const std::string& encoding)
+    {
+        return encoding == "32FC1" || encoding == "16UC1";
+    }
+
+    inline int depthImageType(const std::string& encoding)
+    {
+        return encoding == "16UC1" ? CV_16UC1 : CV_32FC1;
+    }
+
+    // Factor from the pixel values of a depth image to [m]
+    inline double metresPerUnit(const cv::Mat& depth)
+    {
+        return depth.depth() == CV_16U ? 0.001 : 1.0;
+    }
+
+    // Depth at p [m]
+    inline float depthAt(const cv::Mat& depth, const cv::Point& p)
+    {
+        if (depth.depth() == CV_16U)
+            return depth.at<unsigned short>(p) * 0.001f;
+        return depth.at<float>(p);
+    }
+}
+
+#endif //DEPTH_FLIGHT_CONTROLLER_DEPTH_IMAGE_H
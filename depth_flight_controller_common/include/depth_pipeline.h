@@ -0,0 +1,63 @@
+#ifndef DEPTH_FLIGHT_CONTROLLER_DEPTH_PIPELINE_H
+#define DEPTH_FLIGHT_CONTROLLER_DEPTH_PIPELINE_H
+
+#include <ros/ros.h>
+#include <image_transport/image_transport.h>
+#include <cv_bridge/cv_bridge.h>
+#include "quad_msgs/QuadStateEstimate.h"
+#include "quad_common/quad_state.h"
+#include "image_clipper.h"
+#include "c_space_expander.h"
+#include "image_message_buffer.h"
+#include "target_search.h"
+
+namespace depth_flight_controller
+{
+    using namespace quad_common;
+
+    // The clipper, c-space expander and target finder in one callback: every depth frame runs
+    // through the stages in a fixed order on buffers owned here, together with the state
+    // estimate it arrived with. Only Target and HorizonPoints are published, plus the clipped
+    // and expanded images for image_prep if ~publish_debug_images is set, both in the
+    // ~depth_encoding of the expander. The target finder comes from the planner package and
+    // must outlive the pipeline; construct it without connect_topics.
+    class DepthPipeline
+    {
+    public:
+        explicit DepthPipeline(TargetSearch& target_finder, const ros::NodeHandle& nh = ros::NodeHandle(),
+                               const ros::NodeHandle& pnh = ros::NodeHandle("~"));
+        ~DepthPipeline();
+
+        void imageCallback(const sensor_msgs::ImageConstPtr& msg);
+        void stateEstimateCallback(const quad_msgs::QuadStateEstimate::ConstPtr& msg);
+
+        // Runs all stages on one depth frame [m]. Returns false if the expander rejected it.
+        bool processFrame(const std_msgs::Header& header, const cv::Mat& depth_float_img,
+                          const QuadState& state_estimate, const quad_msgs::QuadStateEstimate& state_estimate_msg);
+
+    protected:
+        ros::NodeHandle nh_;
+        image_transport::ImageTransport it_;
+
+        image_transport::Subscriber image_sub_;
+        ros::Subscriber state_estimate_sub_;
+
+        image_transport::Publisher clipped_image_pub_;
+        image_transport::Publisher expanded_image_pub_;
+
+    private:
+        CSpaceExpander c_space_expander_;
+        TargetSearch& target_finder_;
+
+        bool publish_debug_images_;
+        cv::Mat depth_img_expanded_; // Reused across frames, or a header over expanded_msg_
+        cv::Mat depth_img_clipped_;  // Header over clipped_msg_
+        ImageMessageBuffer expanded_msg_;
+        ImageMessageBuffer clipped_msg_;
+
+        QuadState state_estimate_;
+        quad_msgs::QuadStateEstimate state_estimate_msg_;
+    };
+}
+
+#endif //DEPTH_FLIGHT_CONTROLLER_DEPTH_PIPELINE_H
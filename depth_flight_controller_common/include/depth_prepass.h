@@ -0,0 +1,43 @@
+#ifndef DEPTH_FLIGHT_CONTROLLER_DEPTH_PREPASS_H
+#define DEPTH_FLIGHT_CONTROLLER_DEPTH_PREPASS_H
+
+#include <opencv2/core/core.hpp>
+
+namespace depth_flight_controller
+{
+    // One read of a CV_32FC1 depth image in [m] does all the per-pixel work the expanders
+    // need before the c-space expansion:
+    //  - NaNs and negative (invalid) depths of depth are replaced by nan_depth (in place),
+    //  - depth_rounded receives round(depth * precision) clamped to [0, max_depth - 1],
+    //    as CV_16UC1 or CV_32FC1 (depth_type), and for the invalid pixels invalid_depth_u16
+    //    or -1, which no expansion mode stamps,
+    //  - if histogram is not NULL, histogram[z] counts the valid pixels with rounded depth z
+    //    (max_depth entries), which lets the depth-ordered expansions skip their counting pass.
+    // depth_rounded is only allocated if it does not have the right size and type yet.
+    void prepareDepthImage(cv::Mat& depth, float nan_depth, int precision, int max_depth, int depth_type,
+                           cv::Mat& depth_rounded, int* histogram = NULL);
+
+    // Same, but reads a source image that must not be written (a shared message) and stores
+    // the NaN-filled depth in depth, which must already have the size of source. Replaces a
+    // copy of the frame followed by the in-place pre-pass.
+    void prepareDepthImage(const cv::Mat& source, cv::Mat& depth, float nan_depth, int precision, int max_depth,
+                           int depth_type, cv::Mat& depth_rounded, int* histogram = NULL);
+
+    // Copies a CV_32FC1 source into depth (of the same size) with NaNs replaced by nan_depth
+    void fillNanDepth(const cv::Mat& source, float nan_depth, cv::Mat& depth);
+
+    // The uint16 pipeline: the same for a CV_16UC1 source in [mm] in which 0 marks missing
+    // (NaN) and invalid_depth_u16 invalid pixels. Both are replaced by nan_depth [mm] in depth
+    // (CV_16UC1, may be source), and depth_rounded (always CV_16UC1) receives the depth in steps
+    // of 1 / precision [m], which must be whole millimetres, or invalid_depth_u16. Works in
+    // integers only.
+    void prepareDepthImageMillimetres(const cv::Mat& source, cv::Mat& depth, unsigned short nan_depth, int precision,
+                                      int max_depth, cv::Mat& depth_rounded, int* histogram = NULL);
+
+    // Converts a CV_32FC1 source in [m] into depth_mm (CV_16UC1 of the same size) in [mm],
+    // rounded and saturated, with NaNs replaced by nan_depth [m] and negative depths by
+    // invalid_depth_u16, so that both encodings treat them alike
+    void fillNanDepthMillimetres(const cv::Mat& source, float nan_depth, cv::Mat& depth_mm);
+}
+
+#endif //DEPTH_FLIGHT_CONTROLLER_DEPTH_PREPASS_H
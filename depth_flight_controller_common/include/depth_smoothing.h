@@ -0,0 +1,50 @@
+#ifndef DEPTH_FLIGHT_CONTROLLER_DEPTH_SMOOTHING_H
+#define DEPTH_FLIGHT_CONTROLLER_DEPTH_SMOOTHING_H
+
+#include <opencv2/core/core.hpp>
+#include <vector>
+
+namespace depth_flight_controller
+{
+    // The 5x3 smoothing of the expanded depth image: what cv::GaussianBlur does for
+    // cv::Size(5, 3) and sigma 0, i.e. the binomial kernels [1 4 6 4 1] / 16 along the rows and
+    // [1 2 1] / 4 along the columns with BORDER_REFLECT_101, with fixed coefficients. Works in
+    // place on a CV_32FC1 or CV_16UC1 image of at least 3x2 pixels, reading every pixel once
+    // and keeping three horizontally smoothed rows. uint16 pixels are rounded to the nearest
+    // integer. The buffers are kept from frame to frame.
+    class DepthSmoother
+    {
+    public:
+        DepthSmoother();
+
+        // Smooths the whole image
+        void smooth(cv::Mat& image);
+
+        // Smooths only the pixels [col_begin[v], col_end[v]) of every row v (empty rows have
+        // col_begin >= col_end); all others are read but left as they are
+        void smoothRows(cv::Mat& image, const int* col_begin, const int* col_end);
+
+        // Row by row, for an expansion whose last pass finishes the rows top to bottom:
+        // begin, then addRow(v) for v = 0 .. rows - 1 as soon as row v is final, then finish.
+        // addRow(v) writes the smoothed row v - 1, finish the last one.
+        void begin(cv::Mat& image);
+        void addRow(int v);
+        void finish();
+
+    private:
+        void smoothRowHorizontally(int v, int c_begin, int c_end);
+        void writeRow(int v, int c_begin, int c_end);
+        float* ringRow(int v);
+
+        cv::Mat image_;
+        std::vector<float> ring_; // Horizontally smoothed rows v - 1, v, v + 1
+        const int* col_begin_;    // NULL: all columns
+        const int* col_end_;
+    };
+
+    // The same smoothing at a single pixel of an unsmoothed image, unrounded, in the units of
+    // the image
+    float smoothedDepth(const cv::Mat& image, int u, int v);
+}
+
+#endif //DEPTH_FLIGHT_CONTROLLER_DEPTH_SMOOTHING_H
@@ -0,0 +1,44 @@
+#ifndef DEPTH_FLIGHT_CONTROLLER_FREE_SPACE_GAP_INDEX_H
+#define DEPTH_FLIGHT_CONTROLLER_FREE_SPACE_GAP_INDEX_H
+
+#include "horizon_analyzer.h"
+
+namespace depth_flight_controller
+{
+    // A run of free space along the horizon line
+    struct FreeSpaceGap
+    {
+        int begin; // First sample of the run on the line
+        int end;   // Last sample
+        float min_depth; // [m]
+        float width;     // [m], across the run at min_depth
+        float bearing;   // [rad] of the middle sample, positive left of the horizon center
+    };
+
+    // All runs of free space along the horizon line, left to right, as candidates for the
+    // target. The capacity is fixed, so building the index does not allocate; runs beyond
+    // it are only counted. Bearings and widths follow the target of the TargetFinder: the
+    // signed distance along the line from the center over the focal length.
+    class FreeSpaceGapIndex
+    {
+    public:
+        static const int kMaxGaps = 32;
+
+        FreeSpaceGapIndex();
+
+        // depth: the samples of line [m], e.g. HorizonAnalyzer::sampleDepths
+        void build(const float* depth, const HorizonLine& line, float free_space_depth, double focal_length);
+        void clear();
+
+        int size() const;
+        int dropped() const; // Runs that did not fit
+        const FreeSpaceGap& operator[](int i) const;
+
+    private:
+        FreeSpaceGap gaps_[kMaxGaps];
+        int n_gaps_;
+        int n_dropped_;
+    };
+}
+
+#endif //DEPTH_FLIGHT_CONTROLLER_FREE_SPACE_GAP_INDEX_H
@@ -0,0 +1,62 @@
+#ifndef DEPTH_FLIGHT_CONTROLLER_HEAP_ALLOCATION_CHECK_H
+#define DEPTH_FLIGHT_CONTROLLER_HEAP_ALLOCATION_CHECK_H
+
+#include <ros/console.h>
+#include <string>
+#include "allocation_counter.h"
+
+namespace depth_flight_controller
+{
+    // Heap allocations of an operation that runs once per frame, such as the c-space
+    // expansion. The first run after a reset (new lookup tables) may allocate its buffers;
+    // any later run that allocates is warned about.
+    class HeapAllocationCheck
+    {
+    public:
+        HeapAllocationCheck()
+                : count_before_(0),
+                  allocations_(0),
+                  runs_(0)
+        {
+        }
+
+        void begin()
+        {
+            count_before_ = heapAllocationCount();
+        }
+
+        // operation and mode name the run in the warning, e.g. "c-space expansion (pruned)"
+        void end(const char* operation, const std::string& mode = std::string())
+        {
+            allocations_ = heapAllocationCount() - count_before_;
+            ++runs_;
+
+            if (runs_ > 1 && allocations_ > 0)
+            {
+                if (mode.empty())
+                    ROS_WARN_THROTTLE(5.0, "%s allocated %lu times on the heap in steady state", operation,
+                                      allocations_);
+                else
+                    ROS_WARN_THROTTLE(5.0, "%s (%s) allocated %lu times on the heap in steady state", operation,
+                                      mode.c_str(), allocations_);
+            }
+        }
+
+        void reset()
+        {
+            runs_ = 0;
+        }
+
+        unsigned long allocations() const // operator new calls of the last run
+        {
+            return allocations_;
+        }
+
+    private:
+        unsigned long count_before_;
+        unsigned long allocations_;
+        int runs_;
+    };
+}
+
+#endif //DEPTH_FLIGHT_CONTROLLER_HEAP_ALLOCATION_CHECK_H
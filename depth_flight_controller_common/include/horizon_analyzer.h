@@ -0,0 +1,94 @@
+#ifndef DEPTH_FLIGHT_CONTROLLER_HORIZON_ANALYZER_H
+#define DEPTH_FLIGHT_CONTROLLER_HORIZON_ANALYZER_H
+
+#include "horizon_gather_kernel.h"
+#include <opencv2/core/core.hpp>
+#include <vector>
+
+namespace depth_flight_controller
+{
+    // The pixels under a horizon line from edge_left to edge_right, in the order cv::LineIterator
+    // (8-connected) walks them, with their indices v * width + u into the image
+    struct HorizonLine
+    {
+        HorizonLine();
+
+        // image only provides the size. The line is walked from left to right.
+        void build(const cv::Mat& image, cv::Point edge_left, cv::Point edge_right, cv::Point center);
+
+        cv::Point edge_left;
+        cv::Point edge_right;
+        cv::Point center;
+        bool valid; // Usable for the target search, set by the owner of the line
+        std::vector<cv::Point> position;
+        std::vector<int> pixel;
+    };
+
+    // Statistics of the expanded depth along the horizon line, see HorizonAnalyzer. Depths
+    // in [m]. Minima of 6 m with an unset position mean that no pixel qualified.
+    struct HorizonStats
+    {
+        // Farthest sample (ties: the one nearest to the center). Once a sample of at least
+        // the free-space depth is the farthest, the samples of its run take over one by one.
+        float max_depth; // -1 for an empty line
+        cv::Point max_depth_pos;
+
+        // Nearest sample left / right of the center column (ties: the one farthest from the
+        // center), and the nearest sample between the column of max_depth_pos (exclusive) and
+        // the center column (inclusive)
+        float min_depth_left;
+        cv::Point min_depth_left_pos;
+        float min_depth_right;
+        cv::Point min_depth_right_pos;
+        float min_depth_ib;
+        cv::Point min_depth_ib_pos;
+
+        // Samples [free_space_begin, free_space_begin + free_space_length) of the line, the
+        // run of free space that ends in max_depth_pos (length 0 if there is none)
+        int free_space_begin;
+        int free_space_length;
+    };
+
+    // Analyses the horizon in a single pass over the line: the depths under the line are
+    // gathered into a contiguous array, then one sweep over it yields all of HorizonStats.
+    // The array is kept from frame to frame.
+    class HorizonAnalyzer
+    {
+    public:
+        explicit HorizonAnalyzer(float free_space_depth = 4.5f);
+
+        // depth: CV_32FC1 in [m] or CV_16UC1 in [mm], of the size line was built for
+        void analyze(const cv::Mat& depth, const HorizonLine& line, HorizonStats& stats);
+
+        float sampleDepth(int i) const; // [m], of the last analyze call
+        const float* sampleDepths() const;
+
+        // Parallel bands: the line moved down by band_offset[b] rows (negative: up). The bands
+        // are gathered together in one pass over the samples, then each is swept like a
+        // single line, so stats[b] is in the image positions of band b and its free space
+        // run holds the line samples of the same indices. Band samples outside the image
+        // read as 0 m, i.e. blocked.
+        void analyzeBands(const cv::Mat& depth, const HorizonLine& line, const std::vector<int>& band_offset,
+                          std::vector<HorizonStats>& stats);
+
+        float bandSampleDepth(int band, int i) const; // [m], of the last analyzeBands call
+        const float* bandSampleDepths(int band) const;
+
+        void setSimdEnabled(bool enabled);
+        const char* gatherKernelName() const;
+
+    private:
+        void gather(const cv::Mat& depth, const HorizonLine& line);
+        void gatherBands(const cv::Mat& depth, const HorizonLine& line, const std::vector<int>& band_offset);
+        void sweep(const float* depth, const HorizonLine& line, int row_offset, HorizonStats& stats) const;
+
+        float free_space_depth_;
+        HorizonGatherKernel gather_kernel_;
+        std::vector<float> depth_;
+        std::vector<float> band_depth_; // [band][sample], band_step_ samples per band
+        std::vector<int> band_pixel_offset_;
+        int band_step_;
+    };
+}
+
+#endif //DEPTH_FLIGHT_CONTROLLER_HORIZON_ANALYZER_H
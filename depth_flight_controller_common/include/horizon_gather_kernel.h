@@ -0,0 +1,27 @@
+#ifndef DEPTH_FLIGHT_CONTROLLER_HORIZON_GATHER_KERNEL_H
+#define DEPTH_FLIGHT_CONTROLLER_HORIZON_GATHER_KERNEL_H
+
+namespace depth_flight_controller
+{
+    // Depths under horizon bands: dst[b * dst_step + i] = src[index[i] + offset[b]] for the
+    // bands b in [0, n_bands) and the samples i in [0, n), or 0 where index[i] + offset[b]
+    // is not in [0, n_pixels). src is a continuous CV_32FC1 image of n_pixels and offset[b]
+    // a multiple of its width, so 0 marks the samples whose band row left the image. The
+    // bands of a block of samples are gathered together, i.e. column by column.
+    typedef void (*HorizonGatherKernel)(const float* src, int n_pixels, const int* index, int n,
+                                        const int* offset, int n_bands, float* dst, int dst_step);
+
+    void horizonGatherScalar(const float* src, int n_pixels, const int* index, int n, const int* offset,
+                             int n_bands, float* dst, int dst_step);
+#if defined(__x86_64__) || defined(__i386__)
+    void horizonGatherAvx2(const float* src, int n_pixels, const int* index, int n, const int* offset,
+                           int n_bands, float* dst, int dst_step);
+#endif
+
+    // AVX2 gathers are detected at runtime like the span kernels. NEON has no gather
+    // instruction, so ARM uses the scalar kernel.
+    HorizonGatherKernel selectHorizonGatherKernel(bool allow_simd = true);
+    const char* horizonGatherKernelName(HorizonGatherKernel kernel);
+}
+
+#endif //DEPTH_FLIGHT_CONTROLLER_HORIZON_GATHER_KERNEL_H
@@ -0,0 +1,125 @@
+#ifndef DEPTH_FLIGHT_CONTROLLER_HORIZON_GEOMETRY_H
+#define DEPTH_FLIGHT_CONTROLLER_HORIZON_GEOMETRY_H
+
+#include <opencv2/core/core.hpp>
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+#include <math.h>
+
+namespace depth_flight_controller
+{
+    // Pixels of the horizon for a camera attitude, in closed form. The tilt (roll and pitch,
+    // without yaw) follows from the last row of the attitude's rotation matrix, and the
+    // horizon points are projected through a pinhole camera without distortion, which is
+    // what cv::Rodrigues and cv::projectPoints computed before, minus the allocations.
+    // Header only, so that the expander, the target finders and the plotter share it.
+    class HorizonGeometry
+    {
+    public:
+        HorizonGeometry()
+                : focal_length_u_(1),
+                  focal_length_v_(1),
+                  center_u_(0),
+                  center_v_(0)
+        {
+            body_cam_rot_.setIdentity();
+            for (int i = 0; i < 3; ++i)
+                point_[i].setZero();
+        }
+
+        void setIntrinsics(double focal_length_u, double focal_length_v, double center_u, double center_v)
+        {
+            focal_length_u_ = focal_length_u;
+            focal_length_v_ = focal_length_v;
+            center_u_ = center_u;
+            center_v_ = center_v;
+        }
+
+        // K: 3x3 CV_64FC1 camera matrix. Skew is ignored, as cv::projectPoints does.
+        void setIntrinsics(const cv::Mat& K)
+        {
+            CV_Assert(K.rows == 3 && K.cols == 3 && K.type() == CV_64FC1);
+            setIntrinsics(K.at<double>(0, 0), K.at<double>(1, 1), K.at<double>(0, 2), K.at<double>(1, 2));
+        }
+
+        // Rotation from the tilted body frame into the camera frame
+        void setBodyToCamera(const Eigen::Matrix3d& body_cam_rot)
+        {
+            body_cam_rot_ = body_cam_rot;
+        }
+
+        // Left, right and center point of the horizon in the frame of the level body
+        void setHorizonPoints(const Eigen::Vector3d& left, const Eigen::Vector3d& right, const Eigen::Vector3d& center)
+        {
+            point_[0] = left;
+            point_[1] = right;
+            point_[2] = center;
+        }
+
+        // eulerAnglesZYXToRotationMatrix(roll, pitch, 0) for the roll and pitch of q. The last
+        // row of the rotation of q, (-sin(pitch), cos(pitch) sin(roll), cos(pitch) cos(roll)),
+        // does not depend on the yaw and yields the tilt with a single square root.
+        static Eigen::Matrix3d tilt(const Eigen::Quaterniond& q)
+        {
+            double g_x = 2 * (q.x() * q.z() - q.w() * q.y());
+            double g_y = 2 * (q.y() * q.z() + q.w() * q.x());
+            double g_z = q.w() * q.w() - q.x() * q.x() - q.y() * q.y() + q.z() * q.z();
+
+            double cos_pitch_norm = sqrt(g_y * g_y + g_z * g_z);
+            double norm = sqrt(g_x * g_x + cos_pitch_norm * cos_pitch_norm);
+            if (norm == 0)
+                return Eigen::Matrix3d::Identity();
+
+            double sin_pitch = -g_x / norm;
+            double cos_pitch = cos_pitch_norm / norm;
+            double sin_roll = 0;
+            double cos_roll = 1; // Roll is undefined at +-90 deg pitch
+            if (cos_pitch_norm > 0)
+            {
+                sin_roll = g_y / cos_pitch_norm;
+                cos_roll = g_z / cos_pitch_norm;
+            }
+            return tilt(sin_roll, cos_roll, sin_pitch, cos_pitch);
+        }
+
+        // Angles in [rad]
+        static Eigen::Matrix3d tilt(double roll, double pitch)
+        {
+            return tilt(sin(roll), cos(roll), sin(pitch), cos(pitch));
+        }
+
+        // Pixels of the horizon points for the tilt, unrounded
+        void project(const Eigen::Matrix3d& tilt, cv::Point2d& left, cv::Point2d& right, cv::Point2d& center) const
+        {
+            const Eigen::Matrix3d cam_tilt = body_cam_rot_ * tilt;
+            left = projectPoint(cam_tilt * point_[0]);
+            right = projectPoint(cam_tilt * point_[1]);
+            center = projectPoint(cam_tilt * point_[2]);
+        }
+
+    private:
+        static Eigen::Matrix3d tilt(double sin_roll, double cos_roll, double sin_pitch, double cos_pitch)
+        {
+            Eigen::Matrix3d rot;
+            rot << cos_pitch, sin_pitch * sin_roll, sin_pitch * cos_roll,
+                   0, cos_roll, -sin_roll,
+                   -sin_pitch, cos_pitch * sin_roll, cos_pitch * cos_roll;
+            return rot;
+        }
+
+        cv::Point2d projectPoint(const Eigen::Vector3d& p) const
+        {
+            double inv_z = p(2) != 0 ? 1 / p(2) : 1; // As cv::projectPoints
+            return cv::Point2d(focal_length_u_ * p(0) * inv_z + center_u_, focal_length_v_ * p(1) * inv_z + center_v_);
+        }
+
+        double focal_length_u_;
+        double focal_length_v_;
+        double center_u_;
+        double center_v_;
+        Eigen::Matrix3d body_cam_rot_;
+        Eigen::Vector3d point_[3]; // Left, right, center
+    };
+}
+
+#endif //DEPTH_FLIGHT_CONTROLLER_HORIZON_GEOMETRY_H
@@ -0,0 +1,87 @@
+#ifndef DEPTH_FLIGHT_CONTROLLER_HORIZON_LINE_CACHE_H
+#define DEPTH_FLIGHT_CONTROLLER_HORIZON_LINE_CACHE_H
+
+#include "horizon_analyzer.h"
+#include <opencv2/core/core.hpp>
+#include <vector>
+
+namespace depth_flight_controller
+{
+    // Where the horizon lies in the image for a camera attitude
+    class HorizonProjector
+    {
+    public:
+        virtual ~HorizonProjector() {}
+
+        // Horizon at roll and pitch [rad] in an image of image_size: the line from edge_left
+        // to edge_right and its center. Returns whether the line is usable for the target search.
+        virtual bool projectHorizon(double roll, double pitch, const cv::Size& image_size, cv::Point& edge_left,
+                                    cv::Point& edge_right, cv::Point& center) const = 0;
+    };
+
+    // Horizon lines by camera attitude. Roll and pitch are quantised to the resolution, and
+    // every bin within [-max_roll, max_roll] x [-max_pitch, max_pitch] holds the ready-made
+    // pixel index list of the line of its center attitude along with its end points, center and
+    // validity, so that a lookup replaces both the projection and the line walk. A bin has room
+    // for the longest line of the image, max(width, height) samples at 4 bytes, and all bins
+    // never take more than max_bytes: a resolution too fine for that is coarsened (see
+    // resolution()). Either build all bins once, after which find is read-only and may be
+    // shared between threads, or let lookup build them on first use (not thread-safe).
+    class HorizonLineCache
+    {
+    public:
+        static const size_t kDefaultMaxBytes = 4 << 20;
+
+        HorizonLineCache();
+
+        // Drops all lines. Angles in [rad].
+        void configure(const cv::Size& image_size, double resolution, double max_roll, double max_pitch,
+                       size_t max_bytes = kDefaultMaxBytes);
+        const cv::Size& imageSize() const;
+        double resolution() const; // [rad], as configured or coarsened to max_bytes
+        size_t bytes() const;      // Of the bins
+
+        void build(const HorizonProjector& projector);
+
+        // Copies the line of the bin of the attitude into line. False if the attitude is outside
+        // the table or its bin was not built yet.
+        bool find(double roll, double pitch, HorizonLine& line) const;
+
+        // Line of the bin of the attitude, built on first use and copied from the bin when the
+        // bin differs from the last call. Attitudes outside the table are projected and walked
+        // exactly. The line is valid until the next call.
+        const HorizonLine& lookup(double roll, double pitch, const HorizonProjector& projector);
+
+        int builtLines() const;
+
+    private:
+        enum BinState { BIN_EMPTY = 0, BIN_BUILT, BIN_BUILT_VALID };
+
+        struct Bin
+        {
+            short edge_left_x, edge_left_y;
+            short edge_right_x, edge_right_y;
+            short center_x, center_y;
+            unsigned short n_samples;
+            unsigned char state; // BinState
+        };
+
+        int binOf(double roll, double pitch) const; // -1 outside the table
+        void buildBin(int bin, const HorizonProjector& projector, HorizonLine& line);
+        void copyBin(int bin, HorizonLine& line) const;
+
+        cv::Size image_size_;
+        cv::Mat image_shape_; // Only walked by the line iterator
+        double resolution_;
+        int half_rolls_;  // Bins on either side of roll 0
+        int half_pitches_;
+        int max_samples_; // Per bin
+        std::vector<Bin> bins_;   // [roll bin][pitch bin]
+        std::vector<int> pixels_; // [bin][max_samples_], v * width + u
+        int n_built_;
+        HorizonLine line_;
+        int line_bin_; // Bin copied into line_, -1 if none
+    };
+}
+
+#endif //DEPTH_FLIGHT_CONTROLLER_HORIZON_LINE_CACHE_H
@@ -15,17 +15,23 @@
 #include <math.h>
 #include <algorithm>
 #include <fstream>
+#include "depth_image.h"
+#include "depth_prepass.h"
+#include "image_message_buffer.h"
 
 namespace depth_flight_controller
 {
     class ImageClipper
     {
     public:
-        ImageClipper();
+        explicit ImageClipper(const ros::NodeHandle& nh = ros::NodeHandle(), const ros::NodeHandle& pnh = ros::NodeHandle("~"));
         ~ImageClipper();
 
         void imageCallback(const sensor_msgs::ImageConstPtr& msg);
 
+        // Fills the NaNs of a frame [m]. A CV_16UC1 depth_img_clipped receives the result in [mm].
+        static void clipImage(const cv::Mat& depth_float_img, cv::Mat& depth_img_clipped);
+
     protected:
         ros::NodeHandle nh_;
         image_transport::ImageTransport it_;
@@ -34,8 +40,9 @@ namespace depth_flight_controller
         image_transport::Publisher image_pub_;
 
     private:
-        cv::Mat depth_float_img_original_;
-        cv::Mat depth_float_img_clipped_;
+        cv::Mat depth_img_clipped_; // Header over the data of clipped_msg_
+        ImageMessageBuffer clipped_msg_;
+        std::string depth_encoding_; // Of the clipped image: "32FC1" [m] (default) or "16UC1" [mm]
     };
 }
 
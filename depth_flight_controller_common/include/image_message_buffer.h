@@ -0,0 +1,49 @@
+#ifndef DEPTH_FLIGHT_CONTROLLER_IMAGE_MESSAGE_BUFFER_H
+#define DEPTH_FLIGHT_CONTROLLER_IMAGE_MESSAGE_BUFFER_H
+
+#include <boost/make_shared.hpp>
+#include <cv_bridge/cv_bridge.h>
+#include <sensor_msgs/Image.h>
+#include <opencv2/core/core.hpp>
+
+namespace depth_flight_controller
+{
+    // Outgoing image message that a node writes its result into directly. It is published as
+    // a shared pointer, so subscribers in the same process get it without a copy, and its data
+    // is reused for the next frame as soon as no subscriber holds the last one anymore.
+    class ImageMessageBuffer
+    {
+    public:
+        // Header over the data of the message for a rows x cols image of the given encoding.
+        // Only allocates if the last message is still held by a subscriber or the size changed.
+        cv::Mat acquire(const std_msgs::Header& header, int rows, int cols, const std::string& encoding)
+        {
+            // A published message must not change while someone can still read it
+            if (!message_ || !message_.unique())
+                message_ = boost::make_shared<sensor_msgs::Image>();
+
+            int type = cv_bridge::getCvType(encoding);
+            size_t step = size_t(cols) * CV_ELEM_SIZE(type);
+
+            message_->header = header;
+            message_->height = rows;
+            message_->width = cols;
+            message_->encoding = encoding;
+            message_->is_bigendian = false;
+            message_->step = step;
+            message_->data.resize(step * rows);
+
+            return cv::Mat(rows, cols, type, &message_->data[0], step);
+        }
+
+        const sensor_msgs::ImagePtr& message() const
+        {
+            return message_;
+        }
+
+    private:
+        sensor_msgs::ImagePtr message_;
+    };
+}
+
+#endif //DEPTH_FLIGHT_CONTROLLER_IMAGE_MESSAGE_BUFFER_H
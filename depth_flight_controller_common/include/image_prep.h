@@ -19,6 +19,7 @@
 #include "geometry_msgs/Quaternion.h"
 #include "quad_msgs/QuadStateEstimate.h"
 #include "depth_flight_controller_msgs/HorizonPoints.h"
+#include "depth_image.h"
 #include "quad_common/quad_state.h"
 #include <iostream>
 #include <string>
@@ -36,7 +37,7 @@ namespace depth_flight_controller
     class ImagePrep
     {
     public:
-        ImagePrep();
+        explicit ImagePrep(const ros::NodeHandle& nh = ros::NodeHandle());
         ~ImagePrep();
 
         void originalImageCallback(const sensor_msgs::ImageConstPtr& msg);
@@ -64,6 +65,7 @@ namespace depth_flight_controller
         sensor_msgs::Image depth_rgb_img_ros_;
         sensor_msgs::Image original_depth_img_ros_;
 
+        cv_bridge::CvImageConstPtr cv_ptr_original_; // Keeps the shared data of depth_original_img_ alive
         cv::Mat depth_original_img_;
         cv::Mat depth_horizon_img_;
 
@@ -0,0 +1,46 @@
+#ifndef DEPTH_FLIGHT_CONTROLLER_LOOKUP_TABLE_FILE_H
+#define DEPTH_FLIGHT_CONTROLLER_LOOKUP_TABLE_FILE_H
+
+#include <stddef.h>
+#include <string>
+
+namespace depth_flight_controller
+{
+    struct LookupTableConfig;
+
+    // Read-only memory mapping of the (u,z) / (v,z) span tables stored by write(). The file
+    // starts with a versioned header holding everything the tables depend on (image size,
+    // intrinsics, drone radius, depth precision and range); open() refuses files whose header
+    // does not match the requested configuration, so a stale file is simply rebuilt.
+    class LookupTableFile
+    {
+    public:
+        LookupTableFile();
+        ~LookupTableFile();
+
+        bool open(const std::string& path, const LookupTableConfig& config, int precision);
+        void close();
+        bool isOpen() const;
+
+        const int* utable() const; // [u][z][2], valid while open
+        const int* vtable() const; // [v][z][2]
+
+        // Writes to a temporary file that is synced to disk and then renamed over path, so a
+        // concurrent open() never sees a partial file, a crash never leaves one behind, and an
+        // existing mapping of the old file stays valid
+        static bool write(const std::string& path, const LookupTableConfig& config, int precision,
+                          const int* utable, const int* vtable);
+
+        // $ROS_HOME/<file_name>, falling back to ~/.ros/<file_name>
+        static std::string defaultPath(const std::string& file_name);
+
+    private:
+        LookupTableFile(const LookupTableFile&);
+        LookupTableFile& operator=(const LookupTableFile&);
+
+        void* data_;
+        size_t size_;
+    };
+}
+
+#endif //DEPTH_FLIGHT_CONTROLLER_LOOKUP_TABLE_FILE_H
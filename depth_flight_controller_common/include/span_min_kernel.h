@@ -0,0 +1,25 @@
+#ifndef DEPTH_FLIGHT_CONTROLLER_SPAN_MIN_KERNEL_H
+#define DEPTH_FLIGHT_CONTROLLER_SPAN_MIN_KERNEL_H
+
+namespace depth_flight_controller
+{
+    // dst[i] = min(dst[i], value) for i in [0, n). NaN entries of dst are kept, which
+    // matches std::min(dst[i], value) and the cv::Mat based stamping.
+    typedef void (*SpanMinKernel)(float* dst, int n, float value);
+
+    void spanMinScalar(float* dst, int n, float value);
+#if defined(__x86_64__) || defined(__i386__)
+    void spanMinAvx2(float* dst, int n, float value);
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    void spanMinNeon(float* dst, int n, float value);
+#endif
+
+    // Picks the widest kernel the running CPU supports. AVX2 is detected at runtime, so
+    // the package does not need to be built with -mavx2. NEON is used whenever the
+    // compiler targets it (always the case on aarch64).
+    SpanMinKernel selectSpanMinKernel(bool allow_simd = true);
+    const char* spanMinKernelName(SpanMinKernel kernel);
+}
+
+#endif //DEPTH_FLIGHT_CONTROLLER_SPAN_MIN_KERNEL_H
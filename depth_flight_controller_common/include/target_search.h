@@ -0,0 +1,24 @@
+#ifndef DEPTH_FLIGHT_CONTROLLER_TARGET_SEARCH_H
+#define DEPTH_FLIGHT_CONTROLLER_TARGET_SEARCH_H
+
+#include <opencv2/core/core.hpp>
+#include "quad_msgs/QuadStateEstimate.h"
+#include "quad_common/quad_state.h"
+
+namespace depth_flight_controller
+{
+    // The last stage of the depth pipeline, implemented by the target finder of each planner
+    // package: looks for the target in an expanded depth frame and publishes it
+    class TargetSearch
+    {
+    public:
+        virtual ~TargetSearch() {}
+
+        // depth_expanded_img: CV_32FC1 in [m] or CV_16UC1 in [mm], with the state estimate the
+        // frame arrived with
+        virtual void findTarget(const cv::Mat& depth_expanded_img, const quad_common::QuadState& state_estimate_image,
+                                const quad_msgs::QuadStateEstimate& state_estimate_image_msg) = 0;
+    };
+}
+
+#endif //DEPTH_FLIGHT_CONTROLLER_TARGET_SEARCH_H
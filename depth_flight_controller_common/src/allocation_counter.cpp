@@ -0,0 +1,52 @@
+#include "allocation_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+#if __cplusplus >= 201103L
+#define DFC_THROW_BAD_ALLOC
+#define DFC_NOEXCEPT noexcept
+#else
+#define DFC_THROW_BAD_ALLOC throw(std::bad_alloc)
+#define DFC_NOEXCEPT throw()
+#endif
+
+namespace
+{
+    // Per thread, so that the spinner and transport threads of roscpp do not show up in the
+    // count of the thread that expands a frame
+    __thread unsigned long heap_allocation_count = 0;
+}
+
+namespace depth_flight_controller
+{
+    unsigned long heapAllocationCount()
+    {
+        return heap_allocation_count;
+    }
+}
+
+void* operator new(std::size_t size) DFC_THROW_BAD_ALLOC
+{
+    ++heap_allocation_count;
+
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if (p == 0)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](std::size_t size) DFC_THROW_BAD_ALLOC
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) DFC_NOEXCEPT
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) DFC_NOEXCEPT
+{
+    std::free(p);
+}
@@ -3,146 +3,81 @@
 
 namespace depth_flight_controller {
 
-    CSpaceExpander::CSpaceExpander()
-            : it_(nh_)
+    CSpaceExpander::CSpaceExpander(const ros::NodeHandle& nh, const ros::NodeHandle& pnh, bool connect_topics)
+            : nh_(nh),
+              it_(nh_)
     {
-        double focal_length_ = 151.81;
-        double drone_radius_ = 0.3;
-
-        // Build (u,z) lookup table
-        for (int u = 0; u < 160; ++u)
-            for (int z_cm = 0; z_cm <= max_depth_; ++z_cm) {
-                float z = float(z_cm) / 100;
-                float x_u = (float(u) - 80) * z / focal_length_;
-                float alpha_u = atan(x_u/z);
-                float dist_to_point = (sqrt(pow(z, 2) + pow(x_u, 2)));
-
-                float alpha_1_u;
-                float r_1_x_u;
-                float r_2_x_u;
-                int u_low;
-                int u_high;
-
-                if (dist_to_point > 0.2)
-                {
-                    if (z > 0.205)
-                    {
-                        alpha_1_u = asin(drone_radius_ / dist_to_point);
-                        r_1_x_u = z * tan(alpha_u - alpha_1_u);
-                        r_2_x_u = z * tan(alpha_u + alpha_1_u);
-
-                        u_low = int(focal_length_ * r_1_x_u / z) +80;
-                        u_low = std::min(std::max(u_low , 0),159);
-                        utable_[u][z_cm][0] = u_low;
-
-                        u_high = int(focal_length_ * r_2_x_u / z+80);
-                        u_high = std::min(std::max(u_high , 0),159);
-                        utable_[u][z_cm][1] = u_high-u_low+1;
-
-                    } else if (u < 80 )
-                    {
-                        alpha_1_u = asin(drone_radius_ / dist_to_point);
-                        r_2_x_u = z * tan(alpha_u + alpha_1_u);
-
-                        u_low = 0;
-                        utable_[u][z_cm][0] = u_low;
-
-                        u_high = int(focal_length_ * r_2_x_u / z+80);
-                        u_high = std::min(std::max(u_high , 0),159);
-                        utable_[u][z_cm][1] = u_high-u_low+1;
-                    } else
-                    {
-                        alpha_1_u = asin(drone_radius_ / dist_to_point);
-                        r_1_x_u = z * tan(alpha_u - alpha_1_u);
-
-                        u_low = int(focal_length_ * r_1_x_u / z) +80;
-                        u_low = std::min(std::max(u_low , 0),159);
-                        utable_[u][z_cm][0] = u_low;
-
-                        u_high = 159;
-                        utable_[u][z_cm][1] = u_high-u_low+1;
-                    }
-
-                } else
-                {
-                    utable_[u][z_cm][0] = 0;
-                    utable_[u][z_cm][1] = 159;
-                }
-            }
-
-        // Build (v,z) lookup table
-        for (int v = 0; v < 120; ++v)
-            for (int z_cm = 0; z_cm <= max_depth_; ++z_cm) {
-                float z = float(z_cm) / 100;
-                float y_v = (float(v) - 60) * z / focal_length_;
-                float alpha_v = atan(y_v /z);
-                float dist_to_point = (sqrt(pow(z, 2) + pow(y_v, 2)));
-
-                float alpha_1_v;
-                float r_1_y_v;
-                float r_2_y_v;
-                int v_low;
-                int v_high;
-
-                if (dist_to_point > 0.2)
-                {
-                    if (z > 0.205)
-                    {
-                        alpha_1_v = asin(drone_radius_ / dist_to_point);
-                        r_1_y_v = z * tan(alpha_v - alpha_1_v);
-                        r_2_y_v = z * tan(alpha_v + alpha_1_v);
-
-                        v_low = int(focal_length_ * r_1_y_v / z) +60;
-                        v_low = std::min(std::max(v_low , 0),119);
-                        vtable_[v][z_cm][0] = v_low;
-
-                        v_high = int(focal_length_ * r_2_y_v / z+60);
-                        v_high = std::min(std::max(v_high,0),119);
-                        vtable_[v][z_cm][1] = v_high-v_low+1;
-                    } else if (v < 60 )
-                    {
-                        alpha_1_v = asin(drone_radius_ / dist_to_point);
-                        r_2_y_v = z * tan(alpha_v + alpha_1_v);
-
-                        v_low = 0;
-                        vtable_[v][z_cm][0] = v_low;
-
-                        v_high = int(focal_length_ * r_2_y_v / z+60);
-                        v_high = std::min(std::max(v_high,0),119);
-                        vtable_[v][z_cm][1] = v_high-v_low+1;
-                    } else
-                    {
-                        alpha_1_v = asin(drone_radius_ / dist_to_point);
-                        r_1_y_v = z * tan(alpha_v - alpha_1_v);
-
-                        v_low = int(focal_length_ * r_1_y_v / z) +60;
-                        v_low = std::min(std::max(v_low , 0),119);
-                        vtable_[v][z_cm][0] = v_low;
-
-                        v_high = 119;
-                        vtable_[v][z_cm][1] = v_high-v_low+1;
-                    }
-
-                } else
-                {
-                    alpha_1_v = 0;
-                    r_1_y_v = 0;
-                    r_2_y_v = 0;
-                    v_low = 0;
-                    vtable_[v][z_cm][0] = 0;
-                    v_high = 0;
-                    vtable_[v][z_cm][1] = 119;
-                }
-            }
+        pnh.param("drone_radius", drone_radius_, 0.3);
+        pnh.param("max_depth", max_depth_, 5.0);
+        pnh.param<std::string>("lookup_table_cache", lookup_table_cache_, LookupTableFile::defaultPath("c_space_expander_tables.bin"));
 
-        for (int z_cm = 0; z_cm < max_depth_; ++z_cm)
-            reduced_depth_[z_cm] = float(std::max(z_cm,20))/100-drone_radius_;
+        pnh.param<std::string>("expansion_mode", expansion_mode_, "separable");
+        pnh.param<std::string>("depth_encoding", depth_encoding_, "32FC1");
+        if (!isDepthEncoding(depth_encoding_))
+        {
+            ROS_WARN("Unknown depth_encoding %s, using 32FC1", depth_encoding_.c_str());
+            depth_encoding_ = "32FC1";
+        }
 
-        image_sub_ = it_.subscribe("/hummingbird/vi_sensor/camera_depth/depth/disparity", 1, &CSpaceExpander::imageCb, this);
-        image_pub_ = it_.advertise("/hummingbird/vi_sensor/camera_depth/depth/expanded", 1);
+        // The uint16 image is expanded by the modes that write through typed row pointers
+        if (depth_encoding_ == "16UC1" && expansion_mode_ != "separable" && expansion_mode_ != "pruned" &&
+            expansion_mode_ != "range_min" && expansion_mode_ != "stamp")
+        {
+            ROS_WARN("c-space expansion mode %s does not support 16UC1 images, using separable", expansion_mode_.c_str());
+            expansion_mode_ = "separable";
+        }
+        is_depth_ordered_mode_ = expansion_mode_ != "stamp" && expansion_mode_ != "row_pointers" &&
+                                 expansion_mode_ != "parallel";
+
+        bool use_simd;
+        pnh.param("use_simd", use_simd, true);
+        engine_.setSimdEnabled(use_simd);
+
+        bool use_prebuilt_shapes;
+        pnh.param("use_prebuilt_shapes", use_prebuilt_shapes, true);
+        engine_.setPrebuiltShapesEnabled(use_prebuilt_shapes);
+
+        int incremental_tile_size;
+        pnh.param("incremental_tile_size", incremental_tile_size, 16);
+        engine_.setIncrementalTileSize(std::max(incremental_tile_size, 1));
+
+        int pyramid_factor;
+        double pyramid_max_error;
+        pnh.param("pyramid_factor", pyramid_factor, 2);
+        pnh.param("pyramid_max_error", pyramid_max_error, 0.1);
+        engine_.setPyramid(std::max(pyramid_factor, 1), std::max(pyramid_max_error, 1e-3));
+
+        int expansion_threads;
+        pnh.param("expansion_threads", expansion_threads, cv::getNumThreads());
+        engine_.setParallelBands(expansion_threads);
+
+        bool share_lookup_tables;
+        pnh.param("share_lookup_tables", share_lookup_tables, false);
+        engine_.setSharedTables(share_lookup_tables);
+        ROS_INFO("c-space expansion mode: %s, span kernel: %s, depth encoding: %s", expansion_mode_.c_str(),
+                 engine_.spanMinKernelName(), depth_encoding_.c_str());
+
+        if (connect_topics)
+        {
+            image_sub_ = it_.subscribe("/hummingbird/vi_sensor/camera_depth/depth/disparity", 1, &CSpaceExpander::imageCb, this);
+            image_pub_ = it_.advertise("/hummingbird/vi_sensor/camera_depth/depth/expanded", 1);
 
-        state_estimate_original_img_pub_ = nh_.advertise<quad_msgs::QuadStateEstimate>("/hummingbird/state_estimate_original_img", 1);
-        state_estimate_sub_ = nh_.subscribe("/hummingbird/state_estimate", 1, &CSpaceExpander::stateEstimateCallback, this);
+            state_estimate_original_img_pub_ = nh_.advertise<quad_msgs::QuadStateEstimate>("/hummingbird/state_estimate_original_img", 1);
+            state_estimate_sub_ = nh_.subscribe("/hummingbird/state_estimate", 1, &CSpaceExpander::stateEstimateCallback, this);
+        }
+        expansion_stats_pub_ = nh_.advertise<depth_flight_controller_msgs::ExpansionStats>("/hummingbird/c_space_expansion_stats", 1);
+
+        // The lookup tables are built for the camera that is running, from its first CameraInfo
+        // (see cameraInfoCallback), so that a cached file written for it is found again. Waiting
+        // for it here would block the loading thread of a nodelet manager. Frames that arrive
+        // before are dropped by expandDepthImage. Without a CameraInfo within
+        // ~camera_info_timeout [s] the default camera is assumed until one arrives (<= 0: never).
+        camera_info_sub_ = nh_.subscribe("/hummingbird/vi_sensor/camera_depth/depth/camera_info", 1, &CSpaceExpander::cameraInfoCallback, this);
+
+        double camera_info_timeout;
+        pnh.param("camera_info_timeout", camera_info_timeout, 2.0);
+        if (camera_info_timeout > 0)
+            camera_info_timer_ = nh_.createTimer(ros::Duration(camera_info_timeout), &CSpaceExpander::cameraInfoTimeoutCallback, this, true);
     }
 
 
@@ -158,15 +93,82 @@ namespace depth_flight_controller {
     }
 
 
+    void CSpaceExpander::cameraInfoCallback(const sensor_msgs::CameraInfoConstPtr& msg)
+    {
+        if (!hasIntrinsics(*msg))
+            return;
+
+        // Before the first build the engine holds the default configuration without tables
+        LookupTableConfig lookup_table_config = lookupTableConfigFromCameraInfo(*msg, drone_radius_, max_depth_);
+        if (engine_.imageWidth() > 0 && lookup_table_config == engine_.lookupTableConfig())
+            return;
+
+        ROS_INFO("Camera is %dx%d, f = (%.2f, %.2f), c = (%.2f, %.2f): building lookup tables",
+                 msg->width, msg->height, msg->K[0], msg->K[4], msg->K[2], msg->K[5]);
+
+        loadLookupTables(lookup_table_config);
+        expansion_allocations_.reset(); // The first frame after a rebuild may allocate
+        if (!engine_.hasPrebuiltShape())
+            ROS_INFO("No prebuilt expansion passes for %dx%d, using the generic ones", msg->width, msg->height);
+        if (expansion_mode_ == "pyramid")
+            ROS_INFO("Pyramid expansion: depths below %.2f m on the coarse grid", engine_.pyramidSplitDepth() / 100.0);
+    }
+
+    void CSpaceExpander::cameraInfoTimeoutCallback(const ros::TimerEvent& event)
+    {
+        if (engine_.imageWidth() > 0)
+            return;
+
+        LookupTableConfig lookup_table_config = defaultLookupTableConfig(drone_radius_, max_depth_);
+        ROS_WARN("No CameraInfo received, assuming a %dx%d depth camera", lookup_table_config.image_width,
+                 lookup_table_config.image_height);
+        loadLookupTables(lookup_table_config);
+        expansion_allocations_.reset();
+    }
+
+    void CSpaceExpander::loadLookupTables(const LookupTableConfig& config)
+    {
+        focal_length_ = config.focal_length_u;
+        depth_histogram_.resize(config.max_depth);
+
+        if (lookup_table_cache_.empty())
+        {
+            engine_.buildLookupTables(config);
+            prepareRangeMin();
+            return;
+        }
+
+        ros::WallTime start = ros::WallTime::now();
+        CSpaceExpansionEngine::LookupTableSource source = engine_.loadLookupTables(config, lookup_table_cache_);
+        double ms = (ros::WallTime::now() - start).toSec() * 1000;
+
+        if (source == CSpaceExpansionEngine::TABLES_MAPPED)
+            ROS_INFO("Mapped lookup tables from %s in %.1f ms", lookup_table_cache_.c_str(), ms);
+        else if (source == CSpaceExpansionEngine::TABLES_BUILT_AND_CACHED)
+            ROS_INFO("Built lookup tables in %.1f ms and cached them in %s", ms, lookup_table_cache_.c_str());
+        else
+            ROS_WARN("Built lookup tables in %.1f ms, could not write the cache %s", ms, lookup_table_cache_.c_str());
+
+        prepareRangeMin();
+    }
+
+    void CSpaceExpander::prepareRangeMin()
+    {
+        if (expansion_mode_ != "range_min")
+            return;
+
+        ROS_INFO("range_min tables: %.1f MB", engine_.prepareRangeMin() / 1e6);
+    }
+
     void CSpaceExpander::imageCb(const sensor_msgs::ImageConstPtr& msg)
     {
         quad_msgs::QuadStateEstimate state_estimate_original_img_msg = state_estimate_msg_;
 
-        cv_bridge::CvImagePtr cv_ptr_original;
+        cv_bridge::CvImageConstPtr cv_ptr_original;
 
         try
         {
-            cv_ptr_original = cv_bridge::toCvCopy(msg);
+            cv_ptr_original = cv_bridge::toCvShare(msg);
         }
         catch (cv_bridge::Exception& e)
         {
@@ -174,97 +176,138 @@ namespace depth_flight_controller {
             return;
         }
 
-        depth_float_img_original_ = cv_ptr_original->image;
-        cv::Mat mask = cv::Mat(depth_float_img_original_ != depth_float_img_original_);
-        depth_float_img_original_.setTo(4.9, mask);
-
-        depth_float_img_rounded_ = depth_float_img_original_.clone();
-
-        //cv::GaussianBlur(depth_float_img_original_, depth_float_img_original_, cv::Size(3,3), 0, 0 );
-
-        // Round image values to [cm]
-        CSpaceExpander::changeImagePrecision(depth_float_img_original_, depth_float_img_rounded_); // Input: Original image values in [m]; Output: Rounded image values in [cm]
-
-        // Expand c-space
-        CSpaceExpander::expandImage(depth_float_img_original_, depth_float_img_rounded_);
+        // The shared frame is read only. It is expanded into the outgoing message.
+        const cv::Mat& depth_img_shared = cv_ptr_original->image;
+        depth_img_original_ = expanded_msg_.acquire(msg->header, depth_img_shared.rows, depth_img_shared.cols,
+                                                    depth_encoding_);
+        if (!expandDepthImage(depth_img_shared, depth_img_original_))
+            return;
 
         state_estimate_original_img_pub_.publish(state_estimate_original_img_msg);
-        image_pub_.publish(cv_ptr_original->toImageMsg());
+        image_pub_.publish(expanded_msg_.message());
+        publishExpansionStats(msg->header);
     }
 
-    float CSpaceExpander::roundToPrecision(float imageDepth,int precision)
+    void CSpaceExpander::publishExpansionStats(const std_msgs::Header& header)
     {
-        // Do initial checks
-        float roundedImageDepth = roundf(imageDepth * precision_);
-        return roundedImageDepth;
+        expansion_stats_msg_.header = header;
+        expansion_stats_msg_.heap_allocations = expansion_allocations_.allocations();
+        if (expansion_mode_ == "incremental")
+        {
+            const CSpaceExpansionEngine::IncrementalStats& stats = engine_.incrementalStats();
+            expansion_stats_msg_.tiles = stats.tiles;
+            expansion_stats_msg_.changed_tiles = stats.changed_tiles;
+            expansion_stats_msg_.recomputed_tiles = stats.recomputed_tiles;
+            expansion_stats_msg_.recomputed_fraction = stats.tiles > 0 ? float(stats.recomputed_tiles) / stats.tiles : 0.0f;
+        }
+        expansion_stats_pub_.publish(expansion_stats_msg_);
     }
 
-    void CSpaceExpander::changeImagePrecision(cv::Mat& IO, cv::Mat& IR)
+    const std::string& CSpaceExpander::depthEncoding() const
     {
-        // Accept only float type matrices
-        CV_Assert(IO.depth() == CV_32FC1);
-
-        int channels = IO.channels();
-        int nRows = IO.rows;
-        int nCols = IO.cols * channels;
+        return depth_encoding_;
+    }
 
-        if (IO.isContinuous())
+    bool CSpaceExpander::expandDepthImage(const cv::Mat& depth_img, cv::Mat& depth_img_expanded)
+    {
+        if (depth_img.cols != engine_.imageWidth() || depth_img.rows != engine_.imageHeight())
         {
-            nCols *= nRows;
-            nRows = 1;
+            ROS_WARN_THROTTLE(5.0, "Depth image is %dx%d but the lookup tables are built for %dx%d, waiting for its CameraInfo",
+                              depth_img.cols, depth_img.rows,
+                              engine_.imageWidth(), engine_.imageHeight());
+            return false;
         }
 
-        int i,j;
-        float* pO;
-        float* pR;
-        for( i = 0; i < nRows; ++i)
+        int output_type = depthImageType(depth_encoding_);
+        if (depth_img.type() != CV_32FC1 && (depth_img.type() != CV_16UC1 || output_type != CV_16UC1))
         {
-            pO = IO.ptr<float>(i);
-            pR = IR.ptr<float>(i);
-            for ( j = 0; j < nCols; ++j)
-            {
-                pR[j] = CSpaceExpander::roundToPrecision(pO[j], 2);
-            }
+            ROS_ERROR_THROTTLE(5.0, "Can not expand a depth image of type %d into %s", depth_img.type(),
+                               depth_encoding_.c_str());
+            return false;
         }
-    }
 
-    void CSpaceExpander::expandImage(cv::Mat& IO, cv::Mat& IR)
-    {
-        CV_Assert(IO.depth() == CV_32FC1);
+        // No-op for an output that already has the size of the frame
+        depth_img_expanded.create(depth_img.rows, depth_img.cols, output_type);
 
-        for (int v = 0; v < 120; ++v)
+        // Fill NaNs and round image values to [cm] in one pass. The depth-ordered modes take the
+        // rounded image as uint16 along with its histogram. The uint16 pipeline rounds [mm]
+        // to [cm] in integers; a float frame is converted to [mm] first.
+        if (output_type == CV_16UC1)
         {
-            for (int u = 0; u < 160; ++u)
+            const cv::Mat* depth_mm_img = &depth_img;
+            if (depth_img.type() == CV_32FC1)
             {
-                int z_old = IR.at<float>(v, u);
-
-                if (z_old >= 0)
-                {
-                    int x = utable_[u][z_old][0];
-                    int y = vtable_[v][z_old][0];
-                    int w = utable_[u][z_old][1];
-                    int h = vtable_[v][z_old][1];
-                    float z_new = reduced_depth_[z_old];
-
-                    cv::Rect roi = cv::Rect(x, y, w, h);
-
-                    IO(roi).setTo(z_new, IO(roi) > z_new);
-                }
+                fillNanDepthMillimetres(depth_img, 4.9, depth_img_expanded);
+                depth_mm_img = &depth_img_expanded;
             }
+            prepareDepthImageMillimetres(*depth_mm_img, depth_img_expanded, 4900, precision_, engine_.maxDepth(),
+                                         depth_img_rounded_, &depth_histogram_[0]);
+        } else if (is_depth_ordered_mode_)
+        {
+            prepareDepthImage(depth_img, depth_img_expanded, 4.9, precision_, engine_.maxDepth(),
+                              CV_16UC1, depth_img_rounded_, &depth_histogram_[0]);
+        } else
+        {
+            prepareDepthImage(depth_img, depth_img_expanded, 4.9, precision_, engine_.maxDepth(),
+                              CV_32FC1, depth_img_rounded_);
         }
-        cv::GaussianBlur(IO, IO, cv::Size( 5, 3), 0, 0 );
+
+        // Expand c-space
+        CSpaceExpander::expandImage(depth_img_expanded, depth_img_rounded_);
+        return true;
     }
-}
 
-int main(int argc, char** argv)
-{
-    ros::init(argc, argv, "c_space_expander");
+    const int* CSpaceExpander::depthHistogram(const cv::Mat& IR) const
+    {
+        // Only the uint16 image comes with a histogram from the pre-pass
+        return IR.depth() == CV_16U ? &depth_histogram_[0] : NULL;
+    }
 
-    depth_flight_controller::CSpaceExpander cse;
+    void CSpaceExpander::expandImage(cv::Mat& IO, cv::Mat& IR)
+    {
+        CV_Assert(IO.depth() == CV_32FC1 || IO.depth() == CV_16UC1);
 
-    ros::spin();
+        expansion_allocations_.begin();
+        bool is_smoothed = false;
 
-    return 0;
-}
+        if (expansion_mode_ == "stamp")
+        {
+            engine_.expandImageStamping(IO, IR, 0, IO.rows);
+        } else if (expansion_mode_ == "sphere")
+        {
+            engine_.expandImageSpherical(IO, IR, 0, IO.rows);
+        } else if (expansion_mode_ == "row_pointers")
+        {
+            engine_.expandImageRowPointers(IO, IR, 0, IO.rows);
+        } else if (expansion_mode_ == "parallel")
+        {
+            engine_.expandImageParallel(IO, IR, 0, IO.rows);
+        } else if (expansion_mode_ == "pruned")
+        {
+            engine_.expandImagePruned(IO, IR, depthHistogram(IR));
+            ROS_DEBUG("c-space expansion pruned %d of %d stamps", engine_.prunedStamps(), IR.rows * IR.cols);
+        } else if (expansion_mode_ == "range_min")
+        {
+            // Finishes the rows in order, so they are smoothed within the same pass
+            engine_.expandImageRangeMin(IO, IR, true);
+            is_smoothed = true;
+        } else if (expansion_mode_ == "pyramid")
+        {
+            engine_.expandImagePyramid(IO, IR, depthHistogram(IR));
+        } else if (expansion_mode_ == "incremental")
+        {
+            engine_.expandImageIncremental(IO, IR, depthHistogram(IR));
+            ROS_DEBUG("c-space expansion recomputed %d of %d tiles", engine_.incrementalStats().recomputed_tiles,
+                      engine_.incrementalStats().tiles);
+        } else
+        {
+            engine_.expandImageSeparable(IO, IR, depthHistogram(IR));
+        }
 
+        expansion_allocations_.end("c-space expansion", expansion_mode_);
 
+        // cv::GaussianBlur(IO, IO, cv::Size(5, 3), 0, 0) with fixed coefficients
+        if (!is_smoothed)
+            smoother_.smooth(IO);
+    }
+}
@@ -3,156 +3,67 @@
 
 namespace depth_flight_controller {
 
-    CSpaceExpanderHorizon::CSpaceExpanderHorizon()
-            : it_(nh_)
+    CSpaceExpanderHorizon::CSpaceExpanderHorizon(const ros::NodeHandle& nh, const ros::NodeHandle& pnh)
+            : nh_(nh),
+              it_(nh_)
     {
-        double focal_length_ = 151.81;
-        double drone_radius_ = 0.3;
-
-        // Build (u,z) lookup table
-        for (int u = 0; u < 160; ++u)
-            for (int z_cm = 0; z_cm <= max_depth_; ++z_cm) {
-                float z = float(z_cm) / 100;
-                float x_u = (float(u) - 80) * z / focal_length_;
-                float alpha_u = atan(x_u/z);
-                float dist_to_point = (sqrt(pow(z, 2) + pow(x_u, 2)));
-
-                float alpha_1_u;
-                float r_1_x_u;
-                float r_2_x_u;
-                int u_low;
-                int u_high;
-
-                if (dist_to_point > 0.2)
-                {
-                    if (z > 0.205)
-                    {
-                        alpha_1_u = asin(drone_radius_ / dist_to_point);
-                        r_1_x_u = z * tan(alpha_u - alpha_1_u);
-                        r_2_x_u = z * tan(alpha_u + alpha_1_u);
-
-                        u_low = int(focal_length_ * r_1_x_u / z) +80;
-                        u_low = std::min(std::max(u_low , 0),159);
-                        utable_[u][z_cm][0] = u_low;
-
-                        u_high = int(focal_length_ * r_2_x_u / z+80);
-                        u_high = std::min(std::max(u_high , 0),159);
-                        utable_[u][z_cm][1] = u_high-u_low+1;
-
-                    } else if (u < 80 )
-                    {
-                        alpha_1_u = asin(drone_radius_ / dist_to_point);
-                        r_2_x_u = z * tan(alpha_u + alpha_1_u);
-
-                        u_low = 0;
-                        utable_[u][z_cm][0] = u_low;
-
-                        u_high = int(focal_length_ * r_2_x_u / z+80);
-                        u_high = std::min(std::max(u_high , 0),159);
-                        utable_[u][z_cm][1] = u_high-u_low+1;
-                    } else
-                    {
-                        alpha_1_u = asin(drone_radius_ / dist_to_point);
-                        r_1_x_u = z * tan(alpha_u - alpha_1_u);
-
-                        u_low = int(focal_length_ * r_1_x_u / z) +80;
-                        u_low = std::min(std::max(u_low , 0),159);
-                        utable_[u][z_cm][0] = u_low;
-
-                        u_high = 159;
-                        utable_[u][z_cm][1] = u_high-u_low+1;
-                    }
-
-                } else
-                {
-                    utable_[u][z_cm][0] = 0;
-                    utable_[u][z_cm][1] = 159;
-                }
-            }
-
-        // Build (v,z) lookup table
-        for (int v = 0; v < 120; ++v)
-            for (int z_cm = 0; z_cm <= max_depth_; ++z_cm) {
-                float z = float(z_cm) / 100;
-                float y_v = (float(v) - 60) * z / focal_length_;
-                float alpha_v = atan(y_v /z);
-                float dist_to_point = (sqrt(pow(z, 2) + pow(y_v, 2)));
-
-                float alpha_1_v;
-                float r_1_y_v;
-                float r_2_y_v;
-                int v_low;
-                int v_high;
-
-                if (dist_to_point > 0.2)
-                {
-                    if (z > 0.205)
-                    {
-                        alpha_1_v = asin(drone_radius_ / dist_to_point);
-                        r_1_y_v = z * tan(alpha_v - alpha_1_v);
-                        r_2_y_v = z * tan(alpha_v + alpha_1_v);
-
-                        v_low = int(focal_length_ * r_1_y_v / z) +60;
-                        v_low = std::min(std::max(v_low , 0),119);
-                        vtable_[v][z_cm][0] = v_low;
-
-                        v_high = int(focal_length_ * r_2_y_v / z+60);
-                        v_high = std::min(std::max(v_high,0),119);
-                        vtable_[v][z_cm][1] = v_high-v_low+1;
-                    } else if (v < 60 )
-                    {
-                        alpha_1_v = asin(drone_radius_ / dist_to_point);
-                        r_2_y_v = z * tan(alpha_v + alpha_1_v);
-
-                        v_low = 0;
-                        vtable_[v][z_cm][0] = v_low;
-
-                        v_high = int(focal_length_ * r_2_y_v / z+60);
-                        v_high = std::min(std::max(v_high,0),119);
-                        vtable_[v][z_cm][1] = v_high-v_low+1;
-                    } else
-                    {
-                        alpha_1_v = asin(drone_radius_ / dist_to_point);
-                        r_1_y_v = z * tan(alpha_v - alpha_1_v);
-
-                        v_low = int(focal_length_ * r_1_y_v / z) +60;
-                        v_low = std::min(std::max(v_low , 0),119);
-                        vtable_[v][z_cm][0] = v_low;
-
-                        v_high = 119;
-                        vtable_[v][z_cm][1] = v_high-v_low+1;
-                    }
-
-                } else
-                {
-                    alpha_1_v = 0;
-                    r_1_y_v = 0;
-                    r_2_y_v = 0;
-                    v_low = 0;
-                    vtable_[v][z_cm][0] = 0;
-                    v_high = 0;
-                    vtable_[v][z_cm][1] = 119;
-                }
-            }
-
-        for (int z_cm = 0; z_cm < max_depth_; ++z_cm)
-            reduced_depth_[z_cm] = float(std::max(z_cm,20))/100-drone_radius_;
+        pnh.param("drone_radius", drone_radius_, 0.3);
+        pnh.param("max_depth", max_depth_, 5.0);
+        pnh.param<std::string>("lookup_table_cache", lookup_table_cache_, LookupTableFile::defaultPath("c_space_expander_horizon_tables.bin"));
+
+        pnh.param<std::string>("expansion_mode", expansion_mode_, "row_pointers");
+
+        // "band" computes the expanded depth only around the horizon line and publishes it as
+        // HorizonBand, "image" (default) publishes the expanded image
+        std::string output_mode;
+        pnh.param<std::string>("output_mode", output_mode, "image");
+        pnh.param("band_margin", band_margin_, 2);
+        is_band_output_ = output_mode == "band";
+
+        // "horizon_band" smooths the expanded image only on the horizon line +-band_margin
+        // rows, "full" (default) everywhere
+        std::string smoothing;
+        pnh.param<std::string>("smoothing", smoothing, "full");
+        is_band_smoothing_ = smoothing == "horizon_band";
+
+        bool use_simd;
+        pnh.param("use_simd", use_simd, true);
+        engine_.setSimdEnabled(use_simd);
+
+        bool share_lookup_tables;
+        pnh.param("share_lookup_tables", share_lookup_tables, false);
+        engine_.setSharedTables(share_lookup_tables);
+        ROS_INFO("c-space expansion mode: %s, span kernel: %s", expansion_mode_.c_str(), engine_.spanMinKernelName());
 
         image_sub_ = it_.subscribe("/hummingbird/vi_sensor/camera_depth/depth/disparity", 1, &CSpaceExpanderHorizon::imageCallback, this);
-        image_pub_ = it_.advertise("/hummingbird/vi_sensor/camera_depth/depth/expanded", 1);
+        if (is_band_output_)
+            horizon_band_pub_ = nh_.advertise<depth_flight_controller_msgs::HorizonBand>("/hummingbird/horizon_band", 1);
+        else
+            image_pub_ = it_.advertise("/hummingbird/vi_sensor/camera_depth/depth/expanded", 1);
 
         state_estimate_original_img_pub_ = nh_.advertise<quad_msgs::QuadStateEstimate>("/hummingbird/state_estimate_original_img", 1);
+        expansion_stats_pub_ = nh_.advertise<depth_flight_controller_msgs::ExpansionStats>("/hummingbird/c_space_expansion_horizon_stats", 1);
         state_estimate_sub_ = nh_.subscribe("/hummingbird/state_estimate", 1, &CSpaceExpanderHorizon::stateEstimateCallback, this);
 
-        K = (cv::Mat_<double>(3,3)<<151.8076510090423, 0.0, 80.5, 0.0, 151.8076510090423, 60.5, 0.0, 0.0, 1.0);
-        T = (cv::Mat_<double>(3,1) <<  0, 0, 0);
-        distCoeffs = (cv::Mat_<double>(4,1) <<  0, 0, 0, 0);
-
-        body_cam_rot_ << 0, -1, 0, 0, 0, 1, 1, 0, 0;
-        horizon_center_point_world_ << 100, 0, 0;
-        horizon_left_point_world_ << 1000, 100, 0;
-        horizon_right_point_world_ << 1000, -100, 0;
-        rvec = (cv::Mat_<double>(3,3) << 1, 0, 0, 0, 1, 0, 0, 0, 1);
+        // The lookup tables and the intrinsics of the horizon come with the first CameraInfo
+        // (see cameraInfoCallback) instead of waiting for it here, which would block the
+        // loading thread of a nodelet manager. Frames that arrive before are dropped. Without a
+        // CameraInfo within ~camera_info_timeout [s] the default camera is assumed until one
+        // arrives (<= 0: never).
+        camera_info_sub_ = nh_.subscribe("/hummingbird/vi_sensor/camera_depth/depth/camera_info", 1, &CSpaceExpanderHorizon::cameraInfoCallback, this);
+
+        double camera_info_timeout;
+        pnh.param("camera_info_timeout", camera_info_timeout, 2.0);
+        if (camera_info_timeout > 0)
+            camera_info_timer_ = nh_.createTimer(ros::Duration(camera_info_timeout), &CSpaceExpanderHorizon::cameraInfoTimeoutCallback, this, true);
+
+        horizon_geometry_.setIntrinsics(151.8076510090423, 151.8076510090423, 80.5, 60.5);
+
+        Eigen::Matrix3d body_cam_rot;
+        body_cam_rot << 0, -1, 0, 0, 0, 1, 1, 0, 0;
+        horizon_geometry_.setBodyToCamera(body_cam_rot);
+        horizon_geometry_.setHorizonPoints(Eigen::Vector3d(1000, 100, 0), Eigen::Vector3d(1000, -100, 0),
+                                           Eigen::Vector3d(100, 0, 0));
     }
 
 
@@ -168,17 +79,73 @@ namespace depth_flight_controller {
     }
 
 
+    void CSpaceExpanderHorizon::cameraInfoCallback(const sensor_msgs::CameraInfoConstPtr& msg)
+    {
+        if (!hasIntrinsics(*msg))
+            return;
+
+        // Before the first build the engine holds the default configuration without tables
+        LookupTableConfig lookup_table_config = lookupTableConfigFromCameraInfo(*msg, drone_radius_, max_depth_);
+        if (engine_.imageWidth() > 0 && lookup_table_config == engine_.lookupTableConfig())
+            return;
+
+        ROS_INFO("Camera is %dx%d, f = (%.2f, %.2f), c = (%.2f, %.2f): building lookup tables",
+                 msg->width, msg->height, msg->K[0], msg->K[4], msg->K[2], msg->K[5]);
+        horizon_geometry_.setIntrinsics(cameraMatrixFromCameraInfo(*msg));
+
+        loadLookupTables(lookup_table_config);
+        expansion_allocations_.reset(); // The first frame after a rebuild may allocate
+    }
+
+    void CSpaceExpanderHorizon::cameraInfoTimeoutCallback(const ros::TimerEvent& event)
+    {
+        if (engine_.imageWidth() > 0)
+            return;
+
+        // The horizon keeps the default intrinsics set in the constructor
+        LookupTableConfig lookup_table_config = defaultLookupTableConfig(drone_radius_, max_depth_);
+        ROS_WARN("No CameraInfo received, assuming a %dx%d depth camera", lookup_table_config.image_width,
+                 lookup_table_config.image_height);
+        loadLookupTables(lookup_table_config);
+        expansion_allocations_.reset();
+    }
+
+    void CSpaceExpanderHorizon::loadLookupTables(const LookupTableConfig& config)
+    {
+        focal_length_ = config.focal_length_u;
+        depth_histogram_.resize(config.max_depth);
+        band_begin_.resize(config.image_height);
+        band_end_.resize(config.image_height);
+
+        if (lookup_table_cache_.empty())
+        {
+            engine_.buildLookupTables(config);
+            return;
+        }
+
+        ros::WallTime start = ros::WallTime::now();
+        CSpaceExpansionEngine::LookupTableSource source = engine_.loadLookupTables(config, lookup_table_cache_);
+        double ms = (ros::WallTime::now() - start).toSec() * 1000;
+
+        if (source == CSpaceExpansionEngine::TABLES_MAPPED)
+            ROS_INFO("Mapped lookup tables from %s in %.1f ms", lookup_table_cache_.c_str(), ms);
+        else if (source == CSpaceExpansionEngine::TABLES_BUILT_AND_CACHED)
+            ROS_INFO("Built lookup tables in %.1f ms and cached them in %s", ms, lookup_table_cache_.c_str());
+        else
+            ROS_WARN("Built lookup tables in %.1f ms, could not write the cache %s", ms, lookup_table_cache_.c_str());
+    }
+
     void CSpaceExpanderHorizon::imageCallback(const sensor_msgs::ImageConstPtr& msg)
     {
         quad_msgs::QuadStateEstimate state_estimate_original_img_msg = state_estimate_msg_;
         QuadState state_estimate_original_img_ = state_estimate_;
 
 
-        cv_bridge::CvImagePtr cv_ptr_original;
+        cv_bridge::CvImageConstPtr cv_ptr_original;
 
         try
         {
-            cv_ptr_original = cv_bridge::toCvCopy(msg);
+            cv_ptr_original = cv_bridge::toCvShare(msg);
             //cv_ptr_expanded = cv_bridge::toCvCopy(msg);
         }
         catch (cv_bridge::Exception& e)
@@ -187,121 +154,191 @@ namespace depth_flight_controller {
             return;
         }
 
-        depth_float_img_original_ = cv_ptr_original->image;
-        cv::Mat mask = cv::Mat(depth_float_img_original_ != depth_float_img_original_);
-        depth_float_img_original_.setTo(4.9, mask);
+        const cv::Mat& depth_float_img_shared = cv_ptr_original->image;
+        if (depth_float_img_shared.cols != engine_.imageWidth() || depth_float_img_shared.rows != engine_.imageHeight())
+        {
+            ROS_WARN_THROTTLE(5.0, "Depth image is %dx%d but the lookup tables are built for %dx%d, waiting for its CameraInfo",
+                              depth_float_img_shared.cols, depth_float_img_shared.rows,
+                              engine_.imageWidth(), engine_.imageHeight());
+            return;
+        }
 
-        depth_float_img_rounded_ = depth_float_img_original_.clone();
+        // The horizon expansion runs on [m] only, see CSpaceExpander for the uint16 pipeline
+        if (depth_float_img_shared.type() != CV_32FC1)
+        {
+            ROS_WARN_THROTTLE(5.0, "Can not expand a depth image of encoding %s, expected 32FC1",
+                              cv_ptr_original->encoding.c_str());
+            return;
+        }
 
-        //cv::GaussianBlur(depth_float_img_original_, depth_float_img_original_, cv::Size(3,3), 0, 0 );
+        // The shared frame is read only. The pre-pass copies it into the outgoing message,
+        // which is then expanded in place. The band output keeps its copy to itself.
+        if (is_band_output_)
+        {
+            depth_float_img_band_.create(depth_float_img_shared.rows, depth_float_img_shared.cols, CV_32FC1);
+            depth_float_img_original_ = depth_float_img_band_;
+        } else
+        {
+            depth_float_img_original_ = expanded_msg_.acquire(msg->header, depth_float_img_shared.rows,
+                                                              depth_float_img_shared.cols,
+                                                              sensor_msgs::image_encodings::TYPE_32FC1);
+        }
 
-        // Round image values to [cm]
-        CSpaceExpanderHorizon::changeImagePrecision(depth_float_img_original_, depth_float_img_rounded_); // Input: Original image values in [m]; Output: Rounded image values in [cm]
+        // Fill NaNs and round image values to [cm] in one pass
+        if (is_band_output_)
+            prepareDepthImage(depth_float_img_shared, depth_float_img_original_, 4.9, precision_, engine_.maxDepth(),
+                              CV_16UC1, depth_img_rounded_, &depth_histogram_[0]);
+        else
+            prepareDepthImage(depth_float_img_shared, depth_float_img_original_, 4.9, precision_, engine_.maxDepth(),
+                              expansion_mode_ == "sphere" ? CV_16UC1 : CV_32FC1, depth_img_rounded_);
 
         std::vector<cv::Point> horizon_points = buildHorizon(state_estimate_);
 
+        if (is_band_output_)
+        {
+            CSpaceExpanderHorizon::expandBand(depth_float_img_original_, depth_img_rounded_, horizon_points, msg->header);
+            state_estimate_original_img_pub_.publish(state_estimate_original_img_msg);
+            horizon_band_pub_.publish(horizon_band_msg_);
+            publishExpansionStats(msg->header);
+            return;
+        }
+
         // Expand c-space
-        CSpaceExpanderHorizon::expandImage(depth_float_img_original_, depth_float_img_rounded_, horizon_points);
+        CSpaceExpanderHorizon::expandImage(depth_float_img_original_, depth_img_rounded_, horizon_points);
 
         state_estimate_original_img_pub_.publish(state_estimate_original_img_msg);
-        image_pub_.publish(cv_ptr_original->toImageMsg());
+        image_pub_.publish(expanded_msg_.message());
+        publishExpansionStats(msg->header);
     }
 
-    float CSpaceExpanderHorizon::roundToPrecision(float imageDepth,int precision)
+    void CSpaceExpanderHorizon::publishExpansionStats(const std_msgs::Header& header)
     {
-        // Do initial checks
-        float roundedImageDepth = roundf(imageDepth * precision_);
-        return roundedImageDepth;
+        expansion_stats_msg_.header = header;
+        expansion_stats_msg_.heap_allocations = expansion_allocations_.allocations();
+        expansion_stats_pub_.publish(expansion_stats_msg_);
     }
 
-    void CSpaceExpanderHorizon::changeImagePrecision(cv::Mat& IO, cv::Mat& IR)
+    //void CSpaceExpanderHorizon::expandImage(cv::Mat& IO, cv::Mat& IR, cv::Mat& IE)
+    void CSpaceExpanderHorizon::expandImage(cv::Mat& IO, cv::Mat& IR, std::vector<cv::Point> horizon_points)
     {
-        // Accept only float type matrices
         CV_Assert(IO.depth() == CV_32FC1);
 
-        int channels = IO.channels();
-        int nRows = IO.rows;
-        int nCols = IO.cols * channels;
+        cv::Point edge_left_pos = horizon_points.at(0);
+        cv::Point edge_right_pos = horizon_points.at(1);
 
-        if (IO.isContinuous())
+        int v_min_edge = std::min(edge_left_pos.y, edge_right_pos.y);
+        int v_max_edge = std::max(edge_left_pos.y, edge_right_pos.y);
+
+        int v_min = std::max(5, v_min_edge);
+        int v_max = std::min(IO.rows - 6,v_max_edge);
+
+        expansion_allocations_.begin();
+
+        if (expansion_mode_ == "stamp")
+        {
+            engine_.expandImageStamping(IO, IR, v_min-5, v_max+6);
+        } else if (expansion_mode_ == "sphere")
+        {
+            engine_.expandImageSpherical(IO, IR, v_min-5, v_max+6);
+        } else
+        {
+            engine_.expandImageRowPointers(IO, IR, v_min-5, v_max+6);
+        }
+
+        expansion_allocations_.end("c-space expansion", expansion_mode_);
+
+        // cv::GaussianBlur(IO, IO, cv::Size(5, 3), 0, 0) with fixed coefficients
+        if (is_band_smoothing_)
         {
-            nCols *= nRows;
-            nRows = 1;
+            buildBand(IO, horizon_points, band_margin_, 0);
+            smoother_.smoothRows(IO, &band_begin_[0], &band_end_[0]);
+        } else
+        {
+            smoother_.smooth(IO);
         }
+    }
 
-        int i,j;
-        float* pO;
-        float* pR;
-        for( i = 0; i < nRows; ++i)
+    void CSpaceExpanderHorizon::buildBand(const cv::Mat& IO, const std::vector<cv::Point>& horizon_points,
+                                          int row_margin, int col_margin)
+    {
+        // The pixels TargetFinder samples: the horizon line as walked by cv::LineIterator
+        band_line_.clear();
+        cv::LineIterator it(IO, horizon_points.at(0), horizon_points.at(1), 8);
+        for (int i = 0; i < it.count; i++, ++it)
+            band_line_.push_back(it.pos());
+
+        // Per row the columns within row_margin rows and col_margin columns of the line
+        std::fill(band_begin_.begin(), band_begin_.end(), IO.cols);
+        std::fill(band_end_.begin(), band_end_.end(), 0);
+        for (size_t i = 0; i < band_line_.size(); ++i)
         {
-            pO = IO.ptr<float>(i);
-            pR = IR.ptr<float>(i);
-            for ( j = 0; j < nCols; ++j)
+            const cv::Point& p = band_line_[i];
+            for (int v = std::max(p.y - row_margin, 0); v <= std::min(p.y + row_margin, IO.rows - 1); ++v)
             {
-                pR[j] = CSpaceExpanderHorizon::roundToPrecision(pO[j], 2);
+                band_begin_[v] = std::min(band_begin_[v], std::max(p.x - col_margin, 0));
+                band_end_[v] = std::max(band_end_[v], std::min(p.x + col_margin + 1, IO.cols));
             }
         }
+        for (int v = 0; v < IO.rows; ++v)
+        {
+            if (band_begin_[v] >= band_end_[v])
+                band_begin_[v] = band_end_[v] = 0;
+        }
     }
 
-    //void CSpaceExpanderHorizon::expandImage(cv::Mat& IO, cv::Mat& IR, cv::Mat& IE)
-    void CSpaceExpanderHorizon::expandImage(cv::Mat& IO, cv::Mat& IR, std::vector<cv::Point> horizon_points)
+    void CSpaceExpanderHorizon::expandBand(cv::Mat& IO, cv::Mat& IR, const std::vector<cv::Point>& horizon_points,
+                                           const std_msgs::Header& header)
     {
-        CV_Assert(IO.depth() == CV_32FC1);
+        // Expand the line +-band_margin_ rows, and the pixels the 5x3 smoothing of those reads
+        buildBand(IO, horizon_points, band_margin_ + 1, 2);
 
-        cv::Point edge_left_pos = horizon_points.at(0);
-        cv::Point edge_right_pos = horizon_points.at(1);
+        expansion_allocations_.begin();
 
-        int v_min_edge = std::min(edge_left_pos.y, edge_right_pos.y);
-        int v_max_edge = std::max(edge_left_pos.y, edge_right_pos.y);
+        engine_.expandImageBand(IO, IR, &band_begin_[0], &band_end_[0], &depth_histogram_[0]);
 
-        int v_min = std::max(5, v_min_edge);
-        int v_max = std::min(114,v_max_edge);
+        expansion_allocations_.end("c-space band expansion");
 
-        for (int v = v_min-5; v < v_max+6; ++v)
-        {
-            for (int u = 0; u < 160; ++u)
-            {
-                int z_old = IR.at<float>(v, u);
+        // Reuse the message unless a subscriber still holds the last one
+        if (!horizon_band_msg_ || !horizon_band_msg_.unique())
+            horizon_band_msg_ = boost::make_shared<depth_flight_controller_msgs::HorizonBand>();
 
-                if (z_old >= 0)
-                {
-                    int x = utable_[u][z_old][0];
-                    int y = vtable_[v][z_old][0];
-                    int w = utable_[u][z_old][1];
-                    int h = vtable_[v][z_old][1];
-                    float z_new = reduced_depth_[z_old];
+        int n_rows = 2 * band_margin_ + 1;
+        horizon_band_msg_->header = header;
+        horizon_band_msg_->margin = band_margin_;
+        horizon_band_msg_->u.resize(band_line_.size());
+        horizon_band_msg_->v.resize(band_line_.size());
+        horizon_band_msg_->depth.resize(band_line_.size() * n_rows);
+        horizon_band_msg_->pt_center.x = horizon_points.at(2).x;
+        horizon_band_msg_->pt_center.y = horizon_points.at(2).y;
+        horizon_band_msg_->pt_center.z = 0;
 
-                    cv::Rect roi = cv::Rect(x, y, w, h);
+        for (size_t i = 0; i < band_line_.size(); ++i)
+        {
+            const cv::Point& p = band_line_[i];
+            horizon_band_msg_->u[i] = p.x;
+            horizon_band_msg_->v[i] = p.y;
 
-                    IO(roi).setTo(z_new, IO(roi) > z_new);
-                }
+            float* depth = &horizon_band_msg_->depth[i * n_rows];
+            for (int k = 0; k < n_rows; ++k)
+            {
+                int v = p.y - band_margin_ + k;
+                depth[k] = v >= 0 && v < IO.rows ? smoothedDepth(IO, p.x, v) : std::numeric_limits<float>::quiet_NaN();
             }
         }
-        cv::GaussianBlur(IO, IO, cv::Size( 5, 3), 0, 0 );
     }
 
     std::vector<cv::Point> CSpaceExpanderHorizon::buildHorizon(const QuadState state_estimate)
     {
         // Calculate edge points of line
-        Eigen::Matrix3d rvec_state_estimate = CSpaceExpanderHorizon::tiltCalculator(state_estimate);
+        cv::Point2d projected_left;
+        cv::Point2d projected_right;
+        cv::Point2d projected_center;
+        horizon_geometry_.project(CSpaceExpanderHorizon::tiltCalculator(state_estimate), projected_left, projected_right,
+                                  projected_center);
 
-        Eigen::Vector3d horizon_center_point_cam = body_cam_rot_ * rvec_state_estimate *horizon_center_point_world_;
-        Eigen::Vector3d horizon_left_point_cam = body_cam_rot_ * rvec_state_estimate * horizon_left_point_world_;
-        Eigen::Vector3d horizon_right_point_cam = body_cam_rot_ * rvec_state_estimate * horizon_right_point_world_;
-
-        std::vector<cv::Point3f> horizon_3D_points;
-        std::vector<cv::Point2f> projected_horizon_points;
-
-        horizon_3D_points.push_back(cv::Point3d(horizon_left_point_cam(0),horizon_left_point_cam(1),horizon_left_point_cam(2)));
-        horizon_3D_points.push_back(cv::Point3d(horizon_right_point_cam(0),horizon_right_point_cam(1),horizon_right_point_cam(2)));
-        horizon_3D_points.push_back(cv::Point3d(horizon_center_point_cam(0),horizon_center_point_cam(1),horizon_center_point_cam(2)));
-
-        cv::Rodrigues(rvec, rvecR);
-        cv::projectPoints( cv::Mat(horizon_3D_points), rvecR, T, K, distCoeffs, projected_horizon_points);
-
-        cv::Point pt1 = cv::Point(projected_horizon_points[0].x,projected_horizon_points[0].y);
-        cv::Point pt2 = cv::Point(projected_horizon_points[1].x,projected_horizon_points[1].y);
-        cv::Point horizon_center = cv::Point(projected_horizon_points[2].x,projected_horizon_points[2].y);
+        cv::Point pt1 = cv::Point(projected_left.x,projected_left.y);
+        cv::Point pt2 = cv::Point(projected_right.x,projected_right.y);
+        cv::Point horizon_center = cv::Point(projected_center.x,projected_center.y);
 
         std::vector<cv::Point> horizon_points = CSpaceExpanderHorizon::fullLine(pt1, pt2, horizon_center);
 
@@ -310,22 +347,7 @@ namespace depth_flight_controller {
 
     Eigen::Matrix3d CSpaceExpanderHorizon::tiltCalculator(const QuadState &state_estimate)
     {
-        Eigen::Quaterniond q = state_estimate.orientation;
-        Eigen::Vector3d euler_angles = CSpaceExpanderHorizon::toEulerAngle(q);
-        Eigen::Matrix3d state_estimate_rot_mat = eulerAnglesZYXToRotationMatrix(euler_angles);
-        Eigen::Matrix3d state_estimate_rot_mat_inv = state_estimate_rot_mat.inverse();
-        return state_estimate_rot_mat;
-    }
-
-    Eigen::Vector3d CSpaceExpanderHorizon::toEulerAngle(const Eigen::Quaterniond& q)
-    {
-        double roll = atan2(2*q.w()*q.x() + 2*q.y()*q.z(), q.w()*q.w() - q.x()*q.x() - q.y()*q.y() + q.z()*q.z());
-        double pitch = -asin(2*q.x()*q.z() - 2*q.w()*q.y());
-        yaw_ = atan2(2*q.w()*q.z() + 2*q.x()*q.y(), q.w()*q.w() + q.x()*q.x() - q.y()*q.y() - q.z()*q.z());
-
-        Eigen::Vector3d euler_angles(roll, pitch, 0);
-
-        return euler_angles;
+        return HorizonGeometry::tilt(state_estimate.orientation);
     }
 
     std::vector<cv::Point> CSpaceExpanderHorizon::fullLine(cv::Point a, cv::Point b, cv::Point center_pos)
@@ -367,16 +389,3 @@ namespace depth_flight_controller {
     }
 
 }
-
-int main(int argc, char** argv)
-{
-    ros::init(argc, argv, "c_space_expander_horizon");
-
-    depth_flight_controller::CSpaceExpanderHorizon cse;
-
-    ros::spin();
-
-    return 0;
-}
-
-
@@ -0,0 +1,12 @@
+#include "c_space_expander_horizon.h"
+
+int main(int argc, char** argv)
+{
+    ros::init(argc, argv, "c_space_expander_horizon");
+
+    depth_flight_controller::CSpaceExpanderHorizon cse;
+
+    ros::spin();
+
+    return 0;
+}
@@ -0,0 +1,12 @@
+#include "c_space_expander.h"
+
+int main(int argc, char** argv)
+{
+    ros::init(argc, argv, "c_space_expander");
+
+    depth_flight_controller::CSpaceExpander cse;
+
+    ros::spin();
+
+    return 0;
+}
@@ -0,0 +1,587 @@
+#include "c_space_expansion_engine.h"
+#include "depth_prepass.h"
+#include "depth_smoothing.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace depth_flight_controller;
+
+// Keeps the compiler from dropping the lookups of the lookup benchmark
+static volatile long lookup_sink = 0;
+
+// Reads a depth image stored as a list of floats ("[1.2, nan, ...]"), as dumped into
+// original_img.txt. Missing trailing values are filled with NaN.
+static bool loadDepthImage(const char* path, int width, int height, cv::Mat& image)
+{
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    for (size_t i = 0; i < text.size(); ++i)
+        if (text[i] == '[' || text[i] == ']' || text[i] == ',')
+            text[i] = ' ';
+
+    image.create(height, width, CV_32F);
+    float* data = image.ptr<float>(0);
+    int n_pixels = image.rows * image.cols;
+    std::istringstream stream(text);
+    std::string token;
+    int i = 0;
+    for (; i < n_pixels && stream >> token; ++i)
+        data[i] = (token == "nan") ? std::numeric_limits<float>::quiet_NaN() : float(atof(token.c_str()));
+    for (; i < n_pixels; ++i)
+        data[i] = std::numeric_limits<float>::quiet_NaN();
+    return true;
+}
+
+// Same pre-processing as the expander nodes: NaN to 4.9 m, reduced image in cm
+static void prepareImage(cv::Mat& IO, cv::Mat& IR)
+{
+    IR.create(IO.rows, IO.cols, CV_32F);
+    for (int v = 0; v < IO.rows; ++v)
+    {
+        float* io = IO.ptr<float>(v);
+        float* ir = IR.ptr<float>(v);
+        for (int u = 0; u < IO.cols; ++u)
+        {
+            if (io[u] != io[u])
+                io[u] = 4.9f;
+            ir[u] = roundf(io[u] * 100);
+        }
+    }
+}
+
+static double elapsedMs(int64 start, int n_runs)
+{
+    return (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency() / n_runs;
+}
+
+// Span lookups of all source pixels of the frame, as one expansion pass issues them
+static double benchmarkLookups(const CSpaceExpansionEngine& engine, const cv::Mat& IR, bool compact, int n_runs)
+{
+    long checksum = 0;
+    int64 start = cv::getTickCount();
+    for (int run = 0; run < n_runs; ++run)
+    {
+        for (int v = 0; v < IR.rows; ++v)
+        {
+            const float* ir = IR.ptr<float>(v);
+            for (int u = 0; u < IR.cols; ++u)
+            {
+                int z_cm = std::min(int(ir[u]), engine.maxDepth() - 1);
+                int x, w, y, h;
+                if (compact)
+                    engine.lookupCompact(u, v, z_cm, x, w, y, h);
+                else
+                    engine.lookupInt(u, v, z_cm, x, w, y, h);
+                checksum += x + w + y + h;
+            }
+        }
+    }
+    double ms = elapsedMs(start, n_runs);
+    lookup_sink = checksum;
+    return ms;
+}
+
+enum ExpansionMode { SEPARABLE, ROW_POINTERS, SPHERICAL, PRUNED, PYRAMID, RANGE_MIN };
+
+static void expand(CSpaceExpansionEngine& engine, cv::Mat& IO, const cv::Mat& IR, ExpansionMode mode,
+                   const int* depth_histogram = NULL)
+{
+    if (mode == ROW_POINTERS)
+        engine.expandImageRowPointers(IO, IR, 0, IO.rows);
+    else if (mode == SPHERICAL)
+        engine.expandImageSpherical(IO, IR, 0, IO.rows);
+    else if (mode == PRUNED)
+        engine.expandImagePruned(IO, IR, depth_histogram);
+    else if (mode == PYRAMID)
+        engine.expandImagePyramid(IO, IR, depth_histogram);
+    else if (mode == RANGE_MIN)
+        engine.expandImageRangeMin(IO, IR);
+    else
+        engine.expandImageSeparable(IO, IR, depth_histogram);
+}
+
+static double benchmarkExpansion(CSpaceExpansionEngine& engine, const cv::Mat& image, const cv::Mat& IR,
+                                 int n_runs, ExpansionMode mode = SEPARABLE)
+{
+    cv::Mat IO;
+    double total_ms = 0;
+    for (int run = 0; run < n_runs; ++run)
+    {
+        image.copyTo(IO);
+        int64 start = cv::getTickCount();
+        expand(engine, IO, IR, mode);
+        total_ms += elapsedMs(start, 1);
+    }
+    return total_ms / n_runs;
+}
+
+// A negative depth is invalid: whichever pre-pass and exact expansion mode runs, the frame
+// must come out as the stamping of the frame without that source, read as the NaN fill depth.
+// Returns the number of differing pixels.
+static int invalidPixelMismatches(CSpaceExpansionEngine& engine, const cv::Mat& image)
+{
+    const int v_invalid = image.rows / 2;
+    const int u_invalid = image.cols / 2;
+    cv::Mat frame = image.clone();
+    frame.at<float>(v_invalid, u_invalid) = -0.1f;
+
+    cv::Mat expected = image.clone();
+    expected.at<float>(v_invalid, u_invalid) = 4.9f;
+    cv::Mat IR_expected(image.rows, image.cols, CV_32F);
+    for (int v = 0; v < image.rows; ++v)
+        for (int u = 0; u < image.cols; ++u)
+            IR_expected.at<float>(v, u) = roundf(expected.at<float>(v, u) * 100);
+    IR_expected.at<float>(v_invalid, u_invalid) = -1;
+    engine.expandImageStamping(expected, IR_expected, 0, image.rows);
+
+    int n_mismatches = 0;
+    std::vector<int> histogram(engine.maxDepth());
+    const ExpansionMode modes[] = {SEPARABLE, PRUNED, RANGE_MIN, ROW_POINTERS};
+    for (int i = 0; i < 4; ++i)
+    {
+        for (int is_float = 0; is_float < 2; ++is_float)
+        {
+            // The row-pointer stamps read only the float rounded image
+            if (modes[i] == ROW_POINTERS && !is_float)
+                continue;
+
+            cv::Mat IO(frame.rows, frame.cols, CV_32F);
+            cv::Mat IR;
+            prepareDepthImage(frame, IO, 4.9f, engine.precision_, engine.maxDepth(), is_float ? CV_32FC1 : CV_16UC1,
+                              IR, &histogram[0]);
+            expand(engine, IO, IR, modes[i], is_float ? NULL : &histogram[0]);
+            for (int v = 0; v < IO.rows; ++v)
+                for (int u = 0; u < IO.cols; ++u)
+                    n_mismatches += IO.at<float>(v, u) != expected.at<float>(v, u);
+        }
+    }
+
+    // The uint16 pipeline, from the float frame converted to [mm]
+    cv::Mat frame_mm(frame.rows, frame.cols, CV_16UC1);
+    cv::Mat IO_mm(frame.rows, frame.cols, CV_16UC1);
+    cv::Mat IR_mm;
+    fillNanDepthMillimetres(frame, 4.9f, frame_mm);
+    prepareDepthImageMillimetres(frame_mm, IO_mm, 4900, engine.precision_, engine.maxDepth(), IR_mm, &histogram[0]);
+    engine.expandImageSeparable(IO_mm, IR_mm, &histogram[0]);
+    for (int v = 0; v < IO_mm.rows; ++v)
+        for (int u = 0; u < IO_mm.cols; ++u)
+            n_mismatches += fabs(IO_mm.at<unsigned short>(v, u) * 0.001 - expected.at<float>(v, u)) > 0.0006;
+    return n_mismatches;
+}
+
+// Brute-force sphere projection: a pixel belongs to the footprint of a source if one of
+// n x n rays through it, corners and edges included, passes within the drone radius of the
+// point the source sees. Compares the spherical stamp of single sources with it over their
+// rectangles and counts the footprint pixels the stamp misses and the stamped pixels no ray
+// confirms (slivers thinner than the ray spacing).
+static void sphereFootprintMismatches(CSpaceExpansionEngine& engine, const LookupTableConfig& config,
+                                      long& n_missed, long& n_extra, long& n_footprint)
+{
+    const int n = 12;
+    const int depths[] = {35, 60, 100, 200, 400};
+    const double radius = config.drone_radius;
+    cv::Mat IO(config.image_height, config.image_width, CV_32F);
+    cv::Mat IR(config.image_height, config.image_width, CV_32F);
+    n_missed = n_extra = n_footprint = 0;
+
+    for (int i = 0; i < 5; ++i)
+    {
+        for (int v = 0; v < config.image_height; v += config.image_height / 4 - 1)
+        {
+            for (int u = 0; u < config.image_width; u += config.image_width / 8 - 1)
+            {
+                int z_cm = depths[i];
+                double z = z_cm / 100.0;
+                double px = (u - config.center_u) * z / config.focal_length_u;
+                double py = (v - config.center_v) * z / config.focal_length_v;
+
+                IO.setTo(100.0f);
+                IR.setTo(-1.0f);
+                IR.at<float>(v, u) = float(z_cm);
+                engine.expandImageSpherical(IO, IR, 0, IR.rows);
+
+                int x, w, y, h;
+                engine.lookupCompact(u, v, z_cm, x, w, y, h);
+                for (int r = y; r < y + h; ++r)
+                {
+                    for (int c = x; c < x + w; ++c)
+                    {
+                        bool hit = false;
+                        for (int k = 0; k < n * n && !hit; ++k)
+                        {
+                            double a = (c + double(k % n) / (n - 1) - config.center_u) / config.focal_length_u;
+                            double t = (r + double(k / n) / (n - 1) - config.center_v) / config.focal_length_v;
+                            double dot = px * a + py * t + z;
+                            double norm = a * a + t * t + 1;
+                            hit = dot > 0 && (px * px + py * py + z * z) * norm - dot * dot <= radius * radius * norm;
+                        }
+                        bool stamped = IO.at<float>(r, c) < 50.0f;
+                        n_footprint += hit;
+                        n_missed += hit && !stamped;
+                        n_extra += stamped && !hit;
+                    }
+                }
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s original_img.txt [runs]\n", argv[0]);
+        return 1;
+    }
+
+    LookupTableConfig config;
+    cv::Mat image;
+    if (!loadDepthImage(argv[1], config.image_width, config.image_height, image))
+    {
+        fprintf(stderr, "could not read %s\n", argv[1]);
+        return 1;
+    }
+    int n_runs = (argc > 2) ? atoi(argv[2]) : 1000;
+
+    cv::Mat IR;
+    prepareImage(image, IR);
+
+    CSpaceExpansionEngine engine;
+    engine.buildLookupTables(config);
+    size_t int_bytes = sizeof(int) * 2 * engine.maxDepth() * (engine.imageWidth() + engine.imageHeight());
+
+    printf("lookup tables     %10s %12s %14s\n", "bytes", "lookup [ms]", "separable [ms]");
+    printf("int [u][z][2]     %10lu %12.4f %14s\n", (unsigned long)int_bytes,
+           benchmarkLookups(engine, IR, false, n_runs), "-");
+    printf("uint8 [z][u][2]   %10lu %12.4f %14.4f\n", (unsigned long)engine.lookupTableBytes(),
+           benchmarkLookups(engine, IR, true, n_runs), benchmarkExpansion(engine, image, IR, n_runs));
+
+    engine.setSharedTables(true);
+    printf("uint8 shared u/v  %10lu %12.4f %14.4f\n", (unsigned long)engine.lookupTableBytes(),
+           benchmarkLookups(engine, IR, true, n_runs), benchmarkExpansion(engine, image, IR, n_runs));
+
+    // Rectangle vs. spherical stamps
+    engine.setSharedTables(false);
+    int n_slow_runs = std::max(n_runs / 50, 1);
+    printf("\n%-16s %14s %14s\n", "stamps", "pixels/frame", "expand [ms]");
+    printf("%-16s %14ld %14.4f\n", "rectangle", engine.stampedPixels(IR, 0, IR.rows, false),
+           benchmarkExpansion(engine, image, IR, n_slow_runs, ROW_POINTERS));
+    printf("%-16s %14ld %14.4f\n", "spherical", engine.stampedPixels(IR, 0, IR.rows, true),
+           benchmarkExpansion(engine, image, IR, n_runs, SPHERICAL));
+    {
+        long n_missed, n_extra, n_footprint;
+        sphereFootprintMismatches(engine, config, n_missed, n_extra, n_footprint);
+        printf("sphere footprint: %ld pixels, %ld missed, %ld extra\n", n_footprint, n_missed, n_extra);
+    }
+
+    // Fused pre-pass: NaN fill, rounding to uint16 [cm] and depth histogram
+    {
+        cv::Mat raw_image;
+        loadDepthImage(argv[1], config.image_width, config.image_height, raw_image);
+        cv::Mat IO, IR_cm;
+        std::vector<int> histogram(engine.maxDepth());
+
+        double prepass_ms = 0;
+        double expand_ms = 0;
+        for (int run = 0; run < n_runs; ++run)
+        {
+            raw_image.copyTo(IO);
+            int64 start = cv::getTickCount();
+            prepareDepthImage(IO, 4.9f, CSpaceExpansionEngine::precision_, engine.maxDepth(), CV_16UC1,
+                              IR_cm, &histogram[0]);
+            prepass_ms += elapsedMs(start, 1);
+
+            start = cv::getTickCount();
+            engine.expandImageSeparable(IO, IR_cm, &histogram[0]);
+            expand_ms += elapsedMs(start, 1);
+        }
+        printf("\n%-16s %14s %14s\n", "uint16 input", "pre-pass [ms]", "separable [ms]");
+        printf("%-16s %14.4f %14.4f\n", "with histogram", prepass_ms / n_runs, expand_ms / n_runs);
+        printf("negative pixel: %d mismatches\n", invalidPixelMismatches(engine, image));
+    }
+
+    // Incremental vs. full expansion of a sequence in which an 8x8 px object at 2 m moves
+    // across the otherwise static frame
+    {
+        cv::Mat IO;
+        cv::Mat IR_moving = IR.clone();
+        double full_ms = 0;
+        double incremental_ms = 0;
+        long recomputed_tiles = 0;
+        long tiles = 0;
+        for (int run = 0; run < n_runs; ++run)
+        {
+            IR.copyTo(IR_moving);
+            int u0 = (run * 2) % (IR.cols - 8);
+            int v0 = IR.rows / 2;
+            for (int v = v0; v < v0 + 8; ++v)
+                for (int u = u0; u < u0 + 8; ++u)
+                    IR_moving.at<float>(v, u) = 200;
+
+            image.copyTo(IO);
+            int64 start = cv::getTickCount();
+            engine.expandImagePruned(IO, IR_moving);
+            full_ms += elapsedMs(start, 1);
+
+            image.copyTo(IO);
+            start = cv::getTickCount();
+            engine.expandImageIncremental(IO, IR_moving);
+            incremental_ms += elapsedMs(start, 1);
+            recomputed_tiles += engine.incrementalStats().recomputed_tiles;
+            tiles += engine.incrementalStats().tiles;
+        }
+        printf("\n%-16s %14s %14s\n", "moving object", "expand [ms]", "recomputed");
+        printf("%-16s %14.4f %14s\n", "pruned", full_ms / n_runs, "-");
+        printf("%-16s %14.4f %13.1f%%\n", "incremental", incremental_ms / n_runs, 100.0 * recomputed_tiles / tiles);
+    }
+
+    // Pyramid mode: throughput vs. deviation from the exact expansion. The pyramid is
+    // conservative, so the error is how much nearer it reports a pixel.
+    {
+        cv::Mat exact, IO;
+        image.copyTo(exact);
+        engine.expandImageStamping(exact, IR, 0, IR.rows);
+
+        printf("\n%-16s %10s %14s %12s %12s %12s\n", "pyramid", "split [m]", "expand [ms]", "differ [%]",
+               "mean [m]", "max [m]");
+        printf("%-16s %10s %14.4f %12s %12s %12s\n", "pruned (exact)", "-",
+               benchmarkExpansion(engine, image, IR, n_runs, PRUNED), "-", "-", "-");
+
+        const int factors[] = {2, 2, 4, 4, 8};
+        const double max_errors[] = {0.05, 0.2, 0.1, 0.4, 0.4};
+        for (int i = 0; i < 5; ++i)
+        {
+            engine.setPyramid(factors[i], max_errors[i]);
+            image.copyTo(IO);
+            engine.expandImagePyramid(IO, IR);
+
+            int n_differing = 0;
+            double error_sum = 0;
+            double error_max = 0;
+            for (int v = 0; v < IO.rows; ++v)
+            {
+                for (int u = 0; u < IO.cols; ++u)
+                {
+                    double error = exact.at<float>(v, u) - IO.at<float>(v, u);
+                    n_differing += error != 0;
+                    error_sum += error;
+                    error_max = std::max(error_max, error);
+                }
+            }
+
+            char label[32];
+            snprintf(label, sizeof(label), "x%d, max %.2f", factors[i], max_errors[i]);
+            printf("%-16s %10.2f %14.4f %12.2f %12.4f %12.4f\n", label, engine.pyramidSplitDepth() / 100.0,
+                   benchmarkExpansion(engine, image, IR, n_runs, PYRAMID), 100.0 * n_differing / (IO.rows * IO.cols),
+                   error_sum / (IO.rows * IO.cols), error_max);
+        }
+    }
+
+    // Worst case for the stamping modes: a slightly tilted wall in front of the drone, so that
+    // every stamp covers most of the image. The range-min mode does not depend on stamp sizes.
+    {
+        printf("\n%-16s %14s %14s %14s %14s\n", "wall", "row_ptr [ms]", "pruned [ms]", "separable [ms]",
+               "range_min [ms]");
+        printf("%-16s %14s %14.4f %14.4f %14.4f\n", "recorded frame", "-",
+               benchmarkExpansion(engine, image, IR, n_runs, PRUNED), benchmarkExpansion(engine, image, IR, n_runs),
+               benchmarkExpansion(engine, image, IR, n_runs, RANGE_MIN));
+
+        const double wall_depths[] = {0.5, 1.0, 2.0};
+        for (int i = 0; i < 3; ++i)
+        {
+            cv::Mat wall(image.rows, image.cols, CV_32F);
+            cv::Mat IR_wall(image.rows, image.cols, CV_32F);
+            for (int v = 0; v < wall.rows; ++v)
+            {
+                for (int u = 0; u < wall.cols; ++u)
+                {
+                    wall.at<float>(v, u) = float(wall_depths[i] * (1 + 0.2 * u / wall.cols));
+                    IR_wall.at<float>(v, u) = roundf(wall.at<float>(v, u) * 100);
+                }
+            }
+
+            char label[32];
+            snprintf(label, sizeof(label), "wall at %.1f m", wall_depths[i]);
+            printf("%-16s %14.4f %14.4f %14.4f %14.4f\n", label,
+                   benchmarkExpansion(engine, wall, IR_wall, n_slow_runs, ROW_POINTERS),
+                   benchmarkExpansion(engine, wall, IR_wall, n_runs, PRUNED),
+                   benchmarkExpansion(engine, wall, IR_wall, n_runs),
+                   benchmarkExpansion(engine, wall, IR_wall, n_runs, RANGE_MIN));
+        }
+    }
+
+    // 5x3 smoothing after the expansion: cv::GaussianBlur vs. the fixed-coefficient smoother,
+    // over the whole frame, only on an 11 row horizon band, and fused into the range-min pass
+    {
+        cv::Mat expanded, IO, blurred;
+        image.copyTo(expanded);
+        engine.expandImageRangeMin(expanded, IR);
+        DepthSmoother smoother;
+
+        double blur_ms = 0;
+        double smooth_ms = 0;
+        double band_ms = 0;
+        std::vector<int> col_begin(image.rows, 0);
+        std::vector<int> col_end(image.rows, 0);
+        for (int v = image.rows / 2 - 5; v <= image.rows / 2 + 5; ++v)
+            col_end[v] = image.cols;
+
+        for (int run = 0; run < n_runs; ++run)
+        {
+            expanded.copyTo(IO);
+            int64 start = cv::getTickCount();
+            cv::GaussianBlur(IO, IO, cv::Size(5, 3), 0, 0);
+            blur_ms += elapsedMs(start, 1);
+
+            expanded.copyTo(IO);
+            start = cv::getTickCount();
+            smoother.smooth(IO);
+            smooth_ms += elapsedMs(start, 1);
+
+            expanded.copyTo(IO);
+            start = cv::getTickCount();
+            smoother.smoothRows(IO, &col_begin[0], &col_end[0]);
+            band_ms += elapsedMs(start, 1);
+        }
+
+        cv::GaussianBlur(expanded, blurred, cv::Size(5, 3), 0, 0);
+        expanded.copyTo(IO);
+        smoother.smooth(IO);
+        double max_difference = 0;
+        for (int v = 0; v < IO.rows; ++v)
+            for (int u = 0; u < IO.cols; ++u)
+                max_difference = std::max(max_difference, double(fabsf(IO.at<float>(v, u) - blurred.at<float>(v, u))));
+
+        double expand_ms = 0;
+        double fused_ms = 0;
+        for (int run = 0; run < n_runs; ++run)
+        {
+            image.copyTo(IO);
+            int64 start = cv::getTickCount();
+            engine.expandImageRangeMin(IO, IR);
+            expand_ms += elapsedMs(start, 1);
+
+            image.copyTo(IO);
+            start = cv::getTickCount();
+            engine.expandImageRangeMin(IO, IR, true);
+            fused_ms += elapsedMs(start, 1);
+        }
+
+        printf("\n%-16s %14s %14s\n", "smoothing", "time [ms]", "vs blur [m]");
+        printf("%-16s %14.4f %14s\n", "GaussianBlur", blur_ms / n_runs, "-");
+        printf("%-16s %14.4f %14.2g\n", "DepthSmoother", smooth_ms / n_runs, max_difference);
+        printf("%-16s %14.4f %14s\n", "11 row band", band_ms / n_runs, "-");
+        printf("%-16s %14.4f %14s\n", "range_min", expand_ms / n_runs, "-");
+        printf("%-16s %14.4f %14s\n", "range_min fused", fused_ms / n_runs, "-");
+    }
+
+    // Whole expander pass on the recorded frame: NaN fill and rounding, separable or range-min
+    // expansion and smoothing, on the float [m] and on the uint16 [mm] images
+    {
+        cv::Mat frame_mm(image.rows, image.cols, CV_16UC1);
+        fillNanDepthMillimetres(image, 4.9f, frame_mm);
+        std::vector<int> histogram(engine.maxDepth());
+        DepthSmoother smoother;
+
+        printf("\n%-16s %14s %14s %14s\n", "pipeline", "image bytes", "separable [ms]", "range_min [ms]");
+        for (int is_mm = 0; is_mm < 2; ++is_mm)
+        {
+            const cv::Mat& frame = is_mm ? frame_mm : image;
+            cv::Mat IO(frame.rows, frame.cols, frame.type());
+            cv::Mat IR_frame;
+            double ms[2] = {0, 0};
+            for (int mode = 0; mode < 2; ++mode)
+            {
+                int64 start = cv::getTickCount();
+                for (int run = 0; run < n_runs; ++run)
+                {
+                    if (is_mm)
+                        prepareDepthImageMillimetres(frame, IO, 4900, engine.precision_, engine.maxDepth(), IR_frame,
+                                                     &histogram[0]);
+                    else
+                        prepareDepthImage(frame, IO, 4.9f, engine.precision_, engine.maxDepth(), CV_16UC1, IR_frame,
+                                          &histogram[0]);
+
+                    if (mode == 0)
+                    {
+                        engine.expandImageSeparable(IO, IR_frame, &histogram[0]);
+                        smoother.smooth(IO);
+                    } else
+                    {
+                        engine.expandImageRangeMin(IO, IR_frame, true);
+                    }
+                }
+                ms[mode] = elapsedMs(start, n_runs);
+            }
+            printf("%-16s %14lu %14.4f %14.4f\n", is_mm ? "16UC1 [mm]" : "32FC1 [m]",
+                   (unsigned long)(frame.total() * frame.elemSize()), ms[0], ms[1]);
+        }
+    }
+
+    // Depth-ordered passes compiled for the image size and depth range vs. the generic ones
+    {
+        printf("\n%-16s %14s %14s %14s\n", "passes", "separable [ms]", "pruned [ms]", "range_min [ms]");
+        for (int prebuilt = 1; prebuilt >= 0; --prebuilt)
+        {
+            engine.setPrebuiltShapesEnabled(prebuilt != 0);
+            printf("%-16s %14.4f %14.4f %14.4f\n", engine.hasPrebuiltShape() ? "prebuilt" : "generic",
+                   benchmarkExpansion(engine, image, IR, n_runs),
+                   benchmarkExpansion(engine, image, IR, n_runs, PRUNED),
+                   benchmarkExpansion(engine, image, IR, n_runs, RANGE_MIN));
+        }
+        engine.setPrebuiltShapesEnabled(true);
+    }
+
+    // Table build time for larger sensors with the field of view of the default camera
+    // Range-min at the prebuilt resolutions, on the recorded frame upscaled by pixel repetition
+    printf("\n%-16s %14s %14s %14s %14s\n", "resolution", "build [ms]", "table [MB]", "range_min [ms]",
+           "vs separable");
+    for (int scale = 1; scale <= 4; scale *= 2)
+    {
+        LookupTableConfig scaled = config;
+        scaled.image_width *= scale;
+        scaled.image_height *= scale;
+        scaled.focal_length_u *= scale;
+        scaled.focal_length_v *= scale;
+        scaled.center_u *= scale;
+        scaled.center_v *= scale;
+
+        CSpaceExpansionEngine scaled_engine;
+        int64 start = cv::getTickCount();
+        scaled_engine.buildLookupTables(scaled);
+        double build_ms = elapsedMs(start, 1);
+        double table_mb = scaled_engine.prepareRangeMin() / 1e6;
+
+        cv::Mat scaled_image(scaled.image_height, scaled.image_width, CV_32F);
+        cv::Mat scaled_IR(scaled.image_height, scaled.image_width, CV_32F);
+        for (int v = 0; v < scaled.image_height; ++v)
+        {
+            for (int u = 0; u < scaled.image_width; ++u)
+            {
+                scaled_image.at<float>(v, u) = image.at<float>(v / scale, u / scale);
+                scaled_IR.at<float>(v, u) = IR.at<float>(v / scale, u / scale);
+            }
+        }
+
+        cv::Mat expected = scaled_image.clone();
+        scaled_engine.expandImageSeparable(expected, scaled_IR);
+        cv::Mat IO = scaled_image.clone();
+        scaled_engine.expandImageRangeMin(IO, scaled_IR);
+        int n_mismatches = 0;
+        for (int v = 0; v < IO.rows; ++v)
+            for (int u = 0; u < IO.cols; ++u)
+                n_mismatches += IO.at<float>(v, u) != expected.at<float>(v, u);
+
+        printf("%4d x %-9d %14.2f %14.1f %14.4f %14d\n", scaled.image_width, scaled.image_height, build_ms,
+               table_mb, benchmarkExpansion(scaled_engine, scaled_image, scaled_IR, n_slow_runs, RANGE_MIN),
+               n_mismatches);
+    }
+    return 0;
+}
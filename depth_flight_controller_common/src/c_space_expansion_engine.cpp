@@ -0,0 +1,1965 @@
+#include "c_space_expansion_engine.h"
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+namespace depth_flight_controller {
+
+    namespace
+    {
+        // out[i] = min(a[i], b[i]), for the planes of the range-min table
+        void minOfRows(const unsigned short* a, const unsigned short* b, unsigned short* out, int n)
+        {
+            int i = 0;
+#if defined(__SSE2__)
+            // No unsigned 16 bit min before SSE4.1: flip the sign bits, take the signed min,
+            // flip them back
+            const __m128i bias = _mm_set1_epi16(short(-32768));
+            for (; i + 8 <= n; i += 8)
+            {
+                __m128i x = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)), bias);
+                __m128i y = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)), bias);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_xor_si128(_mm_min_epi16(x, y), bias));
+            }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+            for (; i + 8 <= n; i += 8)
+                vst1q_u16(out + i, vminq_u16(vld1q_u16(a + i), vld1q_u16(b + i)));
+#endif
+            for (; i < n; ++i)
+                out[i] = std::min(a[i], b[i]);
+        }
+
+        // row[i] = min(row[i], z), the span-min kernel of the uint16 [mm] images: eight
+        // lanes per SSE2 / NEON register instead of the four of the float kernels
+        void minWithValue(unsigned short* row, int n, unsigned short z)
+        {
+            int i = 0;
+#if defined(__SSE2__)
+            const __m128i bias = _mm_set1_epi16(short(-32768));
+            const __m128i value = _mm_xor_si128(_mm_set1_epi16(short(z)), bias);
+            for (; i + 8 <= n; i += 8)
+            {
+                __m128i x = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i)), bias);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(row + i), _mm_xor_si128(_mm_min_epi16(x, value), bias));
+            }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+            const uint16x8_t value = vdupq_n_u16(z);
+            for (; i + 8 <= n; i += 8)
+                vst1q_u16(row + i, vminq_u16(vld1q_u16(row + i), value));
+#endif
+            for (; i < n; ++i)
+                row[i] = std::min(row[i], z);
+        }
+
+        // Image size and depth range [cm] of the depth-ordered passes. FixedShape carries them
+        // as constants, so that the strides, the divisions by the width and the loop bounds of
+        // its instantiation fold into the code; DynamicShape is the same for any other camera.
+        template <int W, int H, int D>
+        struct FixedShape
+        {
+            int width() const { return W; }
+            int height() const { return H; }
+            int maxDepth() const { return D; }
+
+            static bool matches(int width, int height, int max_depth)
+            {
+                return width == W && height == H && max_depth == D;
+            }
+        };
+
+        class DynamicShape
+        {
+        public:
+            DynamicShape(int width, int height, int max_depth)
+                : width_(width), height_(height), max_depth_(max_depth)
+            {
+            }
+
+            int width() const { return width_; }
+            int height() const { return height_; }
+            int maxDepth() const { return max_depth_; }
+
+        private:
+            int width_;
+            int height_;
+            int max_depth_;
+        };
+
+        // The prebuilt sensor shapes, all at the default table range of 5 m
+        typedef FixedShape<160, 120, 500> Shape160x120;
+        typedef FixedShape<320, 240, 500> Shape320x240;
+        typedef FixedShape<640, 480, 500> Shape640x480;
+
+        // Spans [low, low + extent) of one image axis covered by a sphere of drone_radius around
+        // the point the given pixel sees at each depth, written as (low, extent) per z_cm
+        void buildAxisSpans(int pixel, int n_pixels, double focal_length, double center,
+                            double drone_radius, int max_depth, int* spans)
+        {
+            int last = n_pixels - 1;
+            float offset = float(pixel - center);
+
+            for (int z_cm = 0; z_cm < max_depth; ++z_cm)
+            {
+                float z = float(z_cm) / 100;
+                float x = offset * z / focal_length;
+                float alpha = atan(x / z);
+                float dist_to_point = (sqrt(pow(z, 2) + pow(x, 2)));
+
+                float alpha_1;
+                float r_1;
+                float r_2;
+                int low;
+                int high;
+                int* span = &spans[2 * z_cm];
+
+                if (dist_to_point > 0.2)
+                {
+                    if (z > 0.205)
+                    {
+                        alpha_1 = asin(drone_radius / dist_to_point);
+                        r_1 = z * tan(alpha - alpha_1);
+                        r_2 = z * tan(alpha + alpha_1);
+
+                        low = int(int(focal_length * r_1 / z) + center);
+                        low = std::min(std::max(low, 0), last);
+                        span[0] = low;
+
+                        high = int(focal_length * r_2 / z + center);
+                        high = std::min(std::max(high, 0), last);
+                        span[1] = high - low + 1;
+                    } else if (pixel < center)
+                    {
+                        alpha_1 = asin(drone_radius / dist_to_point);
+                        r_2 = z * tan(alpha + alpha_1);
+
+                        low = 0;
+                        span[0] = low;
+
+                        high = int(focal_length * r_2 / z + center);
+                        high = std::min(std::max(high, 0), last);
+                        span[1] = high - low + 1;
+                    } else
+                    {
+                        alpha_1 = asin(drone_radius / dist_to_point);
+                        r_1 = z * tan(alpha - alpha_1);
+
+                        low = int(int(focal_length * r_1 / z) + center);
+                        low = std::min(std::max(low, 0), last);
+                        span[0] = low;
+
+                        high = last;
+                        span[1] = high - low + 1;
+                    }
+
+                } else
+                {
+                    span[0] = 0;
+                    span[1] = last;
+                }
+            }
+        }
+
+        // Exact image footprint of the sphere of drone_radius around the point P = (x, y, z)
+        // pixel (u, v) sees at depth z: the pixels [c, c + 1) x [r, r + 1) some ray of which
+        // passes within the radius of P. In normalized coordinates a = (col - cx) / fu and
+        // t = (row - cy) / fv the footprint is the ellipse A a^2 - 2 x g a + K (1 + t^2) - g^2 <= 0
+        // with g = y t + z, A = y^2 + z^2 - R^2 and K = |P|^2 - R^2, so a row cuts it in the
+        // chord (x g -+ sqrt(K) sqrt(g^2 - A (1 + t^2))) / A. Over the t range of an image row
+        // the left end of the chord is convex in t and takes its minimum at the t of the
+        // leftmost point of the ellipse, clamped to that range; same for the right end.
+        // The ellipse is bounded only if the sphere lies in front of the camera (z > R):
+        // nearer spheres keep the full rectangle.
+        class SphereFootprint
+        {
+        public:
+            SphereFootprint(const LookupTableConfig& c, int u, int v, int z_cm)
+                    : fu_(c.focal_length_u),
+                      cu_(c.center_u),
+                      fv_(c.focal_length_v),
+                      cv_(c.center_v)
+            {
+                double radius = c.drone_radius;
+                double z = double(z_cm) / 100;
+                double x = (u - c.center_u) * z / c.focal_length_u;
+                double y = (v - c.center_v) * z / c.focal_length_v;
+
+                bounded_ = z > radius + 0.01;
+                if (!bounded_)
+                    return;
+
+                double r2 = radius * radius;
+                double a = y * y + z * z - r2;
+                double sqrt_a = sqrt(a);
+                x_ = x;
+                y_ = y;
+                z_ = z;
+                a_ = a;
+                sqrt_k_ = sqrt(x * x + a);
+
+                // Top and bottom of the ellipse: g^2 = A (1 + t^2)
+                t_top_ = (y * z - radius * sqrt_a) / (z * z - r2);
+                t_bottom_ = (y * z + radius * sqrt_a) / (z * z - r2);
+
+                // Leftmost and rightmost points: the tangent points y / T_z of the planes
+                // through the vertical axis of the camera touching the sphere
+                double d2 = x * x + z * z;
+                double tangent = sqrt(d2 - r2);
+                t_left_ = y * d2 / (z * (d2 - r2) + x * radius * tangent);
+                t_right_ = y * d2 / (z * (d2 - r2) - x * radius * tangent);
+            }
+
+            // Columns [begin, end) of image row r the footprint covers, within [x, x + w)
+            void rowSpan(int r, int x, int w, int& begin, int& end) const
+            {
+                begin = x;
+                end = x + w;
+                if (!bounded_)
+                    return;
+
+                double t_begin = std::max((r - cv_) / fv_, t_top_);
+                double t_end = std::min((r + 1 - cv_) / fv_, t_bottom_);
+                if (t_begin > t_end)
+                {
+                    end = begin;
+                    return;
+                }
+
+                // 1/2000 of a pixel of slack against the rounding of the doubles
+                double left = fu_ * chordEnd(clamp(t_left_, t_begin, t_end), -1) + cu_ - 5e-4;
+                double right = fu_ * chordEnd(clamp(t_right_, t_begin, t_end), 1) + cu_ + 5e-4;
+                begin = std::max(begin, int(floor(left)));
+                end = std::max(std::min(end, int(floor(right)) + 1), begin);
+            }
+
+        private:
+            static double clamp(double t, double low, double high)
+            {
+                return std::min(std::max(t, low), high);
+            }
+
+            double chordEnd(double t, double side) const
+            {
+                double g = y_ * t + z_;
+                double s = sqrt(std::max(g * g - a_ * (1 + t * t), 0.0));
+                return (x_ * g + side * sqrt_k_ * s) / a_;
+            }
+
+            double fu_, cu_, fv_, cv_;
+            bool bounded_;
+            double x_, y_, z_, a_, sqrt_k_;
+            double t_top_, t_bottom_, t_left_, t_right_;
+        };
+    }
+
+    LookupTableConfig::LookupTableConfig()
+            : image_width(160),
+              image_height(120),
+              focal_length_u(151.81),
+              focal_length_v(151.81),
+              center_u(80),
+              center_v(60),
+              drone_radius(0.3),
+              max_depth(500)
+    {
+    }
+
+    bool LookupTableConfig::operator==(const LookupTableConfig& other) const
+    {
+        return image_width == other.image_width && image_height == other.image_height &&
+               focal_length_u == other.focal_length_u && focal_length_v == other.focal_length_v &&
+               center_u == other.center_u && center_v == other.center_v &&
+               drone_radius == other.drone_radius && max_depth == other.max_depth;
+    }
+
+    bool LookupTableConfig::operator!=(const LookupTableConfig& other) const
+    {
+        return !(*this == other);
+    }
+
+    class CSpaceExpansionEngine::LookupTableBody : public cv::ParallelLoopBody
+    {
+    public:
+        LookupTableBody(CSpaceExpansionEngine& engine)
+                : engine_(engine)
+        {
+        }
+
+        // Ranges over the u-rows followed by the v-rows of the tables
+        virtual void operator()(const cv::Range& range) const
+        {
+            const LookupTableConfig& c = engine_.config_;
+
+            for (int i = range.start; i < range.end; ++i)
+            {
+                if (i < c.image_width)
+                {
+                    buildAxisSpans(i, c.image_width, c.focal_length_u, c.center_u, c.drone_radius,
+                                   c.max_depth, &engine_.utable_storage_[2 * i * c.max_depth]);
+                } else
+                {
+                    int v = i - c.image_width;
+                    buildAxisSpans(v, c.image_height, c.focal_length_v, c.center_v, c.drone_radius,
+                                   c.max_depth, &engine_.vtable_storage_[2 * v * c.max_depth]);
+                }
+            }
+        }
+
+    private:
+        CSpaceExpansionEngine& engine_;
+    };
+
+    class CSpaceExpansionEngine::BandBody : public cv::ParallelLoopBody
+    {
+    public:
+        BandBody(CSpaceExpansionEngine& engine, const cv::Mat& IR, int v_min, int v_max)
+                : engine_(engine), IR_(IR), v_min_(v_min), v_max_(v_max)
+        {
+        }
+
+        virtual void operator()(const cv::Range& range) const
+        {
+            int n_bands = engine_.band_img_.size();
+            int width = engine_.image_width_;
+            const float unreached = std::numeric_limits<float>::max();
+
+            for (int b = range.start; b < range.end; ++b)
+            {
+                float* const* rows = &engine_.band_rows_[b][0];
+                int v_begin = v_min_ + (v_max_ - v_min_) * b / n_bands;
+                int v_end = v_min_ + (v_max_ - v_min_) * (b + 1) / n_bands;
+
+                // Only the rows [fill_begin, fill_end) the stamps of the band reach are
+                // initialized, grown as nearer stamps reach farther, and merged
+                int fill_begin = v_begin;
+                int fill_end = v_begin;
+                for (int v = v_begin; v < v_end; ++v)
+                {
+                    const float* pR = IR_.ptr<float>(v);
+                    for (int u = 0; u < width; ++u)
+                    {
+                        int z_cm = engine_.clampDepth(pR[u]);
+                        if (z_cm < 0)
+                            continue;
+
+                        int y, h;
+                        engine_.vSpan(v, z_cm, y, h);
+                        for (; fill_begin > y; --fill_begin)
+                            std::fill(rows[fill_begin - 1], rows[fill_begin - 1] + width, unreached);
+                        for (; fill_end < y + h; ++fill_end)
+                            std::fill(rows[fill_end], rows[fill_end] + width, unreached);
+
+                        engine_.stampRect(rows, u, v, z_cm);
+                    }
+                }
+                engine_.band_reach_[2 * b] = fill_begin;
+                engine_.band_reach_[2 * b + 1] = fill_end;
+            }
+        }
+
+    private:
+        CSpaceExpansionEngine& engine_;
+        const cv::Mat& IR_;
+        int v_min_;
+        int v_max_;
+    };
+
+    class CSpaceExpansionEngine::MergeBody : public cv::ParallelLoopBody
+    {
+    public:
+        MergeBody(CSpaceExpansionEngine& engine)
+                : engine_(engine)
+        {
+        }
+
+        virtual void operator()(const cv::Range& range) const
+        {
+            int n_bands = engine_.band_img_.size();
+            int width = engine_.image_width_;
+
+            for (int r = range.start; r < range.end; ++r)
+            {
+                float* pO = engine_.row_ptr_[r];
+                for (int b = 0; b < n_bands; ++b)
+                {
+                    if (r < engine_.band_reach_[2 * b] || r >= engine_.band_reach_[2 * b + 1])
+                        continue;
+
+                    const float* pB = engine_.band_rows_[b][r];
+                    for (int u = 0; u < width; ++u)
+                        pO[u] = std::min(pO[u], pB[u]);
+                }
+            }
+        }
+
+    private:
+        CSpaceExpansionEngine& engine_;
+    };
+
+    CSpaceExpansionEngine::CSpaceExpansionEngine()
+            : image_width_(0),
+              image_height_(0),
+              max_depth_(0),
+              utable_(NULL),
+              vtable_(NULL),
+              share_tables_(false),
+              shared_offset_(0),
+              shared_min_depth_(0),
+              separable_min_depth_(0),
+              span_min_(selectSpanMinKernel()),
+              prebuilt_shape_(SHAPE_DYNAMIC),
+              prebuilt_shapes_enabled_(true),
+              n_bands_(cv::getNumThreads()),
+              pruned_stamps_(0),
+              tile_size_(16),
+              pyramid_factor_(2),
+              pyramid_max_error_(0.1),
+              pyramid_split_depth_(0),
+              coarse_width_(0),
+              coarse_height_(0),
+              nested_depth_(0),
+              range_min_levels_(0)
+    {
+        incremental_stats_.tiles = 0;
+        incremental_stats_.changed_tiles = 0;
+        incremental_stats_.recomputed_tiles = 0;
+    }
+
+
+    CSpaceExpansionEngine::~CSpaceExpansionEngine()
+    {
+
+    }
+
+    void CSpaceExpansionEngine::buildLookupTables(double focal_length, double drone_radius)
+    {
+        LookupTableConfig config;
+        config.focal_length_u = focal_length;
+        config.focal_length_v = focal_length;
+        config.drone_radius = drone_radius;
+        buildLookupTables(config);
+    }
+
+    const LookupTableConfig& CSpaceExpansionEngine::lookupTableConfig() const
+    {
+        return config_;
+    }
+
+    void CSpaceExpansionEngine::buildLookupTables(const LookupTableConfig& config)
+    {
+        setConfig(config);
+        computeSpanTables();
+        finishLookupTables();
+    }
+
+    CSpaceExpansionEngine::LookupTableSource CSpaceExpansionEngine::loadLookupTables(const LookupTableConfig& config,
+                                                                                     const std::string& cache_path)
+    {
+        setConfig(config);
+
+        if (table_file_.open(cache_path, config, precision_))
+        {
+            utable_ = table_file_.utable();
+            vtable_ = table_file_.vtable();
+            utable_storage_.clear();
+            vtable_storage_.clear();
+            finishLookupTables();
+            return TABLES_MAPPED;
+        }
+
+        computeSpanTables();
+        finishLookupTables();
+
+        if (LookupTableFile::write(cache_path, config, precision_, utable_, vtable_))
+            return TABLES_BUILT_AND_CACHED;
+        return TABLES_BUILT;
+    }
+
+    void CSpaceExpansionEngine::setConfig(const LookupTableConfig& config)
+    {
+        CV_Assert(config.image_width > 0 && config.image_height > 0 && config.max_depth > 0);
+
+        config_ = config;
+        image_width_ = config.image_width;
+        image_height_ = config.image_height;
+        max_depth_ = config.max_depth;
+    }
+
+    void CSpaceExpansionEngine::computeSpanTables()
+    {
+        // Build (u,z) and (v,z) lookup tables
+        table_file_.close();
+        utable_storage_.resize(2 * image_width_ * max_depth_);
+        vtable_storage_.resize(2 * image_height_ * max_depth_);
+        cv::parallel_for_(cv::Range(0, image_width_ + image_height_), LookupTableBody(*this));
+
+        utable_ = &utable_storage_[0];
+        vtable_ = &vtable_storage_[0];
+    }
+
+    void CSpaceExpansionEngine::finishLookupTables()
+    {
+        // Everything derived from the span tables. Cheap compared to the spans themselves.
+        resetIncremental();
+
+        if (Shape160x120::matches(image_width_, image_height_, max_depth_))
+            prebuilt_shape_ = SHAPE_160x120;
+        else if (Shape320x240::matches(image_width_, image_height_, max_depth_))
+            prebuilt_shape_ = SHAPE_320x240;
+        else if (Shape640x480::matches(image_width_, image_height_, max_depth_))
+            prebuilt_shape_ = SHAPE_640x480;
+        else
+            prebuilt_shape_ = SHAPE_DYNAMIC;
+
+        reduced_depth_.resize(max_depth_);
+        reduced_depth_mm_.resize(max_depth_);
+        for (int z_cm = 0; z_cm < max_depth_; ++z_cm)
+        {
+            reduced_depth_[z_cm] = float(std::max(z_cm,20))/100-config_.drone_radius;
+            reduced_depth_mm_[z_cm] = (unsigned short)std::min(std::max(int(lround(reduced_depth_[z_cm] * 1000)), 0), 65535);
+        }
+
+        // The separable passes only keep the nearest stamp per (row, column). That is exact as
+        // long as the v-interval of a pixel shrinks with growing depth, so find the depth from
+        // which on every v-interval contains all intervals of the farther depths.
+        std::vector<int> hull_low(image_height_, image_height_);
+        std::vector<int> hull_high(image_height_, -1);
+
+        separable_min_depth_ = max_depth_;
+        for (int z_cm = max_depth_ - 1; z_cm >= 0; --z_cm)
+        {
+            bool is_nested = true;
+            for (int v = 0; v < image_height_; ++v)
+            {
+                const int* span = &vtable_[2 * (v * max_depth_ + z_cm)];
+                if (span[0] > hull_low[v] || span[0] + span[1] < hull_high[v])
+                    is_nested = false;
+            }
+
+            if (!is_nested)
+                break;
+
+            separable_min_depth_ = z_cm;
+            for (int v = 0; v < image_height_; ++v)
+            {
+                const int* span = &vtable_[2 * (v * max_depth_ + z_cm)];
+                if (span[1] > 0)
+                {
+                    hull_low[v] = std::min(hull_low[v], span[0]);
+                    hull_high[v] = std::max(hull_high[v], span[0] + span[1]);
+                }
+            }
+        }
+
+        // Compact copies for the fast paths. Empty spans are stored with zero extent.
+        compact_utable_.resize(image_width_, max_depth_);
+        for (int u = 0; u < image_width_; ++u)
+            for (int z_cm = 0; z_cm < max_depth_; ++z_cm)
+            {
+                const int* span = &utable_[2 * (u * max_depth_ + z_cm)];
+                compact_utable_.set(u, z_cm, span[0], std::max(span[1], 0));
+            }
+
+        // Both tables are built around the principal point, so with equal focal lengths a
+        // v-span is the u-span of the pixel at the same offset, clipped to the image height.
+        // Find the depths for which that holds exactly (it does not where the tables saturate).
+        shared_offset_ = int(config_.center_u) - int(config_.center_v);
+        shared_min_depth_ = max_depth_;
+        for (int z_cm = max_depth_ - 1; z_cm >= 0; --z_cm)
+        {
+            bool is_shared = true;
+            for (int v = 0; v < image_height_ && is_shared; ++v)
+            {
+                int u = v + shared_offset_;
+                if (u < 0 || u >= image_width_)
+                {
+                    is_shared = false;
+                    break;
+                }
+
+                const int* u_span = &utable_[2 * (u * max_depth_ + z_cm)];
+                const int* v_span = &vtable_[2 * (v * max_depth_ + z_cm)];
+                int low = u_span[0];
+                int high = low + std::max(u_span[1], 0) - 1;
+                int y = std::min(std::max(low - shared_offset_, 0), image_height_ - 1);
+                int h = std::min(std::max(high - shared_offset_, 0), image_height_ - 1) - y + 1;
+
+                if (y != v_span[0] || h != std::max(v_span[1], 0))
+                    is_shared = false;
+            }
+
+            if (!is_shared)
+                break;
+            shared_min_depth_ = z_cm;
+        }
+
+        buildCompactVTable();
+
+        // Per-frame buffers
+        row_ptr_.resize(image_height_);
+        row_ptr_mm_.resize(image_height_);
+        depth_count_.resize(max_depth_);
+        pixel_depth_.resize(image_width_ * image_height_);
+        depth_order_.resize(image_width_ * image_height_);
+        row_next_.resize((image_width_ + 1) * image_height_);
+        col_next_.resize((image_height_ + 1) * image_width_);
+        span_pixel_.resize(image_width_ * image_height_);
+        span_depth_.resize(image_width_ * image_height_);
+        allocateBandBuffers();
+
+        // From nested_depth_ on, the spans of a column (row) contain those of all farther
+        // depths and move monotonically with the column (row)
+        nested_depth_ = max_depth_ - 1;
+        while (nested_depth_ > 0 && isNestedAndOrdered(nested_depth_ - 1))
+            --nested_depth_;
+        cover_u_.clear();
+        cover_v_.clear();
+
+        updatePyramid();
+    }
+
+    void CSpaceExpansionEngine::setSharedTables(bool enabled)
+    {
+        share_tables_ = enabled;
+        buildCompactVTable();
+    }
+
+    size_t CSpaceExpansionEngine::lookupTableBytes() const
+    {
+        return compact_utable_.bytes() + compact_vtable_.bytes();
+    }
+
+    void CSpaceExpansionEngine::buildCompactVTable()
+    {
+        // With shared tables only the depths the u-table can not serve are kept
+        int n_depths = share_tables_ ? shared_min_depth_ : max_depth_;
+
+        compact_vtable_.resize(image_height_, n_depths);
+        for (int v = 0; v < image_height_; ++v)
+            for (int z_cm = 0; z_cm < n_depths; ++z_cm)
+            {
+                const int* span = &vtable_[2 * (v * max_depth_ + z_cm)];
+                compact_vtable_.set(v, z_cm, span[0], std::max(span[1], 0));
+            }
+    }
+
+    void CSpaceExpansionEngine::setSimdEnabled(bool enabled)
+    {
+        span_min_ = selectSpanMinKernel(enabled);
+    }
+
+    void CSpaceExpansionEngine::setPrebuiltShapesEnabled(bool enabled)
+    {
+        prebuilt_shapes_enabled_ = enabled;
+    }
+
+    bool CSpaceExpansionEngine::hasPrebuiltShape() const
+    {
+        return prebuilt_shapes_enabled_ && prebuilt_shape_ != SHAPE_DYNAMIC;
+    }
+
+    const char* CSpaceExpansionEngine::spanMinKernelName() const
+    {
+        return depth_flight_controller::spanMinKernelName(span_min_);
+    }
+
+    void CSpaceExpansionEngine::expandImageStamping(cv::Mat& IO, const cv::Mat& IR, int v_min, int v_max)
+    {
+        CV_Assert(IO.depth() == CV_32FC1 || IO.depth() == CV_16UC1);
+
+        for (int v = v_min; v < v_max; ++v)
+        {
+            for (int u = 0; u < image_width_; ++u)
+            {
+                int z_old = sourceDepth(IR, u, v);
+
+                if (z_old >= 0)
+                {
+                    int x, w, y, h;
+                    lookupInt(u, v, z_old, x, w, y, h);
+                    double z_new = IO.depth() == CV_16U ? reduced_depth_mm_[z_old] : reduced_depth_[z_old];
+
+                    cv::Rect roi = cv::Rect(x, y, w, h);
+
+                    IO(roi).setTo(z_new, IO(roi) > z_new);
+                }
+            }
+        }
+    }
+
+    void CSpaceExpansionEngine::expandImageRowPointers(cv::Mat& IO, const cv::Mat& IR, int v_min, int v_max)
+    {
+        CV_Assert(IO.depth() == CV_32FC1 && IR.depth() == CV_32FC1);
+        CV_Assert(IO.rows == image_height_ && IO.cols == image_width_);
+
+        setRowPointers(IO);
+
+        for (int v = std::max(v_min, 0); v < std::min(v_max, image_height_); ++v)
+        {
+            const float* pR = IR.ptr<float>(v);
+            for (int u = 0; u < image_width_; ++u)
+            {
+                int z_cm = clampDepth(pR[u]);
+                if (z_cm >= 0)
+                    stampRect(&row_ptr_[0], u, v, z_cm);
+            }
+        }
+    }
+
+    void CSpaceExpansionEngine::expandImageSpherical(cv::Mat& IO, const cv::Mat& IR, int v_min, int v_max)
+    {
+        CV_Assert(IO.depth() == CV_32FC1 && (IR.depth() == CV_32FC1 || IR.depth() == CV_16UC1));
+        CV_Assert(IO.rows == image_height_ && IO.cols == image_width_);
+
+        setRowPointers(IO);
+        bucketByDepth(IR, v_min, v_max, NULL);
+
+        // Same marking scheme as expandImagePruned: the first stamp reaching an image pixel
+        // is the nearest one, later stamps skip it
+        resetRowLinks();
+
+        int n_unmarked = image_width_ * image_height_;
+        int begin = 0;
+        for (int z_cm = 0; z_cm < max_depth_ && n_unmarked > 0; ++z_cm)
+        {
+            int end = depth_count_[z_cm];
+            float z_new = reduced_depth_[z_cm];
+
+            for (int k = begin; k < end && n_unmarked > 0; ++k)
+            {
+                int v = depth_order_[k] / image_width_;
+                int u = depth_order_[k] - v * image_width_;
+
+                int x, w, y, h;
+                lookupCompact(u, v, z_cm, x, w, y, h);
+                SphereFootprint footprint(config_, u, v, z_cm);
+
+                for (int i = 0; i < h; ++i)
+                {
+                    int* next = &row_next_[(y + i) * (image_width_ + 1)];
+                    if (findNext(next, x) >= x + w)
+                        continue; // Rectangle row already covered, skip the chord
+
+                    int c_begin, c_end;
+                    footprint.rowSpan(y + i, x, w, c_begin, c_end);
+                    float* pO = row_ptr_[y + i];
+
+                    for (int c = findNext(next, c_begin); c < c_end; c = findNext(next, c + 1))
+                    {
+                        next[c] = c + 1;
+                        pO[c] = std::min(pO[c], z_new);
+                        --n_unmarked;
+                    }
+                }
+            }
+            begin = end;
+        }
+    }
+
+    long CSpaceExpansionEngine::stampedPixels(const cv::Mat& IR, int v_min, int v_max, bool spherical)
+    {
+        long n_pixels = 0;
+        for (int v = std::max(v_min, 0); v < std::min(v_max, image_height_); ++v)
+        {
+            const float* pR = IR.ptr<float>(v);
+            for (int u = 0; u < image_width_; ++u)
+            {
+                int z_cm = clampDepth(pR[u]);
+                if (z_cm < 0)
+                    continue;
+
+                int x, w, y, h;
+                lookupCompact(u, v, z_cm, x, w, y, h);
+                if (!spherical)
+                {
+                    n_pixels += long(w) * h;
+                    continue;
+                }
+
+                SphereFootprint footprint(config_, u, v, z_cm);
+                for (int i = 0; i < h; ++i)
+                {
+                    int c_begin, c_end;
+                    footprint.rowSpan(y + i, x, w, c_begin, c_end);
+                    n_pixels += c_end - c_begin;
+                }
+            }
+        }
+        return n_pixels;
+    }
+
+    void CSpaceExpansionEngine::setParallelBands(int n_bands)
+    {
+        n_bands_ = std::max(n_bands, 1);
+        allocateBandBuffers();
+    }
+
+    void CSpaceExpansionEngine::allocateBandBuffers()
+    {
+        int n_bands = n_bands_;
+
+        band_img_.resize(n_bands);
+        band_rows_.resize(n_bands);
+        band_reach_.assign(2 * n_bands, 0);
+        for (int b = 0; b < n_bands; ++b)
+        {
+            band_img_[b].create(image_height_, image_width_, CV_32FC1);
+            band_rows_[b].resize(image_height_);
+            for (int r = 0; r < image_height_; ++r)
+                band_rows_[b][r] = band_img_[b].ptr<float>(r);
+        }
+    }
+
+    void CSpaceExpansionEngine::expandImageParallel(cv::Mat& IO, const cv::Mat& IR, int v_min, int v_max)
+    {
+        CV_Assert(IO.depth() == CV_32FC1 && IR.depth() == CV_32FC1);
+        CV_Assert(IO.rows == image_height_ && IO.cols == image_width_);
+
+        setRowPointers(IO);
+
+        v_min = std::max(v_min, 0);
+        v_max = std::min(v_max, image_height_);
+        int n_bands = band_img_.size();
+
+        cv::parallel_for_(cv::Range(0, n_bands), BandBody(*this, IR, v_min, v_max), n_bands);
+        cv::parallel_for_(cv::Range(0, image_height_), MergeBody(*this), n_bands);
+    }
+
+    void CSpaceExpansionEngine::expandImageSeparable(cv::Mat& IO, const cv::Mat& IR, const int* depth_histogram)
+    {
+        CV_Assert((IO.depth() == CV_32FC1 || IO.depth() == CV_16UC1) && (IR.depth() == CV_32FC1 || IR.depth() == CV_16UC1));
+        CV_Assert(IO.rows == image_height_ && IO.cols == image_width_);
+
+        setRowPointers(IO);
+        if (IO.depth() == CV_16U)
+            expandDepthOrdered(PASS_SEPARABLE, &row_ptr_mm_[0], &reduced_depth_mm_[0], IR, depth_histogram, false);
+        else
+            expandDepthOrdered(PASS_SEPARABLE, &row_ptr_[0], &reduced_depth_[0], IR, depth_histogram, false);
+    }
+
+
+    void CSpaceExpansionEngine::expandImagePruned(cv::Mat& IO, const cv::Mat& IR, const int* depth_histogram)
+    {
+        CV_Assert((IO.depth() == CV_32FC1 || IO.depth() == CV_16UC1) && (IR.depth() == CV_32FC1 || IR.depth() == CV_16UC1));
+        CV_Assert(IO.rows == image_height_ && IO.cols == image_width_);
+
+        setRowPointers(IO);
+        if (IO.depth() == CV_16U)
+            expandDepthOrdered(PASS_PRUNED, &row_ptr_mm_[0], &reduced_depth_mm_[0], IR, depth_histogram, false);
+        else
+            expandDepthOrdered(PASS_PRUNED, &row_ptr_[0], &reduced_depth_[0], IR, depth_histogram, false);
+    }
+
+
+    template <typename T>
+    void CSpaceExpansionEngine::expandDepthOrdered(DepthOrderedPass pass, T* const* rows, const T* reduced_depth,
+                                                   const cv::Mat& IR, const int* depth_histogram, bool smooth)
+    {
+        switch (hasPrebuiltShape() ? prebuilt_shape_ : SHAPE_DYNAMIC)
+        {
+            case SHAPE_160x120:
+                runDepthOrdered(Shape160x120(), pass, rows, reduced_depth, IR, depth_histogram, smooth);
+                break;
+            case SHAPE_320x240:
+                runDepthOrdered(Shape320x240(), pass, rows, reduced_depth, IR, depth_histogram, smooth);
+                break;
+            case SHAPE_640x480:
+                runDepthOrdered(Shape640x480(), pass, rows, reduced_depth, IR, depth_histogram, smooth);
+                break;
+            default:
+                runDepthOrdered(DynamicShape(image_width_, image_height_, max_depth_), pass, rows, reduced_depth,
+                                IR, depth_histogram, smooth);
+        }
+    }
+
+    template <typename Shape, typename T>
+    void CSpaceExpansionEngine::runDepthOrdered(const Shape& shape, DepthOrderedPass pass, T* const* rows,
+                                                const T* reduced_depth, const cv::Mat& IR,
+                                                const int* depth_histogram, bool smooth)
+    {
+        switch (pass)
+        {
+            case PASS_SEPARABLE:
+                expandSeparable(shape, rows, reduced_depth, IR, depth_histogram);
+                break;
+            case PASS_PRUNED:
+                expandPruned(shape, rows, reduced_depth, IR, depth_histogram);
+                break;
+            case PASS_RANGE_MIN:
+                expandRangeMin(shape, rows, reduced_depth, IR, smooth);
+                break;
+        }
+    }
+
+    template <typename Shape, typename T>
+    void CSpaceExpansionEngine::expandSeparable(const Shape& shape, T* const* rows, const T* reduced_depth,
+                                                const cv::Mat& IR, const int* depth_histogram)
+    {
+        const int width = shape.width();
+        const int height = shape.height();
+        const int max_depth = shape.maxDepth();
+
+        bucketByDepth(shape, IR, 0, height, depth_histogram);
+
+        // Horizontal pass: walking the slices from near to far, every column of a row is
+        // taken by the first (i.e. nearest) stamp of that row covering it
+        resetRowLinks(shape);
+
+        int n_spans = 0;
+        int begin = 0;
+        for (int z_cm = 0; z_cm < max_depth; ++z_cm)
+        {
+            int end = depth_count_[z_cm];
+            for (int k = begin; k < end; ++k)
+            {
+                int v = depth_order_[k] / width;
+                int u = depth_order_[k] - v * width;
+
+                if (z_cm < separable_min_depth_)
+                {
+                    stampRect(rows, u, v, z_cm);
+                    continue;
+                }
+
+                int x, w;
+                uSpan(u, z_cm, x, w);
+                int* next = &row_next_[v * (width + 1)];
+
+                for (int c = findNext(next, x); c < x + w; c = findNext(next, c + 1))
+                {
+                    next[c] = c + 1;
+                    span_pixel_[n_spans] = v * width + c;
+                    span_depth_[n_spans] = z_cm;
+                    ++n_spans;
+                }
+            }
+            begin = end;
+        }
+
+        // Vertical pass: the row pass emitted its spans sorted by depth, so the first span
+        // reaching an image pixel carries the minimum reduced depth for it
+        for (int i = 0; i < (height + 1) * width; ++i)
+            col_next_[i] = i % (height + 1);
+
+        for (int k = 0; k < n_spans; ++k)
+        {
+            int z_cm = span_depth_[k];
+            int v = span_pixel_[k] / width;
+            int u = span_pixel_[k] - v * width;
+            T z_new = reduced_depth[z_cm];
+
+            int y, h;
+            vSpan(v, z_cm, y, h);
+            int* next = &col_next_[u * (height + 1)];
+
+            for (int r = findNext(next, y); r < y + h; r = findNext(next, r + 1))
+            {
+                next[r] = r + 1;
+                rows[r][u] = std::min(rows[r][u], z_new);
+            }
+        }
+    }
+
+    template <typename Shape, typename T>
+    void CSpaceExpansionEngine::expandPruned(const Shape& shape, T* const* rows, const T* reduced_depth,
+                                             const cv::Mat& IR, const int* depth_histogram)
+    {
+        const int width = shape.width();
+        const int height = shape.height();
+        const int max_depth = shape.maxDepth();
+
+        bucketByDepth(shape, IR, 0, height, depth_histogram);
+
+        // The row links mark image pixels that already hold a stamp. Stamps arrive sorted by
+        // depth, so a marked pixel can not be lowered any further by the current or any later
+        // stamp and is skipped; a stamp without unmarked pixels is pruned as a whole.
+        resetRowLinks(shape);
+
+        pruned_stamps_ = 0;
+        int n_unmarked = width * height;
+        int begin = 0;
+        for (int z_cm = 0; z_cm < max_depth; ++z_cm)
+        {
+            int end = depth_count_[z_cm];
+            T z_new = reduced_depth[z_cm];
+
+            for (int k = begin; k < end; ++k)
+            {
+                if (n_unmarked == 0)
+                {
+                    // Every image pixel holds its final value, all remaining stamps are pruned
+                    pruned_stamps_ += depth_count_[max_depth - 1] - k;
+                    return;
+                }
+
+                int v = depth_order_[k] / width;
+                int u = depth_order_[k] - v * width;
+
+                if (isDominatedByNeighbour(shape, u, v, z_cm))
+                {
+                    ++pruned_stamps_;
+                    continue;
+                }
+
+                int x, w, y, h;
+                lookupCompact(u, v, z_cm, x, w, y, h);
+                int x_end = x + w;
+                bool is_stamped = false;
+
+                for (int r = y; r < y + h; ++r)
+                {
+                    int* next = &row_next_[r * (width + 1)];
+                    T* pO = rows[r];
+
+                    for (int c = findNext(next, x); c < x_end; c = findNext(next, c + 1))
+                    {
+                        next[c] = c + 1;
+                        pO[c] = std::min(pO[c], z_new);
+                        is_stamped = true;
+                        --n_unmarked;
+                    }
+                }
+
+                if (!is_stamped)
+                    ++pruned_stamps_;
+            }
+            begin = end;
+        }
+    }
+
+
+    void CSpaceExpansionEngine::expandImageBand(cv::Mat& IO, const cv::Mat& IR, const int* band_begin,
+                                                const int* band_end, const int* depth_histogram)
+    {
+        CV_Assert(IO.depth() == CV_32FC1 && (IR.depth() == CV_32FC1 || IR.depth() == CV_16UC1));
+        CV_Assert(IO.rows == image_height_ && IO.cols == image_width_);
+
+        setRowPointers(IO);
+        bucketByDepth(IR, 0, image_height_, depth_histogram);
+
+        int n_unmarked = 0;
+        int band_top = image_height_;
+        int band_bottom = 0;
+        for (int v = 0; v < image_height_; ++v)
+        {
+            CV_Assert(band_begin[v] >= 0 && band_end[v] <= image_width_);
+            if (band_end[v] > band_begin[v])
+            {
+                n_unmarked += band_end[v] - band_begin[v];
+                band_top = std::min(band_top, v);
+                band_bottom = v + 1;
+            }
+        }
+
+        // Only the row links of the band are read
+        for (int i = band_top * (image_width_ + 1); i < band_bottom * (image_width_ + 1); ++i)
+            row_next_[i] = i % (image_width_ + 1);
+
+        // Marking as in expandImagePruned, restricted to the band: the nearest stamp reaching a
+        // band pixel is final, and the loop ends once no band pixel is left
+        int begin = 0;
+        for (int z_cm = 0; z_cm < max_depth_ && n_unmarked > 0; ++z_cm)
+        {
+            int end = depth_count_[z_cm];
+            float z_new = reduced_depth_[z_cm];
+
+            for (int k = begin; k < end && n_unmarked > 0; ++k)
+            {
+                int v = depth_order_[k] / image_width_;
+                int u = depth_order_[k] - v * image_width_;
+
+                int x, w, y, h;
+                lookupCompact(u, v, z_cm, x, w, y, h);
+                int r_end = std::min(y + h, band_bottom);
+
+                for (int r = std::max(y, band_top); r < r_end; ++r)
+                {
+                    int x_end = std::min(x + w, band_end[r]);
+                    int* next = &row_next_[r * (image_width_ + 1)];
+                    float* pO = row_ptr_[r];
+
+                    for (int c = findNext(next, std::max(x, band_begin[r])); c < x_end; c = findNext(next, c + 1))
+                    {
+                        next[c] = c + 1;
+                        pO[c] = std::min(pO[c], z_new);
+                        --n_unmarked;
+                    }
+                }
+            }
+            begin = end;
+        }
+    }
+
+    void CSpaceExpansionEngine::expandImageIncremental(cv::Mat& IO, const cv::Mat& IR, const int* depth_histogram)
+    {
+        CV_Assert(IO.depth() == CV_32FC1 && (IR.depth() == CV_32FC1 || IR.depth() == CV_16UC1));
+        CV_Assert(IO.rows == image_height_ && IO.cols == image_width_ && IR.rows == image_height_ && IR.cols == image_width_);
+
+        int n_tiles_u = (image_width_ + tile_size_ - 1) / tile_size_;
+        int n_tiles_v = (image_height_ + tile_size_ - 1) / tile_size_;
+        bool has_last = !last_IR_.empty() && last_IR_.type() == IR.type();
+        size_t elem_size = IR.elemSize();
+
+        incremental_stats_.tiles = n_tiles_u * n_tiles_v;
+        incremental_stats_.changed_tiles = 0;
+        incremental_stats_.recomputed_tiles = 0;
+        tile_state_.assign(n_tiles_u * n_tiles_v, has_last ? TILE_CLEAN : TILE_CHANGED);
+
+        for (int tile_v = 0; tile_v < n_tiles_v && has_last; ++tile_v)
+        {
+            int v_begin = tile_v * tile_size_;
+            int v_end = std::min(v_begin + tile_size_, image_height_);
+            for (int tile_u = 0; tile_u < n_tiles_u; ++tile_u)
+            {
+                int u_begin = tile_u * tile_size_;
+                int u_end = std::min(u_begin + tile_size_, image_width_);
+
+                bool is_changed = false;
+                for (int v = v_begin; v < v_end && !is_changed; ++v)
+                    is_changed = memcmp(IR.ptr(v) + u_begin * elem_size, last_IR_.ptr(v) + u_begin * elem_size,
+                                        (u_end - u_begin) * elem_size) != 0;
+
+                if (is_changed)
+                    markReachedTiles(IR, u_begin, u_end, v_begin, v_end);
+            }
+        }
+
+        // Clean tiles are copied from the last result and linked as marked, so that the
+        // depth-ordered pass below only visits the pixels of the recomputed tiles. Those hold
+        // the depth of the current frame already.
+        int n_unmarked = 0;
+        for (int v = 0; v < image_height_; ++v)
+        {
+            const unsigned char* state = &tile_state_[(v / tile_size_) * n_tiles_u];
+            int* next = &row_next_[v * (image_width_ + 1)];
+            float* pO = IO.ptr<float>(v);
+            next[image_width_] = image_width_;
+
+            for (int tile_u = 0; tile_u < n_tiles_u; ++tile_u)
+            {
+                int u_begin = tile_u * tile_size_;
+                int u_end = std::min(u_begin + tile_size_, image_width_);
+                if (state[tile_u] != TILE_CLEAN)
+                {
+                    for (int c = u_begin; c < u_end; ++c)
+                        next[c] = c;
+                    n_unmarked += u_end - u_begin;
+                } else
+                {
+                    for (int c = u_begin; c < u_end; ++c)
+                        next[c] = c + 1;
+                    memcpy(pO + u_begin, last_IO_.ptr<float>(v) + u_begin, (u_end - u_begin) * sizeof(float));
+                }
+            }
+        }
+
+        for (size_t i = 0; i < tile_state_.size(); ++i)
+        {
+            incremental_stats_.changed_tiles += tile_state_[i] == TILE_CHANGED;
+            incremental_stats_.recomputed_tiles += tile_state_[i] != TILE_CLEAN;
+        }
+
+        if (n_unmarked > 0)
+        {
+            setRowPointers(IO);
+            bucketByDepth(IR, 0, image_height_, depth_histogram);
+
+            int begin = 0;
+            for (int z_cm = 0; z_cm < max_depth_ && n_unmarked > 0; ++z_cm)
+            {
+                int end = depth_count_[z_cm];
+                float z_new = reduced_depth_[z_cm];
+
+                for (int k = begin; k < end && n_unmarked > 0; ++k)
+                {
+                    int v = depth_order_[k] / image_width_;
+                    int u = depth_order_[k] - v * image_width_;
+
+                    int x, w, y, h;
+                    lookupCompact(u, v, z_cm, x, w, y, h);
+                    int x_end = x + w;
+
+                    for (int r = y; r < y + h; ++r)
+                    {
+                        int* next = &row_next_[r * (image_width_ + 1)];
+                        float* pO = row_ptr_[r];
+
+                        for (int c = findNext(next, x); c < x_end; c = findNext(next, c + 1))
+                        {
+                            next[c] = c + 1;
+                            pO[c] = std::min(pO[c], z_new);
+                            --n_unmarked;
+                        }
+                    }
+                }
+                begin = end;
+            }
+        }
+
+        // Keep this frame for the next call. Only recomputed tiles have a new result, and only
+        // changed tiles a new IR.
+        if (!has_last)
+        {
+            IO.copyTo(last_IO_);
+            IR.copyTo(last_IR_);
+            return;
+        }
+
+        for (int v = 0; v < image_height_; ++v)
+        {
+            const unsigned char* state = &tile_state_[(v / tile_size_) * n_tiles_u];
+            for (int tile_u = 0; tile_u < n_tiles_u; ++tile_u)
+            {
+                int u_begin = tile_u * tile_size_;
+                int u_end = std::min(u_begin + tile_size_, image_width_);
+                if (state[tile_u] != TILE_CLEAN)
+                    memcpy(last_IO_.ptr<float>(v) + u_begin, IO.ptr<float>(v) + u_begin, (u_end - u_begin) * sizeof(float));
+                if (state[tile_u] == TILE_CHANGED)
+                    memcpy(last_IR_.ptr(v) + u_begin * elem_size, IR.ptr(v) + u_begin * elem_size, (u_end - u_begin) * elem_size);
+            }
+        }
+    }
+
+    void CSpaceExpansionEngine::markReachedTiles(const cv::Mat& IR, int u_begin, int u_end, int v_begin, int v_end)
+    {
+        // Bounding box of the stamps of the tile in the last and in the current frame: the
+        // pixels whose value the change can lower or raise
+        int x_min = u_begin, x_max = u_end, y_min = v_begin, y_max = v_end;
+        for (int v = v_begin; v < v_end; ++v)
+        {
+            for (int u = u_begin; u < u_end; ++u)
+            {
+                for (int frame = 0; frame < 2; ++frame)
+                {
+                    int z_cm = sourceDepth(frame == 0 ? last_IR_ : IR, u, v);
+                    if (z_cm < 0)
+                        continue;
+
+                    int x, w, y, h;
+                    lookupCompact(u, v, z_cm, x, w, y, h);
+                    if (w <= 0 || h <= 0)
+                        continue;
+
+                    x_min = std::min(x_min, x);
+                    x_max = std::max(x_max, x + w);
+                    y_min = std::min(y_min, y);
+                    y_max = std::max(y_max, y + h);
+                }
+            }
+        }
+
+        int n_tiles_u = (image_width_ + tile_size_ - 1) / tile_size_;
+        for (int tile_v = y_min / tile_size_; tile_v <= (y_max - 1) / tile_size_; ++tile_v)
+        {
+            for (int tile_u = x_min / tile_size_; tile_u <= (x_max - 1) / tile_size_; ++tile_u)
+            {
+                unsigned char& state = tile_state_[tile_v * n_tiles_u + tile_u];
+                state = std::max(state, (unsigned char)TILE_REACHED);
+            }
+        }
+        tile_state_[(v_begin / tile_size_) * n_tiles_u + u_begin / tile_size_] = TILE_CHANGED;
+    }
+
+    void CSpaceExpansionEngine::setPyramid(int factor, double max_error)
+    {
+        CV_Assert(factor >= 1 && max_error > 0);
+        pyramid_factor_ = factor;
+        pyramid_max_error_ = max_error;
+        if (max_depth_ > 0)
+            updatePyramid();
+    }
+
+    int CSpaceExpansionEngine::pyramidSplitDepth() const
+    {
+        return pyramid_split_depth_;
+    }
+
+    void CSpaceExpansionEngine::updatePyramid()
+    {
+        // A block stamp exceeds the stamps of its pixels by at most factor - 1 px on either
+        // side. Stamps get smaller with depth and are smallest at the principal point, so the
+        // split is just beyond the farthest depth at which that growth stays within max_error
+        // of a central stamp. (The tables degenerate below the drone radius, hence from far.)
+        int growth = 2 * (pyramid_factor_ - 1);
+        pyramid_split_depth_ = 0;
+        for (int z_cm = max_depth_ - 1; z_cm >= 0; --z_cm)
+        {
+            int x, w, y, h;
+            lookupCompact(int(config_.center_u), int(config_.center_v), z_cm, x, w, y, h);
+            if (growth <= pyramid_max_error_ * std::min(w, h))
+            {
+                pyramid_split_depth_ = z_cm + 1;
+                break;
+            }
+        }
+
+        coarse_width_ = (image_width_ + pyramid_factor_ - 1) / pyramid_factor_;
+        coarse_height_ = (image_height_ + pyramid_factor_ - 1) / pyramid_factor_;
+        int n_blocks = coarse_width_ * coarse_height_;
+        coarse_depth_.resize(n_blocks);
+        coarse_span_.resize(4 * n_blocks);
+        coarse_count_.resize(max_depth_ + 1);
+        coarse_order_.resize(n_blocks);
+        coarse_next_.resize((coarse_width_ + 1) * coarse_height_);
+        coarse_value_.resize(n_blocks);
+    }
+
+    bool CSpaceExpansionEngine::isNestedAndOrdered(int z_cm) const
+    {
+        for (int i = 0; i < std::max(image_width_, image_height_); ++i)
+        {
+            int x, w, y, h;
+            int x_far, w_far, y_far, h_far;
+            int x_next, w_next, y_next, h_next;
+            int u = std::min(i, image_width_ - 1);
+            int v = std::min(i, image_height_ - 1);
+            lookupCompact(u, v, z_cm, x, w, y, h);
+            lookupCompact(u, v, z_cm + 1, x_far, w_far, y_far, h_far);
+            lookupCompact(std::min(u + 1, image_width_ - 1), std::min(v + 1, image_height_ - 1), z_cm,
+                          x_next, w_next, y_next, h_next);
+
+            if (w <= 0 || h <= 0 || w_next <= 0 || h_next <= 0)
+                return false;
+            if ((w_far > 0 && (x_far < x || x_far + w_far > x + w)) ||
+                (h_far > 0 && (y_far < y || y_far + h_far > y + h)))
+                return false;
+            if (x_next < x || x_next + w_next < x + w || y_next < y || y_next + h_next < y + h)
+                return false;
+        }
+        return true;
+    }
+
+    void CSpaceExpansionEngine::expandImagePyramid(cv::Mat& IO, const cv::Mat& IR, const int* depth_histogram)
+    {
+        CV_Assert(IO.depth() == CV_32FC1 && (IR.depth() == CV_32FC1 || IR.depth() == CV_16UC1));
+        CV_Assert(IO.rows == image_height_ && IO.cols == image_width_);
+
+        setRowPointers(IO);
+        bucketByDepth(IR, 0, image_height_, depth_histogram);
+
+        // Coarse level: per block the nearest near depth and the bounding box of the stamps
+        // of its near pixels
+        int f = pyramid_factor_;
+        int split = pyramid_split_depth_;
+        std::fill(coarse_count_.begin(), coarse_count_.end(), 0);
+        for (int bv = 0; bv < coarse_height_; ++bv)
+        {
+            int v_end = std::min((bv + 1) * f, image_height_);
+            for (int bu = 0; bu < coarse_width_; ++bu)
+            {
+                int u_end = std::min((bu + 1) * f, image_width_);
+                int block = bv * coarse_width_ + bu;
+                // Negative source depths are skipped, as in the depth order
+                int z_min = max_depth_;
+                for (int v = bv * f; v < v_end; ++v)
+                {
+                    const int* pZ = &pixel_depth_[v * image_width_];
+                    for (int u = bu * f; u < u_end; ++u)
+                    {
+                        if (pZ[u] >= 0)
+                            z_min = std::min(z_min, pZ[u]);
+                    }
+                }
+                if (z_min >= split)
+                    z_min = max_depth_;
+
+                int x_min = image_width_, x_max = 0, y_min = image_height_, y_max = 0;
+                if (z_min < max_depth_ && z_min >= nested_depth_)
+                {
+                    // Nested and ordered spans: the stamps of the corner pixels at the nearest
+                    // depth contain those of all pixels of the block
+                    int corners[2][2] = {{bu * f, bv * f}, {u_end - 1, v_end - 1}};
+                    for (int i = 0; i < 2; ++i)
+                    {
+                        int x, w, y, h;
+                        lookupCompact(corners[i][0], corners[i][1], z_min, x, w, y, h);
+                        if (w <= 0 || h <= 0)
+                            continue;
+
+                        x_min = std::min(x_min, x);
+                        x_max = std::max(x_max, x + w);
+                        y_min = std::min(y_min, y);
+                        y_max = std::max(y_max, y + h);
+                    }
+                } else if (z_min < max_depth_)
+                {
+                    for (int v = bv * f; v < v_end; ++v)
+                    {
+                        const int* pZ = &pixel_depth_[v * image_width_];
+                        for (int u = bu * f; u < u_end; ++u)
+                        {
+                            if (pZ[u] < 0 || pZ[u] >= split)
+                                continue;
+
+                            int x, w, y, h;
+                            lookupCompact(u, v, pZ[u], x, w, y, h);
+                            if (w <= 0 || h <= 0)
+                                continue;
+
+                            x_min = std::min(x_min, x);
+                            x_max = std::max(x_max, x + w);
+                            y_min = std::min(y_min, y);
+                            y_max = std::max(y_max, y + h);
+                        }
+                    }
+                }
+
+                int* span = &coarse_span_[4 * block];
+                span[0] = x_min / f;
+                span[1] = (x_max + f - 1) / f;
+                span[2] = y_min / f;
+                span[3] = (y_max + f - 1) / f;
+                coarse_depth_[block] = z_min;
+                ++coarse_count_[z_min];
+            }
+        }
+
+        int n_blocks = 0;
+        for (int z_cm = 0; z_cm <= max_depth_; ++z_cm)
+        {
+            int count = coarse_count_[z_cm];
+            coarse_count_[z_cm] = n_blocks;
+            n_blocks += count;
+        }
+        for (int block = 0; block < coarse_width_ * coarse_height_; ++block)
+            coarse_order_[coarse_count_[coarse_depth_[block]]++] = block;
+
+        // Depth-ordered marking as in expandImagePruned, on the coarse grid
+        for (int i = 0; i < (coarse_width_ + 1) * coarse_height_; ++i)
+            coarse_next_[i] = i % (coarse_width_ + 1);
+        std::fill(coarse_value_.begin(), coarse_value_.end(), std::numeric_limits<float>::quiet_NaN());
+
+        int n_unmarked = coarse_width_ * coarse_height_;
+        int n_near_blocks = split > 0 ? coarse_count_[split - 1] : 0;
+        for (int k = 0; k < n_near_blocks && n_unmarked > 0; ++k)
+        {
+            int block = coarse_order_[k];
+            const int* span = &coarse_span_[4 * block];
+            float z_new = reduced_depth_[coarse_depth_[block]];
+
+            for (int r = span[2]; r < span[3]; ++r)
+            {
+                int* next = &coarse_next_[r * (coarse_width_ + 1)];
+                float* pC = &coarse_value_[r * coarse_width_];
+
+                for (int c = findNext(next, span[0]); c < span[1]; c = findNext(next, c + 1))
+                {
+                    next[c] = c + 1;
+                    pC[c] = z_new;
+                    --n_unmarked;
+                }
+            }
+        }
+
+        // Merge the coarse level into the image. Pixels it reaches hold a stamp nearer than the
+        // split depth and are marked, so that the far stamps at full resolution skip them.
+        n_unmarked = 0;
+        for (int v = 0; v < image_height_; ++v)
+        {
+            const float* pC = &coarse_value_[(v / f) * coarse_width_];
+            int* next = &row_next_[v * (image_width_ + 1)];
+            float* pO = row_ptr_[v];
+            next[image_width_] = image_width_;
+
+            for (int u = 0; u < image_width_; ++u)
+            {
+                float z_coarse = pC[u / f];
+                if (z_coarse == z_coarse)
+                {
+                    pO[u] = std::min(pO[u], z_coarse);
+                    next[u] = u + 1;
+                } else
+                {
+                    next[u] = u;
+                    ++n_unmarked;
+                }
+            }
+        }
+
+        int begin = split > 0 ? depth_count_[split - 1] : 0;
+        for (int z_cm = split; z_cm < max_depth_ && n_unmarked > 0; ++z_cm)
+        {
+            int end = depth_count_[z_cm];
+            float z_new = reduced_depth_[z_cm];
+
+            for (int k = begin; k < end && n_unmarked > 0; ++k)
+            {
+                int v = depth_order_[k] / image_width_;
+                int u = depth_order_[k] - v * image_width_;
+
+                // A near neighbour's block stamp contains its own stamp
+                if (isDominatedByNeighbour(u, v, z_cm))
+                    continue;
+
+                int x, w, y, h;
+                lookupCompact(u, v, z_cm, x, w, y, h);
+                int x_end = x + w;
+
+                for (int r = y; r < y + h; ++r)
+                {
+                    int* next = &row_next_[r * (image_width_ + 1)];
+                    float* pO = row_ptr_[r];
+
+                    for (int c = findNext(next, x); c < x_end; c = findNext(next, c + 1))
+                    {
+                        next[c] = c + 1;
+                        pO[c] = std::min(pO[c], z_new);
+                        --n_unmarked;
+                    }
+                }
+            }
+            begin = end;
+        }
+    }
+
+    void CSpaceExpansionEngine::expandImageRangeMin(cv::Mat& IO, const cv::Mat& IR, bool smooth)
+    {
+        CV_Assert((IO.depth() == CV_32FC1 || IO.depth() == CV_16UC1) && (IR.depth() == CV_32FC1 || IR.depth() == CV_16UC1));
+        CV_Assert(IO.rows == image_height_ && IO.cols == image_width_ && IR.rows == image_height_ && IR.cols == image_width_);
+
+        prepareRangeMin();
+
+        setRowPointers(IO);
+        if (smooth)
+            smoother_.begin(IO);
+
+        if (IO.depth() == CV_16U)
+            expandDepthOrdered(PASS_RANGE_MIN, &row_ptr_mm_[0], &reduced_depth_mm_[0], IR, NULL, smooth);
+        else
+            expandDepthOrdered(PASS_RANGE_MIN, &row_ptr_[0], &reduced_depth_[0], IR, NULL, smooth);
+
+        if (smooth)
+            smoother_.finish();
+    }
+
+
+    template <typename Shape, typename T>
+    void CSpaceExpansionEngine::expandRangeMin(const Shape& shape, T* const* rows, const T* reduced_depth,
+                                               const cv::Mat& IR, bool smooth)
+    {
+        const int width = shape.width();
+        const int height = shape.height();
+        const int max_depth = shape.maxDepth();
+
+        int z_first = buildRangeMinTable(shape, IR);
+
+        for (int i = 0; i < width * height; ++i)
+        {
+            if (pixel_depth_[i] >= 0 && pixel_depth_[i] < nested_depth_)
+                stampRect(rows, i % width, i / width, pixel_depth_[i]);
+        }
+
+        // The nearest source of the box whose stamps at depth z cover a pixel covers it as
+        // well if it is not farther than z. Otherwise no source nearer than it covers the
+        // pixel, so the search continues at its depth; the boxes shrink with the depth.
+
+        for (int r = 0; r < height; ++r)
+        {
+            T* pO = rows[r];
+            for (int c = 0; c < width; ++c)
+            {
+                int z_cm = z_first;
+                while (z_cm < max_depth)
+                {
+                    const unsigned short* cover_col = &cover_u_[2 * (z_cm * width + c)];
+                    const unsigned short* cover_row = &cover_v_[2 * (z_cm * height + r)];
+                    if (cover_col[0] >= cover_col[1] || cover_row[0] >= cover_row[1])
+                        break;
+
+                    int z_min = rangeMin(shape, cover_col[0], cover_col[1], cover_row[0], cover_row[1]);
+                    if (z_min <= z_cm)
+                    {
+                        pO[c] = std::min(pO[c], reduced_depth[z_min]);
+                        break;
+                    }
+                    z_cm = z_min;
+                }
+            }
+
+            if (smooth)
+                smoother_.addRow(r);
+        }
+    }
+
+    size_t CSpaceExpansionEngine::prepareRangeMin()
+    {
+        if (cover_u_.empty())
+            buildCoverTables();
+        return (cover_u_.size() + cover_v_.size() + range_min_.size()) * sizeof(unsigned short);
+    }
+
+    void CSpaceExpansionEngine::buildCoverTables()
+    {
+        // The spans are ordered from nested_depth_ on, so the stamps reaching column c are
+        // those from the first column whose span ends beyond c up to the first column whose
+        // span starts beyond c. Same for the rows.
+        cover_u_.assign(2 * max_depth_ * image_width_, 0);
+        cover_v_.assign(2 * max_depth_ * image_height_, 0);
+        for (int axis = 0; axis < 2; ++axis)
+        {
+            int size = axis == 0 ? image_width_ : image_height_;
+            for (int z_cm = nested_depth_; z_cm < max_depth_; ++z_cm)
+            {
+                unsigned short* cover = axis == 0 ? &cover_u_[2 * z_cm * size] : &cover_v_[2 * z_cm * size];
+                int begin = 0;
+                int end = 0;
+                for (int c = 0; c < size; ++c)
+                {
+                    int low, extent;
+                    for (; begin < size; ++begin)
+                    {
+                        if (axis == 0)
+                            uSpan(begin, z_cm, low, extent);
+                        else
+                            vSpan(begin, z_cm, low, extent);
+                        if (low + extent > c)
+                            break;
+                    }
+                    for (; end < size; ++end)
+                    {
+                        if (axis == 0)
+                            uSpan(end, z_cm, low, extent);
+                        else
+                            vSpan(end, z_cm, low, extent);
+                        if (low > c)
+                            break;
+                    }
+                    cover[2 * c] = (unsigned short)begin;
+                    cover[2 * c + 1] = (unsigned short)std::max(begin, end);
+                }
+            }
+        }
+
+        floor_log2_.resize(std::max(image_width_, image_height_) + 1);
+        floor_log2_[0] = 0;
+        for (size_t n = 1; n < floor_log2_.size(); ++n)
+            floor_log2_[n] = (unsigned char)(n == 1 ? 0 : floor_log2_[n / 2] + 1);
+
+        // A query uses the squares of the largest level not above the shorter side of its box,
+        // so the sparse table only needs the levels up to the shorter of the widest covers.
+        // Near depths cover most of the image, so this mostly matters where nested_depth_ is far.
+        int max_cover_u = 1;
+        int max_cover_v = 1;
+        for (int z_cm = nested_depth_; z_cm < max_depth_; ++z_cm)
+        {
+            for (int u = 0; u < image_width_; ++u)
+                max_cover_u = std::max(max_cover_u, cover_u_[2 * (z_cm * image_width_ + u) + 1] -
+                                                    cover_u_[2 * (z_cm * image_width_ + u)]);
+            for (int v = 0; v < image_height_; ++v)
+                max_cover_v = std::max(max_cover_v, cover_v_[2 * (z_cm * image_height_ + v) + 1] -
+                                                    cover_v_[2 * (z_cm * image_height_ + v)]);
+        }
+
+        range_min_levels_ = floor_log2_[std::min(max_cover_u, max_cover_v)] + 1;
+        range_min_.resize(size_t(range_min_levels_) * image_width_ * image_height_);
+    }
+
+
+    template <typename Shape>
+    int CSpaceExpansionEngine::buildRangeMinTable(const Shape& shape, const cv::Mat& IR)
+    {
+        const int width = shape.width();
+        const int height = shape.height();
+
+        // Plane (0, 0): the clamped source depths. Sources nearer than nested_depth_ are
+        // stamped directly and enter as the maximum unsigned short, as do negative ones.
+        int n_pixels = width * height;
+        int z_first = std::numeric_limits<unsigned short>::max();
+        unsigned short* base = &range_min_[0];
+        for (int v = 0; v < height; ++v)
+        {
+            int* pZ = &pixel_depth_[v * width];
+            unsigned short* pM = base + v * width;
+            if (IR.depth() == CV_16U)
+            {
+                const unsigned short* pR = IR.ptr<unsigned short>(v);
+                for (int u = 0; u < width; ++u)
+                    pZ[u] = clampDepth(pR[u]);
+            } else
+            {
+                const float* pR = IR.ptr<float>(v);
+                for (int u = 0; u < width; ++u)
+                    pZ[u] = clampDepth(pR[u]);
+            }
+
+            for (int u = 0; u < width; ++u)
+            {
+                pM[u] = pZ[u] >= nested_depth_ ? (unsigned short)pZ[u] : std::numeric_limits<unsigned short>::max();
+                z_first = std::min(z_first, int(pM[u]));
+            }
+        }
+
+        // Plane k: minimum over the 2^k x 2^k sources from (u, v) on, from the minimum over
+        // two columns of plane k - 1, then over two of its rows in place
+        for (int k = 1; k < range_min_levels_; ++k)
+        {
+            int half = 1 << (k - 1);
+            const unsigned short* prev = base + size_t(k - 1) * n_pixels;
+            unsigned short* cur = base + size_t(k) * n_pixels;
+            for (int v = 0; v < height - half + 1; ++v)
+            {
+                int row = v * width;
+                minOfRows(prev + row, prev + row + half, cur + row, width - 2 * half + 1);
+            }
+            for (int v = 0; v < height - 2 * half + 1; ++v)
+            {
+                int row = v * width;
+                minOfRows(cur + row, cur + row + half * width, cur + row, width - 2 * half + 1);
+            }
+        }
+        return z_first;
+    }
+
+    template <typename Shape>
+    int CSpaceExpansionEngine::rangeMin(const Shape& shape, int u_begin, int u_end, int v_begin, int v_end) const
+    {
+        // Overlapping squares of the largest level that fits the shorter side tile the query
+        // box: four if it is about square, a few more along the longer side otherwise
+        int k = floor_log2_[std::min(u_end - u_begin, v_end - v_begin)];
+        int size = 1 << k;
+        const int width = shape.width();
+        const unsigned short* plane = &range_min_[size_t(k) * width * shape.height()];
+        int u_last = u_end - size;
+        int v_last = v_end - size;
+
+        int z_min = std::numeric_limits<unsigned short>::max();
+        for (int v = v_begin;; v = std::min(v + size, v_last))
+        {
+            const unsigned short* row = plane + v * width;
+            for (int u = u_begin;; u = std::min(u + size, u_last))
+            {
+                z_min = std::min(z_min, int(row[u]));
+                if (u == u_last)
+                    break;
+            }
+            if (v == v_last)
+                break;
+        }
+        return z_min;
+    }
+
+    void CSpaceExpansionEngine::setIncrementalTileSize(int tile_size)
+    {
+        CV_Assert(tile_size > 0);
+        tile_size_ = tile_size;
+        resetIncremental();
+    }
+
+    void CSpaceExpansionEngine::resetIncremental()
+    {
+        last_IR_.release();
+    }
+
+    const CSpaceExpansionEngine::IncrementalStats& CSpaceExpansionEngine::incrementalStats() const
+    {
+        return incremental_stats_;
+    }
+
+    int CSpaceExpansionEngine::prunedStamps() const
+    {
+        return pruned_stamps_;
+    }
+
+
+    template <typename Shape>
+    bool CSpaceExpansionEngine::isDominatedByNeighbour(const Shape& shape, int u, int v, int z_cm) const
+    {
+        // The left and the upper neighbour come first in the depth order if they are not
+        // farther away. Their stamp has been applied completely, so a rectangle inside
+        // theirs has nothing left to write.
+        const int neighbours[2][2] = {{u - 1, v}, {u, v - 1}};
+
+        for (int i = 0; i < 2; ++i)
+        {
+            int u_n = neighbours[i][0];
+            int v_n = neighbours[i][1];
+            if (u_n < 0 || v_n < 0)
+                continue;
+
+            int z_n = pixel_depth_[v_n * shape.width() + u_n];
+            if (z_n < 0 || z_n > z_cm)
+                continue;
+
+            int x, w, y, h;
+            int x_n, w_n, y_n, h_n;
+            lookupCompact(u, v, z_cm, x, w, y, h);
+            lookupCompact(u_n, v_n, z_n, x_n, w_n, y_n, h_n);
+
+            if (x_n <= x && x_n + w_n >= x + w && y_n <= y && y_n + h_n >= y + h)
+                return true;
+        }
+        return false;
+    }
+
+    bool CSpaceExpansionEngine::isDominatedByNeighbour(int u, int v, int z_cm) const
+    {
+        return isDominatedByNeighbour(DynamicShape(image_width_, image_height_, max_depth_), u, v, z_cm);
+    }
+
+    template <typename Shape>
+    void CSpaceExpansionEngine::bucketByDepth(const Shape& shape, const cv::Mat& IR, int v_min, int v_max,
+                                              const int* depth_histogram)
+    {
+        const int width = shape.width();
+        const int height = shape.height();
+        const int max_depth = shape.maxDepth();
+
+        // Counting sort of the source pixels of the rows [v_min, v_max) by depth. Afterwards bucket
+        // z_cm holds depth_order_[depth_count_[z_cm-1] .. depth_count_[z_cm]), row-major inside a bucket.
+        if (depth_histogram != NULL && IR.depth() == CV_16U && v_min <= 0 && v_max >= height)
+        {
+            // The pre-pass has counted the valid depths already, a single scatter pass is left
+            int n_sources = 0;
+            for (int z_cm = 0; z_cm < max_depth; ++z_cm)
+            {
+                depth_count_[z_cm] = n_sources;
+                n_sources += depth_histogram[z_cm];
+            }
+
+            for (int v = 0; v < height; ++v)
+            {
+                const unsigned short* pR = IR.ptr<unsigned short>(v);
+                int* pZ = &pixel_depth_[v * width];
+                for (int u = 0; u < width; ++u)
+                {
+                    pZ[u] = pR[u] == invalid_depth_u16 ? -1 : std::min(int(pR[u]), max_depth - 1);
+                    if (pZ[u] >= 0)
+                        depth_order_[depth_count_[pZ[u]]++] = v * width + u;
+                }
+            }
+            return;
+        }
+
+        std::fill(depth_count_.begin(), depth_count_.end(), 0);
+        for (int v = 0; v < height; ++v)
+        {
+            int* pZ = &pixel_depth_[v * width];
+            if (v < v_min || v >= v_max)
+            {
+                std::fill(pZ, pZ + width, -1);
+                continue;
+            }
+
+            if (IR.depth() == CV_16U)
+            {
+                const unsigned short* pR = IR.ptr<unsigned short>(v);
+                for (int u = 0; u < width; ++u)
+                    pZ[u] = pR[u] == invalid_depth_u16 ? -1 : std::min(int(pR[u]), max_depth - 1);
+            } else
+            {
+                const float* pR = IR.ptr<float>(v);
+                for (int u = 0; u < width; ++u)
+                    pZ[u] = std::min(int(pR[u]), max_depth - 1);
+            }
+
+            for (int u = 0; u < width; ++u)
+            {
+                if (pZ[u] >= 0)
+                    ++depth_count_[pZ[u]];
+            }
+        }
+
+        int n_sources = 0;
+        for (int z_cm = 0; z_cm < max_depth; ++z_cm)
+        {
+            int count = depth_count_[z_cm];
+            depth_count_[z_cm] = n_sources;
+            n_sources += count;
+        }
+
+        for (int i = 0; i < width * height; ++i)
+        {
+            if (pixel_depth_[i] >= 0)
+                depth_order_[depth_count_[pixel_depth_[i]]++] = i;
+        }
+    }
+
+    void CSpaceExpansionEngine::bucketByDepth(const cv::Mat& IR, int v_min, int v_max, const int* depth_histogram)
+    {
+        bucketByDepth(DynamicShape(image_width_, image_height_, max_depth_), IR, v_min, v_max, depth_histogram);
+    }
+
+    template <typename Shape>
+    void CSpaceExpansionEngine::resetRowLinks(const Shape& shape)
+    {
+        for (int i = 0; i < (shape.width() + 1) * shape.height(); ++i)
+            row_next_[i] = i % (shape.width() + 1);
+    }
+
+    void CSpaceExpansionEngine::resetRowLinks()
+    {
+        resetRowLinks(DynamicShape(image_width_, image_height_, max_depth_));
+    }
+
+    int CSpaceExpansionEngine::clampDepth(float z_rounded) const
+    {
+        // Values beyond the table range are treated as the farthest tabulated depth
+        return std::min(int(z_rounded), max_depth_ - 1);
+    }
+
+    int CSpaceExpansionEngine::clampDepth(int z_rounded) const
+    {
+        return std::min(z_rounded, max_depth_ - 1);
+    }
+
+    int CSpaceExpansionEngine::clampDepth(unsigned short z_rounded) const
+    {
+        return z_rounded == invalid_depth_u16 ? -1 : std::min(int(z_rounded), max_depth_ - 1);
+    }
+
+    int CSpaceExpansionEngine::sourceDepth(const cv::Mat& IR, int u, int v) const
+    {
+        if (IR.depth() == CV_16U)
+            return clampDepth(IR.at<unsigned short>(v, u));
+        return clampDepth(IR.at<float>(v, u));
+    }
+
+    void CSpaceExpansionEngine::setRowPointers(cv::Mat& IO)
+    {
+        if (IO.depth() == CV_16U)
+        {
+            for (int v = 0; v < image_height_; ++v)
+                row_ptr_mm_[v] = IO.ptr<unsigned short>(v);
+        } else
+        {
+            for (int v = 0; v < image_height_; ++v)
+                row_ptr_[v] = IO.ptr<float>(v);
+        }
+    }
+
+    void CSpaceExpansionEngine::stampRect(float* const* rows, int u, int v, int z_cm) const
+    {
+        int x, w, y, h;
+        lookupCompact(u, v, z_cm, x, w, y, h);
+        float z_new = reduced_depth_[z_cm];
+
+        for (int r = y; r < y + h; ++r)
+            span_min_(rows[r] + x, w, z_new);
+    }
+
+    void CSpaceExpansionEngine::stampRect(unsigned short* const* rows, int u, int v, int z_cm) const
+    {
+        int x, w, y, h;
+        lookupCompact(u, v, z_cm, x, w, y, h);
+        unsigned short z_new = reduced_depth_mm_[z_cm];
+
+        for (int r = y; r < y + h; ++r)
+            minWithValue(rows[r] + x, w, z_new);
+    }
+
+    int CSpaceExpansionEngine::findNext(int* next, int i)
+    {
+        // Union-find lookup with path halving
+        while (next[i] != i)
+        {
+            next[i] = next[next[i]];
+            i = next[i];
+        }
+        return i;
+    }
+}
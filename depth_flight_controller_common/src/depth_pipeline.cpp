@@ -0,0 +1,81 @@
+#include "depth_pipeline.h"
+
+
+namespace depth_flight_controller
+{
+    DepthPipeline::DepthPipeline(TargetSearch& target_finder, const ros::NodeHandle& nh, const ros::NodeHandle& pnh)
+            : nh_(nh),
+              it_(nh_),
+              c_space_expander_(nh, pnh, false),
+              target_finder_(target_finder)
+    {
+        pnh.param("publish_debug_images", publish_debug_images_, false);
+
+        image_sub_ = it_.subscribe("/hummingbird/vi_sensor/camera_depth/depth/disparity", 1, &DepthPipeline::imageCallback, this);
+        state_estimate_sub_ = nh_.subscribe("/hummingbird/state_estimate", 1, &DepthPipeline::stateEstimateCallback, this);
+
+        if (publish_debug_images_)
+        {
+            clipped_image_pub_ = it_.advertise("/hummingbird/vi_sensor/camera_depth/depth/clipped", 1);
+            expanded_image_pub_ = it_.advertise("/hummingbird/vi_sensor/camera_depth/depth/expanded", 1);
+        }
+    }
+
+
+    DepthPipeline::~DepthPipeline()
+    {
+    }
+
+    void DepthPipeline::stateEstimateCallback(const quad_msgs::QuadStateEstimate::ConstPtr& msg)
+    {
+        state_estimate_ = QuadState(*msg);
+        state_estimate_msg_ = *msg;
+    }
+
+    void DepthPipeline::imageCallback(const sensor_msgs::ImageConstPtr& msg)
+    {
+        // The state estimate the frame arrived with is used by all stages
+        QuadState state_estimate_image = state_estimate_;
+        quad_msgs::QuadStateEstimate state_estimate_image_msg = state_estimate_msg_;
+
+        cv_bridge::CvImageConstPtr cv_ptr_original;
+
+        try
+        {
+            cv_ptr_original = cv_bridge::toCvShare(msg);
+        }
+        catch (cv_bridge::Exception& e)
+        {
+            ROS_ERROR("cv_bridge exception: %s", e.what());
+            return;
+        }
+
+        processFrame(msg->header, cv_ptr_original->image, state_estimate_image, state_estimate_image_msg);
+    }
+
+    bool DepthPipeline::processFrame(const std_msgs::Header& header, const cv::Mat& depth_float_img,
+                                     const QuadState& state_estimate, const quad_msgs::QuadStateEstimate& state_estimate_msg)
+    {
+        // The clipped image only feeds image_prep, the expander fills the NaNs itself
+        if (publish_debug_images_)
+        {
+            const std::string& depth_encoding = c_space_expander_.depthEncoding();
+            depth_img_clipped_ = clipped_msg_.acquire(header, depth_float_img.rows, depth_float_img.cols, depth_encoding);
+            ImageClipper::clipImage(depth_float_img, depth_img_clipped_);
+            clipped_image_pub_.publish(clipped_msg_.message());
+
+            depth_img_expanded_ = expanded_msg_.acquire(header, depth_float_img.rows, depth_float_img.cols, depth_encoding);
+        }
+
+        if (!c_space_expander_.expandDepthImage(depth_float_img, depth_img_expanded_))
+            return false;
+        c_space_expander_.publishExpansionStats(header);
+
+        target_finder_.findTarget(depth_img_expanded_, state_estimate, state_estimate_msg);
+
+        if (publish_debug_images_)
+            expanded_image_pub_.publish(expanded_msg_.message());
+
+        return true;
+    }
+}
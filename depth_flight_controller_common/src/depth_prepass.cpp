@@ -0,0 +1,367 @@
+#include "depth_prepass.h"
+#include "depth_image.h"
+
+#include <string.h>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+namespace depth_flight_controller
+{
+    namespace
+    {
+        // Rounds half away from zero like roundf for the non-negative values that survive the
+        // clamp, without a call per pixel: floor(y + 0.5) clamped to [0, z_max]
+        inline int roundAndClamp(float y, float z_max)
+        {
+            return int(std::min(std::max(y + 0.5f, 0.0f), z_max));
+        }
+
+        // Rounded depth of an invalid (negative) pixel: never a table depth, so every
+        // expansion mode skips it
+        template <typename T>
+        inline int invalidRounded();
+
+        template <>
+        inline int invalidRounded<unsigned short>()
+        {
+            return invalid_depth_u16;
+        }
+
+        template <>
+        inline int invalidRounded<float>()
+        {
+            return -1;
+        }
+
+#if defined(__SSE2__)
+        inline void storeRounded(unsigned short* dst, __m128i z0, __m128i z1)
+        {
+            // No unsigned saturating 32 -> 16 bit pack before SSE4.1: shift into the signed
+            // range, pack, shift back
+            const __m128i bias32 = _mm_set1_epi32(32768);
+            const __m128i bias16 = _mm_set1_epi16(short(-32768));
+            __m128i z = _mm_packs_epi32(_mm_sub_epi32(z0, bias32), _mm_sub_epi32(z1, bias32));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_xor_si128(z, bias16));
+        }
+
+        inline void storeRounded(float* dst, __m128i z0, __m128i z1)
+        {
+            _mm_storeu_ps(dst, _mm_cvtepi32_ps(z0));
+            _mm_storeu_ps(dst + 4, _mm_cvtepi32_ps(z1));
+        }
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+        inline void storeRounded(unsigned short* dst, int32x4_t z0, int32x4_t z1)
+        {
+            vst1q_u16(dst, vcombine_u16(vmovn_u32(vreinterpretq_u32_s32(z0)), vmovn_u32(vreinterpretq_u32_s32(z1))));
+        }
+
+        inline void storeRounded(float* dst, int32x4_t z0, int32x4_t z1)
+        {
+            vst1q_f32(dst, vcvtq_f32_s32(z0));
+            vst1q_f32(dst + 4, vcvtq_f32_s32(z1));
+        }
+#endif
+
+        // pS and pD may be the same row, pD may be NULL if only the rounded depth is wanted
+        template <typename T>
+        void prepareRow(const float* pS, float* pD, T* pR, int n, float nan_depth, float scale, float z_max)
+        {
+            int u = 0;
+
+#if defined(__SSE2__)
+            const __m128 v_fill = _mm_set1_ps(nan_depth);
+            const __m128 v_scale = _mm_set1_ps(scale);
+            const __m128 v_half = _mm_set1_ps(0.5f);
+            const __m128 v_zero = _mm_setzero_ps();
+            const __m128 v_max = _mm_set1_ps(z_max);
+            const __m128i v_invalid = _mm_set1_epi32(invalidRounded<T>());
+
+            for (; u + 8 <= n; u += 8)
+            {
+                __m128i z[2];
+                for (int i = 0; i < 2; ++i)
+                {
+                    __m128 d = _mm_loadu_ps(pS + u + 4 * i);
+                    __m128 is_negative = _mm_cmplt_ps(d, v_zero);
+                    __m128 is_filled = _mm_or_ps(_mm_cmpunord_ps(d, d), is_negative);
+                    d = _mm_or_ps(_mm_and_ps(is_filled, v_fill), _mm_andnot_ps(is_filled, d));
+                    if (pD)
+                        _mm_storeu_ps(pD + u + 4 * i, d);
+
+                    __m128 y = _mm_add_ps(_mm_mul_ps(d, v_scale), v_half);
+                    __m128i z_valid = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(y, v_zero), v_max));
+                    __m128i is_invalid = _mm_castps_si128(is_negative);
+                    z[i] = _mm_or_si128(_mm_and_si128(is_invalid, v_invalid), _mm_andnot_si128(is_invalid, z_valid));
+                }
+                storeRounded(pR + u, z[0], z[1]);
+            }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+            const float32x4_t v_fill = vdupq_n_f32(nan_depth);
+            const float32x4_t v_scale = vdupq_n_f32(scale);
+            const float32x4_t v_half = vdupq_n_f32(0.5f);
+            const float32x4_t v_zero = vdupq_n_f32(0.0f);
+            const float32x4_t v_max = vdupq_n_f32(z_max);
+            const int32x4_t v_invalid = vdupq_n_s32(invalidRounded<T>());
+
+            for (; u + 8 <= n; u += 8)
+            {
+                int32x4_t z[2];
+                for (int i = 0; i < 2; ++i)
+                {
+                    float32x4_t d = vld1q_f32(pS + u + 4 * i);
+                    uint32x4_t is_negative = vcltq_f32(d, v_zero);
+                    d = vbslq_f32(vbicq_u32(vceqq_f32(d, d), is_negative), d, v_fill);
+                    if (pD)
+                        vst1q_f32(pD + u + 4 * i, d);
+
+                    float32x4_t y = vaddq_f32(vmulq_f32(d, v_scale), v_half);
+                    z[i] = vbslq_s32(is_negative, v_invalid, vcvtq_s32_f32(vminq_f32(vmaxq_f32(y, v_zero), v_max)));
+                }
+                storeRounded(pR + u, z[0], z[1]);
+            }
+#endif
+
+            for (; u < n; ++u)
+            {
+                bool is_negative = pS[u] < 0;
+                float d = pS[u] != pS[u] || is_negative ? nan_depth : pS[u];
+                if (pD)
+                    pD[u] = d;
+                pR[u] = T(is_negative ? invalidRounded<T>() : roundAndClamp(d * scale, z_max));
+            }
+        }
+
+        // The same for a depth row in [mm] with 0 marking missing and invalid_depth_u16 invalid
+        // pixels, in integers only: pD[u] = pS[u] or nan_depth, pR[u] = min((pD[u] + divisor / 2)
+        // / divisor, z_max), or invalid_depth_u16 for the invalid pixels
+        void prepareRowMillimetres(const unsigned short* pS, unsigned short* pD, unsigned short* pR, int n,
+                                   unsigned short nan_depth, int divisor, int z_max)
+        {
+            int u = 0;
+
+            // The centimetres of the default precision: x / 10 is (x * 52429) >> 19 for every
+            // uint16 x, i.e. the upper half of a 16 bit product shifted by 3
+#if defined(__SSE2__)
+            if (divisor == 10)
+            {
+                const __m128i v_fill = _mm_set1_epi16(short(nan_depth));
+                const __m128i v_zero = _mm_setzero_si128();
+                const __m128i v_half = _mm_set1_epi16(5);
+                const __m128i v_magic = _mm_set1_epi16(short(52429));
+                const __m128i v_max = _mm_set1_epi16(short(std::min(z_max, 32767)));
+                const __m128i v_invalid = _mm_set1_epi16(short(invalid_depth_u16));
+
+                for (; u + 8 <= n; u += 8)
+                {
+                    __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pS + u));
+                    __m128i is_invalid = _mm_cmpeq_epi16(d, v_invalid);
+                    __m128i is_filled = _mm_or_si128(_mm_cmpeq_epi16(d, v_zero), is_invalid);
+                    d = _mm_or_si128(_mm_and_si128(is_filled, v_fill), _mm_andnot_si128(is_filled, d));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(pD + u), d);
+
+                    // The invalid_depth_u16 lanes of is_invalid are all ones
+                    __m128i z = _mm_srli_epi16(_mm_mulhi_epu16(_mm_adds_epu16(d, v_half), v_magic), 3);
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(pR + u), _mm_or_si128(_mm_min_epi16(z, v_max), is_invalid));
+                }
+            }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+            if (divisor == 10)
+            {
+                const uint16x8_t v_fill = vdupq_n_u16(nan_depth);
+                const uint16x8_t v_half = vdupq_n_u16(5);
+                const uint16x4_t v_magic = vdup_n_u16(52429);
+                const uint16x8_t v_max = vdupq_n_u16((unsigned short)std::min(z_max, 65535));
+
+                for (; u + 8 <= n; u += 8)
+                {
+                    uint16x8_t d = vld1q_u16(pS + u);
+                    uint16x8_t is_invalid = vceqq_u16(d, vdupq_n_u16(invalid_depth_u16));
+                    d = vbslq_u16(vorrq_u16(vceqq_u16(d, vdupq_n_u16(0)), is_invalid), v_fill, d);
+                    vst1q_u16(pD + u, d);
+
+                    uint16x8_t y = vqaddq_u16(d, v_half);
+                    uint16x8_t z = vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(y), v_magic), 16),
+                                                vshrn_n_u32(vmull_u16(vget_high_u16(y), v_magic), 16));
+                    vst1q_u16(pR + u, vorrq_u16(vminq_u16(vshrq_n_u16(z, 3), v_max), is_invalid));
+                }
+            }
+#endif
+
+            for (; u < n; ++u)
+            {
+                bool is_invalid = pS[u] == invalid_depth_u16;
+                pD[u] = pS[u] == 0 || is_invalid ? nan_depth : pS[u];
+                pR[u] = is_invalid ? invalid_depth_u16
+                                   : (unsigned short)std::min((int(pD[u]) + divisor / 2) / divisor, z_max);
+            }
+        }
+
+        void fillNanRow(const float* pS, float* pD, int n, float nan_depth)
+        {
+            int u = 0;
+
+#if defined(__SSE2__)
+            const __m128 v_fill = _mm_set1_ps(nan_depth);
+            for (; u + 4 <= n; u += 4)
+            {
+                __m128 d = _mm_loadu_ps(pS + u);
+                __m128 is_nan = _mm_cmpunord_ps(d, d);
+                _mm_storeu_ps(pD + u, _mm_or_ps(_mm_and_ps(is_nan, v_fill), _mm_andnot_ps(is_nan, d)));
+            }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+            const float32x4_t v_fill = vdupq_n_f32(nan_depth);
+            for (; u + 4 <= n; u += 4)
+            {
+                float32x4_t d = vld1q_f32(pS + u);
+                vst1q_f32(pD + u, vbslq_f32(vceqq_f32(d, d), d, v_fill));
+            }
+#endif
+
+            for (; u < n; ++u)
+                pD[u] = pS[u] != pS[u] ? nan_depth : pS[u];
+        }
+
+        // Counts runs of equal values instead of single pixels: large flat areas (the filled
+        // NaNs, walls) would otherwise serialize on the increment of a single bin. Invalid
+        // pixels are not counted.
+        template <typename T>
+        void countRow(const T* pR, int n, int* histogram)
+        {
+            const int invalid = invalidRounded<T>();
+            int run_value = int(pR[0]);
+            int run_length = 0;
+            for (int u = 0; u < n; ++u)
+            {
+                int z = int(pR[u]);
+                if (z != run_value)
+                {
+                    if (run_value != invalid)
+                        histogram[run_value] += run_length;
+                    run_value = z;
+                    run_length = 0;
+                }
+                ++run_length;
+            }
+            if (run_value != invalid)
+                histogram[run_value] += run_length;
+        }
+    }
+
+    void prepareDepthImage(cv::Mat& depth, float nan_depth, int precision, int max_depth, int depth_type,
+                           cv::Mat& depth_rounded, int* histogram)
+    {
+        prepareDepthImage(depth, depth, nan_depth, precision, max_depth, depth_type, depth_rounded, histogram);
+    }
+
+    void prepareDepthImage(const cv::Mat& source, cv::Mat& depth, float nan_depth, int precision, int max_depth,
+                           int depth_type, cv::Mat& depth_rounded, int* histogram)
+    {
+        CV_Assert(source.type() == CV_32FC1 && depth.type() == CV_32FC1);
+        CV_Assert(source.rows == depth.rows && source.cols == depth.cols);
+        CV_Assert(depth_type == CV_16UC1 || depth_type == CV_32FC1);
+        CV_Assert(max_depth > 0 && (depth_type != CV_16UC1 || max_depth <= invalid_depth_u16));
+
+        depth_rounded.create(depth.rows, depth.cols, depth_type);
+        if (histogram)
+            memset(histogram, 0, sizeof(int) * max_depth);
+
+        int n_rows = depth.rows;
+        int n_cols = depth.cols;
+        if (source.isContinuous() && depth.isContinuous() && depth_rounded.isContinuous())
+        {
+            n_cols *= n_rows;
+            n_rows = 1;
+        }
+
+        const int block_size = 1024;
+        float scale = float(precision);
+        float z_max = float(max_depth - 1);
+        for (int v = 0; v < n_rows; ++v)
+        {
+            // Blocks small enough for the histogram to read them back from L1
+            for (int u = 0; u < n_cols; u += block_size)
+            {
+                int n = std::min(block_size, n_cols - u);
+                const float* pS = source.ptr<float>(v) + u;
+                float* pD = depth.ptr<float>(v) + u;
+
+                if (depth_type == CV_16UC1)
+                {
+                    unsigned short* pR = depth_rounded.ptr<unsigned short>(v) + u;
+                    prepareRow(pS, pD, pR, n, nan_depth, scale, z_max);
+                    if (histogram)
+                        countRow(pR, n, histogram);
+                } else
+                {
+                    float* pR = depth_rounded.ptr<float>(v) + u;
+                    prepareRow(pS, pD, pR, n, nan_depth, scale, z_max);
+                    if (histogram)
+                        countRow(pR, n, histogram);
+                }
+            }
+        }
+    }
+
+    void prepareDepthImageMillimetres(const cv::Mat& source, cv::Mat& depth, unsigned short nan_depth, int precision,
+                                      int max_depth, cv::Mat& depth_rounded, int* histogram)
+    {
+        CV_Assert(source.type() == CV_16UC1 && depth.type() == CV_16UC1);
+        CV_Assert(source.rows == depth.rows && source.cols == depth.cols);
+        CV_Assert(precision > 0 && 1000 % precision == 0 && max_depth > 0 && max_depth <= invalid_depth_u16);
+
+        depth_rounded.create(depth.rows, depth.cols, CV_16UC1);
+        if (histogram)
+            memset(histogram, 0, sizeof(int) * max_depth);
+
+        int n_rows = depth.rows;
+        int n_cols = depth.cols;
+        if (source.isContinuous() && depth.isContinuous() && depth_rounded.isContinuous())
+        {
+            n_cols *= n_rows;
+            n_rows = 1;
+        }
+
+        const int block_size = 1024;
+        for (int v = 0; v < n_rows; ++v)
+        {
+            for (int u = 0; u < n_cols; u += block_size)
+            {
+                int n = std::min(block_size, n_cols - u);
+                unsigned short* pR = depth_rounded.ptr<unsigned short>(v) + u;
+                prepareRowMillimetres(source.ptr<unsigned short>(v) + u, depth.ptr<unsigned short>(v) + u, pR, n,
+                                      nan_depth, 1000 / precision, max_depth - 1);
+                if (histogram)
+                    countRow(pR, n, histogram);
+            }
+        }
+    }
+
+    void fillNanDepthMillimetres(const cv::Mat& source, float nan_depth, cv::Mat& depth_mm)
+    {
+        CV_Assert(source.type() == CV_32FC1 && depth_mm.type() == CV_16UC1);
+        CV_Assert(source.rows == depth_mm.rows && source.cols == depth_mm.cols);
+
+        for (int v = 0; v < source.rows; ++v)
+        {
+            prepareRow(source.ptr<float>(v), (float*)NULL, depth_mm.ptr<unsigned short>(v), source.cols, nan_depth,
+                       1000.0f, float(invalid_depth_u16 - 1));
+        }
+    }
+
+    void fillNanDepth(const cv::Mat& source, float nan_depth, cv::Mat& depth)
+    {
+        CV_Assert(source.type() == CV_32FC1 && depth.type() == CV_32FC1);
+        CV_Assert(source.rows == depth.rows && source.cols == depth.cols);
+
+        for (int v = 0; v < source.rows; ++v)
+            fillNanRow(source.ptr<float>(v), depth.ptr<float>(v), source.cols, nan_depth);
+    }
+}
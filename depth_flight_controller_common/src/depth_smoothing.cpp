@@ -0,0 +1,174 @@
+#include "depth_smoothing.h"
+
+#include <algorithm>
+
+namespace depth_flight_controller
+{
+    namespace
+    {
+        // Binomial kernels of cv::GaussianBlur for ksize 5 and 3 at sigma 0
+        const float kRowCenter = 0.375f;
+        const float kRowNear = 0.25f;
+        const float kRowFar = 0.0625f;
+        const float kColCenter = 0.5f;
+        const float kColNear = 0.25f;
+
+        inline int reflect101(int i, int n)
+        {
+            return i < 0 ? -i : (i >= n ? 2 * n - 2 - i : i);
+        }
+
+        template <typename T>
+        inline float smoothAtBorder(const T* row, int c, int cols)
+        {
+            return kRowFar * (row[reflect101(c - 2, cols)] + row[reflect101(c + 2, cols)]) +
+                   kRowNear * (row[reflect101(c - 1, cols)] + row[reflect101(c + 1, cols)]) +
+                   kRowCenter * row[c];
+        }
+
+        template <typename T>
+        void smoothRow(const T* in, float* out, int c_begin, int c_end, int cols)
+        {
+            int c = c_begin;
+            for (; c < std::min(c_end, 2); ++c)
+                out[c] = smoothAtBorder(in, c, cols);
+            for (; c < std::min(c_end, cols - 2); ++c)
+                out[c] = kRowFar * (in[c - 2] + in[c + 2]) + kRowNear * (in[c - 1] + in[c + 1]) + kRowCenter * in[c];
+            for (; c < c_end; ++c)
+                out[c] = smoothAtBorder(in, c, cols);
+        }
+
+        inline void store(float& pixel, float value)
+        {
+            pixel = value;
+        }
+
+        inline void store(unsigned short& pixel, float value)
+        {
+            // Exact for [mm]: the weights are multiples of 1/64
+            pixel = (unsigned short)(value + 0.5f);
+        }
+
+        template <typename T>
+        void combineRows(const float* above, const float* center, const float* below, T* out, int c_begin, int c_end)
+        {
+            for (int c = c_begin; c < c_end; ++c)
+                store(out[c], kColNear * (above[c] + below[c]) + kColCenter * center[c]);
+        }
+
+        template <typename T>
+        float smoothedPixel(const cv::Mat& image, int u, int v)
+        {
+            const float kernel_v[3] = {kColNear, kColCenter, kColNear};
+
+            float sum = 0;
+            for (int i = 0; i < 3; ++i)
+            {
+                const T* row = image.ptr<T>(reflect101(v - 1 + i, image.rows));
+                sum += kernel_v[i] * smoothAtBorder(row, u, image.cols);
+            }
+            return sum;
+        }
+    }
+
+    DepthSmoother::DepthSmoother()
+            : col_begin_(NULL),
+              col_end_(NULL)
+    {
+    }
+
+    void DepthSmoother::smooth(cv::Mat& image)
+    {
+        begin(image);
+        for (int v = 0; v < image.rows; ++v)
+            addRow(v);
+        finish();
+    }
+
+    void DepthSmoother::smoothRows(cv::Mat& image, const int* col_begin, const int* col_end)
+    {
+        begin(image);
+        col_begin_ = col_begin;
+        col_end_ = col_end;
+        for (int v = 0; v < image.rows; ++v)
+            addRow(v);
+        finish();
+        col_begin_ = NULL;
+        col_end_ = NULL;
+    }
+
+    void DepthSmoother::begin(cv::Mat& image)
+    {
+        CV_Assert((image.type() == CV_32FC1 || image.type() == CV_16UC1) && image.rows >= 2 && image.cols >= 3);
+
+        image_ = image;
+        ring_.resize(3 * image.cols);
+        col_begin_ = NULL;
+        col_end_ = NULL;
+    }
+
+    void DepthSmoother::addRow(int v)
+    {
+        int c_begin = 0;
+        int c_end = image_.cols;
+        if (col_begin_ != NULL)
+        {
+            // Only the columns the smoothed rows v - 1 .. v + 1 read from this row
+            c_begin = image_.cols;
+            c_end = 0;
+            for (int r = std::max(v - 1, 0); r <= std::min(v + 1, image_.rows - 1); ++r)
+            {
+                if (col_begin_[r] < col_end_[r])
+                {
+                    c_begin = std::min(c_begin, col_begin_[r]);
+                    c_end = std::max(c_end, col_end_[r]);
+                }
+            }
+        }
+
+        if (c_begin < c_end)
+            smoothRowHorizontally(v, c_begin, c_end);
+
+        // Row v - 1 has been read for the last time
+        if (v >= 1)
+            writeRow(v - 1, col_begin_ ? col_begin_[v - 1] : 0, col_end_ ? col_end_[v - 1] : image_.cols);
+    }
+
+    void DepthSmoother::finish()
+    {
+        int v = image_.rows - 1;
+        writeRow(v, col_begin_ ? col_begin_[v] : 0, col_end_ ? col_end_[v] : image_.cols);
+    }
+
+    float* DepthSmoother::ringRow(int v)
+    {
+        return &ring_[(v % 3) * image_.cols];
+    }
+
+    void DepthSmoother::smoothRowHorizontally(int v, int c_begin, int c_end)
+    {
+        if (image_.depth() == CV_16U)
+            smoothRow(image_.ptr<unsigned short>(v), ringRow(v), c_begin, c_end, image_.cols);
+        else
+            smoothRow(image_.ptr<float>(v), ringRow(v), c_begin, c_end, image_.cols);
+    }
+
+    void DepthSmoother::writeRow(int v, int c_begin, int c_end)
+    {
+        const float* above = ringRow(v == 0 ? 1 : v - 1);
+        const float* center = ringRow(v);
+        const float* below = ringRow(v == image_.rows - 1 ? v - 1 : v + 1);
+
+        if (image_.depth() == CV_16U)
+            combineRows(above, center, below, image_.ptr<unsigned short>(v), c_begin, c_end);
+        else
+            combineRows(above, center, below, image_.ptr<float>(v), c_begin, c_end);
+    }
+
+    float smoothedDepth(const cv::Mat& image, int u, int v)
+    {
+        if (image.depth() == CV_16U)
+            return smoothedPixel<unsigned short>(image, u, v);
+        return smoothedPixel<float>(image, u, v);
+    }
+}
@@ -0,0 +1,151 @@
+#include "free_space_gap_index.h"
+#include "horizon_analyzer.h"
+#include "allocation_counter.h"
+#include "depth_image.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include <vector>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace depth_flight_controller;
+
+// Keeps the compiler from dropping the gaps
+static volatile double gap_sink = 0;
+
+static double elapsedUs(int64 start, int n_runs)
+{
+    return (cv::getTickCount() - start) * 1e6 / cv::getTickFrequency() / n_runs;
+}
+
+static float signedDistance(const cv::Point& p, const cv::Point& q)
+{
+    cv::Point diff = p - q;
+    return copysignf(sqrtf(float(diff.x * diff.x + diff.y * diff.y)), float(q.x - p.x));
+}
+
+// A cluttered forest: 5 m of background and n_poles poles of 2 to 8 px at 1 to 4 m
+static cv::Mat clutteredScene(int width, int height, int n_poles)
+{
+    cv::Mat scene(height, width, CV_32F, cv::Scalar(5.0f));
+    for (int k = 0; k < n_poles; ++k)
+    {
+        int x = rand() % width;
+        int pole_width = 2 + rand() % 7;
+        float depth = 1.0f + 3.0f * rand() / RAND_MAX;
+        cv::rectangle(scene, cv::Point(x, 0), cv::Point(std::min(x + pole_width, width) - 1, height - 1),
+                      cv::Scalar(depth), CV_FILLED);
+    }
+    return scene;
+}
+
+// Every free space run, collected the way the target finder collected the largest one: a
+// cv::LineIterator walk and a std::vector of points per run
+static int vectorGaps(const cv::Mat& depth, const HorizonLine& line, float free_space_depth,
+                      std::vector<std::vector<cv::Point> >& runs, std::vector<float>& widths)
+{
+    runs.clear();
+    widths.clear();
+    std::vector<cv::Point> run;
+    std::vector<float> run_depths;
+    cv::LineIterator it(depth, line.edge_left, line.edge_right, 8);
+    for (int i = 0; i <= it.count; ++i, ++it)
+    {
+        bool free = i < it.count && depthAt(depth, it.pos()) >= free_space_depth;
+        if (free)
+        {
+            run.push_back(it.pos());
+            run_depths.push_back(depthAt(depth, it.pos()));
+        } else if (!run.empty())
+        {
+            float min_depth = *std::min_element(run_depths.begin(), run_depths.end());
+            widths.push_back(fabsf(signedDistance(run.front(), line.center) -
+                                   signedDistance(run.back(), line.center)) / 151.18f * min_depth);
+            runs.push_back(run);
+            run.clear();
+            run_depths.clear();
+        }
+    }
+    return runs.size();
+}
+
+int main(int argc, char** argv)
+{
+    int n_runs = (argc > 1) ? atoi(argv[1]) : 20000;
+    const int width = 160;
+    const int height = 120;
+    const float free_space_depth = 4.5f;
+
+    srand(1);
+    const int n_scenes = 16;
+    std::vector<cv::Mat> scenes;
+    for (int k = 0; k < n_scenes; ++k)
+        scenes.push_back(clutteredScene(width, height, 24));
+
+    HorizonLine line;
+    line.build(scenes[0], cv::Point(0, 52), cv::Point(width - 1, 68), cv::Point(width / 2, 60));
+    line.valid = true;
+
+    HorizonAnalyzer analyzer;
+    HorizonStats stats;
+    FreeSpaceGapIndex index;
+    std::vector<std::vector<cv::Point> > runs;
+    std::vector<float> widths;
+
+    // Both find the same gaps
+    int n_mismatches = 0;
+    int n_gaps = 0;
+    for (int k = 0; k < n_scenes; ++k)
+    {
+        analyzer.analyze(scenes[k], line, stats);
+        index.build(analyzer.sampleDepths(), line, free_space_depth, 151.18);
+        int n_vector_gaps = vectorGaps(scenes[k], line, free_space_depth, runs, widths);
+        n_gaps += index.size();
+        if (index.dropped() == 0 && n_vector_gaps != index.size())
+            ++n_mismatches;
+        for (int g = 0; g < std::min(n_vector_gaps, index.size()); ++g)
+            if (runs[g].front() != line.position[index[g].begin] || runs[g].back() != line.position[index[g].end] ||
+                fabsf(widths[g] - index[g].width) > 1e-4f)
+                ++n_mismatches;
+    }
+
+    double sum = 0;
+    unsigned long allocations = heapAllocationCount();
+    int64 start = cv::getTickCount();
+    for (int run = 0; run < n_runs; ++run)
+    {
+        sum += vectorGaps(scenes[run % n_scenes], line, free_space_depth, runs, widths);
+    }
+    double vector_us = elapsedUs(start, n_runs);
+    double vector_allocations = double(heapAllocationCount() - allocations) / n_runs;
+
+    // The samples come with the horizon analysis, which the target finder runs anyway
+    allocations = heapAllocationCount();
+    start = cv::getTickCount();
+    for (int run = 0; run < n_runs; ++run)
+    {
+        analyzer.analyze(scenes[run % n_scenes], line, stats);
+        index.build(analyzer.sampleDepths(), line, free_space_depth, 151.18);
+        sum += index.size();
+    }
+    double index_us = elapsedUs(start, n_runs);
+    double index_allocations = double(heapAllocationCount() - allocations) / n_runs;
+
+    allocations = heapAllocationCount();
+    start = cv::getTickCount();
+    for (int run = 0; run < n_runs; ++run)
+    {
+        index.build(analyzer.sampleDepths(), line, free_space_depth, 151.18);
+        sum += index.size();
+    }
+    double build_us = elapsedUs(start, n_runs);
+    double build_allocations = double(heapAllocationCount() - allocations) / n_runs;
+    gap_sink = sum;
+
+    printf("%-28s %12s %14s\n", "free space gaps", "[us]", "[allocations]");
+    printf("%-28s %12.3f %14.2f\n", "vector of point vectors", vector_us, vector_allocations);
+    printf("%-28s %12.3f %14.2f\n", "analyze + gap index", index_us, index_allocations);
+    printf("%-28s %12.3f %14.2f\n", "gap index only", build_us, build_allocations);
+    printf("%.1f gaps per frame, %d mismatches\n", double(n_gaps) / n_scenes, n_mismatches);
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include "free_space_gap_index.h"
+
+#include <algorithm>
+#include <math.h>
+
+namespace depth_flight_controller
+{
+    namespace
+    {
+        // Distance of p from the center along the line, positive left of it
+        float signedDistance(const cv::Point& p, const cv::Point& center)
+        {
+            cv::Point diff = p - center;
+            return copysignf(sqrtf(float(diff.x * diff.x + diff.y * diff.y)), float(center.x - p.x));
+        }
+    }
+
+    FreeSpaceGapIndex::FreeSpaceGapIndex()
+            : n_gaps_(0),
+              n_dropped_(0)
+    {
+    }
+
+    void FreeSpaceGapIndex::build(const float* depth, const HorizonLine& line, float free_space_depth,
+                                  double focal_length)
+    {
+        clear();
+
+        const int n_samples = line.position.size();
+        const float inv_focal_length = float(1 / focal_length);
+        int i = 0;
+        while (i < n_samples)
+        {
+            if (depth[i] < free_space_depth)
+            {
+                ++i;
+                continue;
+            }
+
+            int begin = i;
+            float min_depth = depth[i];
+            for (++i; i < n_samples && depth[i] >= free_space_depth; ++i)
+                min_depth = std::min(min_depth, depth[i]);
+
+            if (n_gaps_ == kMaxGaps)
+            {
+                ++n_dropped_;
+                continue;
+            }
+
+            FreeSpaceGap& gap = gaps_[n_gaps_++];
+            gap.begin = begin;
+            gap.end = i - 1;
+            gap.min_depth = min_depth;
+
+            float begin_distance = signedDistance(line.position[gap.begin], line.center);
+            float end_distance = signedDistance(line.position[gap.end], line.center);
+            float middle_distance = signedDistance(line.position[(gap.begin + gap.end) / 2], line.center);
+            gap.width = fabsf(begin_distance - end_distance) * inv_focal_length * min_depth;
+            gap.bearing = atanf(middle_distance * inv_focal_length);
+        }
+    }
+
+    void FreeSpaceGapIndex::clear()
+    {
+        n_gaps_ = 0;
+        n_dropped_ = 0;
+    }
+
+    int FreeSpaceGapIndex::size() const
+    {
+        return n_gaps_;
+    }
+
+    int FreeSpaceGapIndex::dropped() const
+    {
+        return n_dropped_;
+    }
+
+    const FreeSpaceGap& FreeSpaceGapIndex::operator[](int i) const
+    {
+        return gaps_[i];
+    }
+}
@@ -0,0 +1,266 @@
+#include "horizon_analyzer.h"
+#include "depth_image.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace depth_flight_controller;
+
+// Keeps the compiler from dropping the analysis
+static volatile double analysis_sink = 0;
+
+// Reads a depth image stored as a list of floats ("[1.2, nan, ...]"), as dumped into
+// original_img.txt. NaN and missing values are set to 4.9 m, as the expander does.
+static bool loadDepthImage(const char* path, int width, int height, cv::Mat& image)
+{
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    for (size_t i = 0; i < text.size(); ++i)
+        if (text[i] == '[' || text[i] == ']' || text[i] == ',')
+            text[i] = ' ';
+
+    image.create(height, width, CV_32F);
+    float* data = image.ptr<float>(0);
+    int n_pixels = image.rows * image.cols;
+    std::istringstream stream(text);
+    std::string token;
+    int i = 0;
+    for (; i < n_pixels && stream >> token; ++i)
+        data[i] = (token == "nan") ? 4.9f : float(atof(token.c_str()));
+    for (; i < n_pixels; ++i)
+        data[i] = 4.9f;
+    return true;
+}
+
+static double elapsedMs(int64 start, int n_runs)
+{
+    return (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency() / n_runs;
+}
+
+static int sideOf(const cv::Point& p, const cv::Point& q)
+{
+    return p.x < q.x ? -1 : (p.x > q.x ? 1 : 0);
+}
+
+static float distance(const cv::Point& p, const cv::Point& q)
+{
+    cv::Point diff = p - q;
+    return sqrtf(float(diff.x * diff.x + diff.y * diff.y));
+}
+
+// The former TargetFinder::horizonAnalyze loops: two cv::LineIterator walks, a checked pixel
+// access and a square root per sample
+static double twoPassAnalysis(const cv::Mat& depth, cv::Point edge_left, cv::Point edge_right, cv::Point center)
+{
+    cv::LineIterator it(depth, edge_left, edge_right, 8);
+    cv::LineIterator it_ib = it;
+    std::vector<cv::Point> free_space_points;
+
+    double max_depth = -1;
+    cv::Point max_depth_pos;
+    double min_depth_left = 6.0;
+    double min_depth_right = 6.0;
+    double min_depth_ib = 6.0;
+    double min_dist_center_max = 180;
+    double max_dist_center_left_min = 180;
+    double max_dist_center_right_min = 180;
+    double max_dist_center_ib_min = 180;
+    bool in_free_space = false;
+
+    for (int i = 0; i < it.count; ++i, ++it)
+    {
+        float expanded_depth = depthAt(depth, it.pos());
+        cv::Point pos = it.pos();
+        float dist_center = distance(pos, center);
+        int side = sideOf(pos, center);
+
+        if (side == -1 && (expanded_depth < min_depth_left ||
+                           (expanded_depth == min_depth_left && dist_center > max_dist_center_left_min)))
+        {
+            max_dist_center_left_min = dist_center;
+            min_depth_left = expanded_depth;
+        } else if (side == 1 && (expanded_depth < min_depth_right ||
+                                 (expanded_depth == min_depth_right && dist_center > max_dist_center_right_min)))
+        {
+            max_dist_center_right_min = dist_center;
+            min_depth_right = expanded_depth;
+        }
+
+        if (expanded_depth < 4.5)
+            in_free_space = false;
+
+        if (expanded_depth > max_depth || (expanded_depth == max_depth && dist_center < min_dist_center_max) ||
+            in_free_space)
+        {
+            if (!in_free_space)
+                free_space_points.clear();
+            if (expanded_depth >= 4.5)
+            {
+                in_free_space = true;
+                free_space_points.push_back(pos);
+            }
+            min_dist_center_max = dist_center;
+            max_depth = expanded_depth;
+            max_depth_pos = pos;
+        }
+    }
+
+    for (int i = 0; i < it_ib.count; ++i, ++it_ib)
+    {
+        float expanded_depth = depthAt(depth, it_ib.pos());
+        cv::Point pos = it_ib.pos();
+        float dist_center = distance(pos, center);
+        int side = sideOf(pos, center);
+        int side_of_max = sideOf(max_depth_pos, pos);
+
+        if ((side == 0 || side == side_of_max) &&
+            (expanded_depth < min_depth_ib || (expanded_depth == min_depth_ib && dist_center > max_dist_center_ib_min)))
+        {
+            max_dist_center_ib_min = dist_center;
+            min_depth_ib = expanded_depth;
+        }
+    }
+    return max_depth + min_depth_left + min_depth_right + min_depth_ib + free_space_points.size();
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s original_img.txt [runs]\n", argv[0]);
+        return 1;
+    }
+
+    cv::Mat image;
+    if (!loadDepthImage(argv[1], 160, 120, image))
+    {
+        fprintf(stderr, "could not read %s\n", argv[1]);
+        return 1;
+    }
+    int n_runs = (argc > 2) ? atoi(argv[2]) : 10000;
+
+    cv::Mat image_mm(image.rows, image.cols, CV_16UC1);
+    for (int v = 0; v < image.rows; ++v)
+        for (int u = 0; u < image.cols; ++u)
+            image_mm.at<unsigned short>(v, u) = (unsigned short)(image.at<float>(v, u) * 1000 + 0.5f);
+
+    // Horizons through the image center at rolls of -20 to 20 deg, across the full width
+    const int n_lines = 9;
+    cv::Point edge_left[n_lines];
+    cv::Point edge_right[n_lines];
+    cv::Point center(image.cols / 2, image.rows / 2);
+    for (int i = 0; i < n_lines; ++i)
+    {
+        double slope = tan((-20 + 5 * i) * M_PI / 180);
+        edge_left[i] = cv::Point(0, cvRound(center.y - slope * center.x));
+        edge_right[i] = cv::Point(image.cols - 1, cvRound(center.y + slope * (image.cols - 1 - center.x)));
+    }
+
+    HorizonAnalyzer analyzer;
+    HorizonStats stats;
+    HorizonLine line;
+    HorizonLine cached_lines[n_lines];
+    for (int i = 0; i < n_lines; ++i)
+        cached_lines[i].build(image, edge_left[i], edge_right[i], center);
+
+    printf("%-16s %16s %16s %16s\n", "horizon", "two-pass [us]", "one-pass [us]", "cached line [us]");
+    for (int is_mm = 0; is_mm < 2; ++is_mm)
+    {
+        const cv::Mat& depth = is_mm ? image_mm : image;
+        double sum = 0;
+
+        int64 start = cv::getTickCount();
+        for (int run = 0; run < n_runs; ++run)
+            for (int i = 0; i < n_lines; ++i)
+                sum += twoPassAnalysis(depth, edge_left[i], edge_right[i], center);
+        double two_pass_ms = elapsedMs(start, n_runs * n_lines);
+
+        start = cv::getTickCount();
+        for (int run = 0; run < n_runs; ++run)
+        {
+            for (int i = 0; i < n_lines; ++i)
+            {
+                line.build(depth, edge_left[i], edge_right[i], center);
+                analyzer.analyze(depth, line, stats);
+                sum += stats.max_depth;
+            }
+        }
+        double one_pass_ms = elapsedMs(start, n_runs * n_lines);
+
+        // The line kept by the HorizonLineCache while the attitude stays in its bin: only the
+        // gather and the sweep remain
+        start = cv::getTickCount();
+        for (int run = 0; run < n_runs; ++run)
+        {
+            for (int i = 0; i < n_lines; ++i)
+            {
+                analyzer.analyze(depth, cached_lines[i], stats);
+                sum += stats.max_depth;
+            }
+        }
+        double cached_ms = elapsedMs(start, n_runs * n_lines);
+
+        analysis_sink = sum;
+        printf("%-16s %16.3f %16.3f %16.3f\n", is_mm ? "16UC1 [mm]" : "32FC1 [m]", two_pass_ms * 1000,
+               one_pass_ms * 1000, cached_ms * 1000);
+    }
+
+    // Five bands 8 px apart: a line walk and analysis per band vs one gather over all bands
+    const int n_bands = 5;
+    std::vector<int> band_offset;
+    for (int b = 0; b < n_bands; ++b)
+        band_offset.push_back((b - n_bands / 2) * 8);
+    std::vector<HorizonStats> band_stats;
+
+    printf("\n%-16s %16s %16s %16s\n", "5 bands", "per band [us]", "scalar [us]", "simd [us]");
+    for (int is_mm = 0; is_mm < 2; ++is_mm)
+    {
+        const cv::Mat& depth = is_mm ? image_mm : image;
+        double sum = 0;
+
+        int64 start = cv::getTickCount();
+        for (int run = 0; run < n_runs; ++run)
+        {
+            for (int i = 0; i < n_lines; ++i)
+            {
+                for (int b = 0; b < n_bands; ++b)
+                {
+                    cv::Point shift(0, band_offset[b]);
+                    line.build(depth, edge_left[i] + shift, edge_right[i] + shift, center + shift);
+                    analyzer.analyze(depth, line, stats);
+                    sum += stats.max_depth;
+                }
+            }
+        }
+        double per_band_ms = elapsedMs(start, n_runs * n_lines);
+
+        double bands_ms[2];
+        for (int simd = 0; simd < 2; ++simd)
+        {
+            analyzer.setSimdEnabled(simd);
+            start = cv::getTickCount();
+            for (int run = 0; run < n_runs; ++run)
+            {
+                for (int i = 0; i < n_lines; ++i)
+                {
+                    analyzer.analyzeBands(depth, cached_lines[i], band_offset, band_stats);
+                    sum += band_stats[0].max_depth;
+                }
+            }
+            bands_ms[simd] = elapsedMs(start, n_runs * n_lines);
+        }
+
+        analysis_sink = sum;
+        printf("%-16s %16.3f %16.3f %16.3f\n", is_mm ? "16UC1 [mm]" : "32FC1 [m]", per_band_ms * 1000,
+               bands_ms[0] * 1000, bands_ms[1] * 1000);
+    }
+    printf("gather kernel: %s\n", analyzer.gatherKernelName());
+    return 0;
+}
@@ -0,0 +1,295 @@
+#include "horizon_analyzer.h"
+#include "depth_image.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
+
+namespace depth_flight_controller
+{
+    namespace
+    {
+        // Every minimum starts at 6 m and 180 px from the center
+        const float kNoDepth = 6.0f;
+        const int kNoDistSq = 180 * 180;
+
+        // Running minimum over samples in line order: a sample takes over if it is nearer, or
+        // as near and farther from the center
+        struct NearestSample
+        {
+            NearestSample()
+                    : depth(kNoDepth),
+                      dist_sq(kNoDistSq),
+                      index(-1)
+            {
+            }
+
+            void add(float sample_depth, int sample_dist_sq, int i)
+            {
+                if (sample_depth < depth || (sample_depth == depth && sample_dist_sq > dist_sq))
+                {
+                    depth = sample_depth;
+                    dist_sq = sample_dist_sq;
+                    index = i;
+                }
+            }
+
+            float depth;
+            int dist_sq;
+            int index;
+        };
+    }
+
+    HorizonLine::HorizonLine()
+            : valid(false)
+    {
+    }
+
+    void HorizonLine::build(const cv::Mat& image, cv::Point edge_left_pos, cv::Point edge_right_pos,
+                            cv::Point center_pos)
+    {
+        // The sweep relies on the columns growing along the line
+        if (edge_left_pos.x > edge_right_pos.x)
+            std::swap(edge_left_pos, edge_right_pos);
+
+        edge_left = edge_left_pos;
+        edge_right = edge_right_pos;
+        center = center_pos;
+
+        cv::LineIterator it(image, edge_left, edge_right, 8);
+        position.resize(it.count);
+        pixel.resize(it.count);
+
+        // Consecutive samples are 8-neighbours, so the position follows from the pointer step
+        // without the divisions of LineIterator::pos (a row step is more than twice a pixel)
+        const long row_step = long(image.step);
+        bool follow_steps = image.cols > 2;
+        const uchar* last_ptr = *it;
+        cv::Point p = it.pos();
+
+        for (int i = 0; i < it.count; ++i, ++it)
+        {
+            if (i > 0 && follow_steps)
+            {
+                long delta = *it - last_ptr;
+                int step_v = delta > row_step / 2 ? 1 : (delta < -row_step / 2 ? -1 : 0);
+                long step_u = delta - step_v * row_step;
+                p.x += step_u > 0 ? 1 : (step_u < 0 ? -1 : 0);
+                p.y += step_v;
+                last_ptr = *it;
+            } else if (i > 0)
+            {
+                p = it.pos();
+            }
+            position[i] = p;
+            pixel[i] = p.y * image.cols + p.x;
+        }
+    }
+
+    HorizonAnalyzer::HorizonAnalyzer(float free_space_depth)
+            : free_space_depth_(free_space_depth),
+              gather_kernel_(selectHorizonGatherKernel()),
+              band_step_(0)
+    {
+    }
+
+    void HorizonAnalyzer::analyze(const cv::Mat& depth, const HorizonLine& line, HorizonStats& stats)
+    {
+        gather(depth, line);
+        sweep(&depth_[0], line, 0, stats);
+    }
+
+    float HorizonAnalyzer::sampleDepth(int i) const
+    {
+        return depth_[i];
+    }
+
+    const float* HorizonAnalyzer::sampleDepths() const
+    {
+        return &depth_[0];
+    }
+
+    void HorizonAnalyzer::analyzeBands(const cv::Mat& depth, const HorizonLine& line,
+                                       const std::vector<int>& band_offset, std::vector<HorizonStats>& stats)
+    {
+        gatherBands(depth, line, band_offset);
+
+        stats.resize(band_offset.size());
+        for (size_t b = 0; b < band_offset.size(); ++b)
+            sweep(&band_depth_[b * band_step_], line, band_offset[b], stats[b]);
+    }
+
+    float HorizonAnalyzer::bandSampleDepth(int band, int i) const
+    {
+        return band_depth_[band * band_step_ + i];
+    }
+
+    const float* HorizonAnalyzer::bandSampleDepths(int band) const
+    {
+        return &band_depth_[band * band_step_];
+    }
+
+    void HorizonAnalyzer::setSimdEnabled(bool enabled)
+    {
+        gather_kernel_ = selectHorizonGatherKernel(enabled);
+    }
+
+    const char* HorizonAnalyzer::gatherKernelName() const
+    {
+        return horizonGatherKernelName(gather_kernel_);
+    }
+
+    void HorizonAnalyzer::gather(const cv::Mat& depth, const HorizonLine& line)
+    {
+        CV_Assert(depth.type() == CV_32FC1 || depth.type() == CV_16UC1);
+
+        int n_samples = line.pixel.size();
+        if (int(depth_.size()) < n_samples + 1)
+            depth_.resize(n_samples + 1); // Not empty, for &depth_[0]
+
+        if (!depth.isContinuous())
+        {
+            for (int i = 0; i < n_samples; ++i)
+                depth_[i] = depthAt(depth, line.position[i]);
+        } else if (depth.depth() == CV_16U)
+        {
+            const unsigned short* base = depth.ptr<unsigned short>(0);
+            for (int i = 0; i < n_samples; ++i)
+                depth_[i] = base[line.pixel[i]] * 0.001f;
+        } else
+        {
+            const float* base = depth.ptr<float>(0);
+            for (int i = 0; i < n_samples; ++i)
+                depth_[i] = base[line.pixel[i]];
+        }
+    }
+
+    void HorizonAnalyzer::gatherBands(const cv::Mat& depth, const HorizonLine& line,
+                                      const std::vector<int>& band_offset)
+    {
+        CV_Assert(depth.type() == CV_32FC1 || depth.type() == CV_16UC1);
+
+        const int n_samples = line.pixel.size();
+        const int n_bands = band_offset.size();
+        band_step_ = n_samples;
+        if (int(band_depth_.size()) < n_bands * n_samples + 1)
+            band_depth_.resize(n_bands * n_samples + 1);
+
+        if (n_samples == 0 || n_bands == 0)
+            return;
+
+        band_pixel_offset_.resize(n_bands);
+        for (int b = 0; b < n_bands; ++b)
+            band_pixel_offset_[b] = band_offset[b] * depth.cols;
+
+        if (depth.isContinuous() && depth.depth() == CV_32F)
+        {
+            gather_kernel_(depth.ptr<float>(0), depth.rows * depth.cols, &line.pixel[0], n_samples,
+                           &band_pixel_offset_[0], n_bands, &band_depth_[0], band_step_);
+            return;
+        }
+
+        for (int i = 0; i < n_samples; ++i)
+        {
+            for (int b = 0; b < n_bands; ++b)
+            {
+                cv::Point p(line.position[i].x, line.position[i].y + band_offset[b]);
+                band_depth_[b * band_step_ + i] = (p.y >= 0 && p.y < depth.rows) ? depthAt(depth, p) : 0.0f;
+            }
+        }
+    }
+
+    void HorizonAnalyzer::sweep(const float* sample_depth, const HorizonLine& line, int row_offset,
+                                HorizonStats& stats) const
+    {
+        const std::vector<cv::Point>& position = line.position;
+        const int n_samples = position.size();
+
+        NearestSample left;
+        NearestSample right;
+
+        // The in-between minimum depends on the final maximum, so it is kept for both sides:
+        // ib_left over the samples right of the column of the current maximum up to the
+        // center column, ib_right as the minimum from the center column on up to the column
+        // left of the current maximum, taken whenever the maximum moves
+        NearestSample ib_left;
+        NearestSample ib_right;
+        NearestSample from_center;
+        NearestSample from_center_before_column;
+
+        float max_depth = -1;
+        int max_dist_sq = kNoDistSq;
+        int max_index = -1;
+        bool in_free_space = false;
+        int free_space_begin = 0;
+        int free_space_length = 0;
+
+        for (int i = 0; i < n_samples; ++i)
+        {
+            float depth = sample_depth[i];
+            int offset = position[i].x - line.center.x;
+            int dy = position[i].y - line.center.y;
+            int dist_sq = offset * offset + dy * dy;
+
+            if (i == 0 || position[i].x != position[i - 1].x)
+                from_center_before_column = from_center;
+
+            if (offset < 0)
+                left.add(depth, dist_sq, i);
+            else if (offset > 0)
+                right.add(depth, dist_sq, i);
+
+            if (depth < free_space_depth_)
+                in_free_space = false;
+
+            if (depth > max_depth || (depth == max_depth && dist_sq < max_dist_sq) || in_free_space)
+            {
+                if (!in_free_space)
+                    free_space_length = 0;
+
+                if (depth >= free_space_depth_)
+                {
+                    if (free_space_length == 0)
+                        free_space_begin = i;
+                    in_free_space = true;
+                    ++free_space_length;
+                }
+                max_dist_sq = dist_sq;
+                max_depth = depth;
+                max_index = i;
+
+                ib_left = NearestSample();
+                ib_right = from_center_before_column;
+            }
+
+            if (offset <= 0 && max_index >= 0 && position[i].x > position[max_index].x)
+                ib_left.add(depth, dist_sq, i);
+            if (offset >= 0)
+                from_center.add(depth, dist_sq, i);
+        }
+
+        // Positions in the band
+        const cv::Point shift(0, row_offset);
+
+        stats.max_depth = max_depth;
+        stats.max_depth_pos = max_index >= 0 ? position[max_index] + shift : cv::Point();
+        stats.min_depth_left = left.depth;
+        stats.min_depth_left_pos = left.index >= 0 ? position[left.index] + shift : cv::Point();
+        stats.min_depth_right = right.depth;
+        stats.min_depth_right_pos = right.index >= 0 ? position[right.index] + shift : cv::Point();
+        stats.free_space_begin = free_space_begin;
+        stats.free_space_length = free_space_length;
+
+        int max_offset = max_index >= 0 ? position[max_index].x - line.center.x : 0;
+        if (max_index >= 0 && max_offset == 0)
+        {
+            // The maximum is in the center column
+            stats.min_depth_ib = max_depth;
+            stats.min_depth_ib_pos = position[max_index] + shift;
+        } else
+        {
+            const NearestSample& ib = max_offset < 0 ? ib_left : ib_right;
+            stats.min_depth_ib = ib.depth;
+            stats.min_depth_ib_pos = ib.index >= 0 ? position[ib.index] + shift : cv::Point();
+        }
+    }
+}
@@ -0,0 +1,79 @@
+#include "horizon_gather_kernel.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace depth_flight_controller
+{
+    namespace
+    {
+        inline float gatherOne(const float* src, int n_pixels, int j)
+        {
+            return unsigned(j) < unsigned(n_pixels) ? src[j] : 0.0f;
+        }
+    }
+
+    void horizonGatherScalar(const float* src, int n_pixels, const int* index, int n, const int* offset,
+                             int n_bands, float* dst, int dst_step)
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            for (int b = 0; b < n_bands; ++b)
+                dst[b * dst_step + i] = gatherOne(src, n_pixels, index[i] + offset[b]);
+        }
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    __attribute__((target("avx2")))
+    void horizonGatherAvx2(const float* src, int n_pixels, const int* index, int n, const int* offset,
+                           int n_bands, float* dst, int dst_step)
+    {
+        const __m256i v_minus_one = _mm256_set1_epi32(-1);
+        const __m256i v_n_pixels = _mm256_set1_epi32(n_pixels);
+        const __m256 v_zero = _mm256_setzero_ps();
+
+        int i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            const __m256i v_index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(index + i));
+            for (int b = 0; b < n_bands; ++b)
+            {
+                // Lanes outside the image keep 0 and are not read
+                __m256i v_pixel = _mm256_add_epi32(v_index, _mm256_set1_epi32(offset[b]));
+                __m256i v_inside = _mm256_and_si256(_mm256_cmpgt_epi32(v_pixel, v_minus_one),
+                                                    _mm256_cmpgt_epi32(v_n_pixels, v_pixel));
+                __m256 v_depth = _mm256_mask_i32gather_ps(v_zero, src, v_pixel, _mm256_castsi256_ps(v_inside), 4);
+                _mm256_storeu_ps(dst + b * dst_step + i, v_depth);
+            }
+        }
+        for (; i < n; ++i)
+        {
+            for (int b = 0; b < n_bands; ++b)
+                dst[b * dst_step + i] = gatherOne(src, n_pixels, index[i] + offset[b]);
+        }
+    }
+#endif
+
+    HorizonGatherKernel selectHorizonGatherKernel(bool allow_simd)
+    {
+        if (!allow_simd)
+            return &horizonGatherScalar;
+
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return &horizonGatherAvx2;
+#endif
+        return &horizonGatherScalar;
+    }
+
+    const char* horizonGatherKernelName(HorizonGatherKernel kernel)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        if (kernel == &horizonGatherAvx2)
+            return "avx2";
+#endif
+        return "scalar";
+    }
+}
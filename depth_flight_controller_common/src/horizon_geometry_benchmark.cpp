@@ -0,0 +1,133 @@
+#include "horizon_geometry.h"
+#include <opencv2/calib3d/calib3d.hpp>
+#include <vector>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace depth_flight_controller;
+
+// Keeps the compiler from dropping the projections
+static volatile double projection_sink = 0;
+
+static double elapsedUs(int64 start, int n_runs)
+{
+    return (cv::getTickCount() - start) * 1e6 / cv::getTickFrequency() / n_runs;
+}
+
+static double uniform(double low, double high)
+{
+    return low + (high - low) * rand() / RAND_MAX;
+}
+
+// Horizon projection as the expander and the target finders did it per frame: euler angles,
+// tilt matrix, cv::Rodrigues of the identity and cv::projectPoints of the three points
+struct OpenCvProjection
+{
+    OpenCvProjection()
+    {
+        K = (cv::Mat_<double>(3,3)<<151.8076510090423, 0.0, 80.5, 0.0, 151.8076510090423, 60.5, 0.0, 0.0, 1.0);
+        T = (cv::Mat_<double>(3,1) <<  0, 0, 0);
+        distCoeffs = (cv::Mat_<double>(4,1) <<  0, 0, 0, 0);
+        rvec = (cv::Mat_<double>(3,3) << 1, 0, 0, 0, 1, 0, 0, 0, 1);
+        body_cam_rot << 0, -1, 0, 0, 0, 1, 1, 0, 0;
+        center_point << 100, 0, 0;
+        left_point << 1000, 100, 0;
+        right_point << 1000, -100, 0;
+    }
+
+    void project(const Eigen::Quaterniond& q, std::vector<cv::Point2f>& projected_points)
+    {
+        double roll = atan2(2*q.w()*q.x() + 2*q.y()*q.z(), q.w()*q.w() - q.x()*q.x() - q.y()*q.y() + q.z()*q.z());
+        double pitch = -asin(2*q.x()*q.z() - 2*q.w()*q.y());
+        Eigen::Matrix3d tilt = HorizonGeometry::tilt(roll, pitch); // eulerAnglesZYXToRotationMatrix(roll, pitch, 0)
+
+        Eigen::Vector3d left_cam = body_cam_rot * tilt * left_point;
+        Eigen::Vector3d right_cam = body_cam_rot * tilt * right_point;
+        Eigen::Vector3d center_cam = body_cam_rot * tilt * center_point;
+
+        std::vector<cv::Point3f> points;
+        points.push_back(cv::Point3d(left_cam(0), left_cam(1), left_cam(2)));
+        points.push_back(cv::Point3d(right_cam(0), right_cam(1), right_cam(2)));
+        points.push_back(cv::Point3d(center_cam(0), center_cam(1), center_cam(2)));
+
+        cv::Rodrigues(rvec, rvecR);
+        cv::projectPoints(cv::Mat(points), rvecR, T, K, distCoeffs, projected_points);
+    }
+
+    cv::Mat K;
+    cv::Mat T;
+    cv::Mat distCoeffs;
+    cv::Mat rvec;
+    cv::Mat rvecR;
+    Eigen::Matrix3d body_cam_rot;
+    Eigen::Vector3d center_point;
+    Eigen::Vector3d left_point;
+    Eigen::Vector3d right_point;
+};
+
+int main(int argc, char** argv)
+{
+    int n_runs = (argc > 1) ? atoi(argv[1]) : 100000;
+
+    // Attitudes within +-40 deg of roll and pitch and any yaw
+    const int n_attitudes = 1000;
+    std::vector<Eigen::Quaterniond> attitudes(n_attitudes);
+    srand(1);
+    for (int i = 0; i < n_attitudes; ++i)
+    {
+        attitudes[i] = Eigen::AngleAxisd(uniform(-M_PI, M_PI), Eigen::Vector3d::UnitZ()) *
+                       Eigen::AngleAxisd(uniform(-0.7, 0.7), Eigen::Vector3d::UnitY()) *
+                       Eigen::AngleAxisd(uniform(-0.7, 0.7), Eigen::Vector3d::UnitX());
+    }
+
+    OpenCvProjection opencv_projection;
+    HorizonGeometry geometry;
+    geometry.setIntrinsics(opencv_projection.K);
+    geometry.setBodyToCamera(opencv_projection.body_cam_rot);
+    geometry.setHorizonPoints(opencv_projection.left_point, opencv_projection.right_point,
+                              opencv_projection.center_point);
+
+    // Agreement, on the pixels as projected and as truncated to cv::Point by the callers
+    double max_deviation = 0;
+    int n_pixel_mismatches = 0;
+    std::vector<cv::Point2f> projected_points;
+    cv::Point2d pixels[3];
+    for (int i = 0; i < n_attitudes; ++i)
+    {
+        opencv_projection.project(attitudes[i], projected_points);
+        geometry.project(HorizonGeometry::tilt(attitudes[i]), pixels[0], pixels[1], pixels[2]);
+        for (int k = 0; k < 3; ++k)
+        {
+            max_deviation = std::max(max_deviation, std::max(fabs(pixels[k].x - projected_points[k].x),
+                                                             fabs(pixels[k].y - projected_points[k].y)));
+            if (int(pixels[k].x) != int(projected_points[k].x) || int(pixels[k].y) != int(projected_points[k].y))
+                ++n_pixel_mismatches;
+        }
+    }
+
+    double sum = 0;
+    int64 start = cv::getTickCount();
+    for (int run = 0; run < n_runs; ++run)
+    {
+        opencv_projection.project(attitudes[run % n_attitudes], projected_points);
+        sum += projected_points[0].x;
+    }
+    double opencv_us = elapsedUs(start, n_runs);
+
+    start = cv::getTickCount();
+    for (int run = 0; run < n_runs; ++run)
+    {
+        geometry.project(HorizonGeometry::tilt(attitudes[run % n_attitudes]), pixels[0], pixels[1], pixels[2]);
+        sum += pixels[0].x;
+    }
+    double closed_form_us = elapsedUs(start, n_runs);
+    projection_sink = sum;
+
+    printf("%-24s %12s\n", "horizon projection", "[us]");
+    printf("%-24s %12.3f\n", "Rodrigues + projectPoints", opencv_us);
+    printf("%-24s %12.3f\n", "closed form", closed_form_us);
+    printf("max deviation %.2e px, %d of %d truncated pixels differ\n", max_deviation, n_pixel_mismatches,
+           3 * n_attitudes);
+    return 0;
+}
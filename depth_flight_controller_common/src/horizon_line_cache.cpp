@@ -0,0 +1,174 @@
+#include "horizon_line_cache.h"
+
+#include <math.h>
+#include <algorithm>
+
+namespace depth_flight_controller
+{
+    HorizonLineCache::HorizonLineCache()
+            : resolution_(0),
+              half_rolls_(-1),
+              half_pitches_(-1),
+              max_samples_(0),
+              n_built_(0),
+              line_bin_(-1)
+    {
+    }
+
+    void HorizonLineCache::configure(const cv::Size& image_size, double resolution, double max_roll,
+                                     double max_pitch, size_t max_bytes)
+    {
+        CV_Assert(resolution > 0 && max_roll >= 0 && max_pitch >= 0);
+
+        image_size_ = image_size;
+        image_shape_.create(image_size.height, image_size.width, CV_8UC1);
+        resolution_ = resolution;
+
+        // An 8-connected line within the image has at most one sample per column or row
+        max_samples_ = std::max(image_size.width, image_size.height);
+        const size_t bin_bytes = sizeof(Bin) + max_samples_ * sizeof(int);
+        CV_Assert(max_samples_ <= 65535 && max_bytes >= bin_bytes);
+        for (;;)
+        {
+            // Degrees converted to radians do not divide exactly
+            half_rolls_ = int(floor(max_roll / resolution_ + 1e-6));
+            half_pitches_ = int(floor(max_pitch / resolution_ + 1e-6));
+            size_t n_bins = size_t(2 * half_rolls_ + 1) * (2 * half_pitches_ + 1);
+            if (n_bins * bin_bytes <= max_bytes)
+                break;
+            resolution_ *= 1.05;
+        }
+
+        Bin empty = Bin();
+        bins_.assign(size_t(2 * half_rolls_ + 1) * (2 * half_pitches_ + 1), empty);
+        pixels_.assign(bins_.size() * max_samples_, 0);
+        n_built_ = 0;
+        line_bin_ = -1;
+    }
+
+    const cv::Size& HorizonLineCache::imageSize() const
+    {
+        return image_size_;
+    }
+
+    double HorizonLineCache::resolution() const
+    {
+        return resolution_;
+    }
+
+    size_t HorizonLineCache::bytes() const
+    {
+        return bins_.size() * sizeof(Bin) + pixels_.size() * sizeof(int);
+    }
+
+    void HorizonLineCache::build(const HorizonProjector& projector)
+    {
+        for (int bin = 0; bin < int(bins_.size()); ++bin)
+        {
+            if (bins_[bin].state == BIN_EMPTY)
+                buildBin(bin, projector, line_);
+        }
+        line_bin_ = -1;
+    }
+
+    bool HorizonLineCache::find(double roll, double pitch, HorizonLine& line) const
+    {
+        int bin = binOf(roll, pitch);
+        if (bin < 0 || bins_[bin].state == BIN_EMPTY)
+            return false;
+
+        copyBin(bin, line);
+        return true;
+    }
+
+    const HorizonLine& HorizonLineCache::lookup(double roll, double pitch, const HorizonProjector& projector)
+    {
+        int bin = binOf(roll, pitch);
+        if (bin < 0)
+        {
+            cv::Point edge_left;
+            cv::Point edge_right;
+            cv::Point center;
+            bool valid = projector.projectHorizon(roll, pitch, image_size_, edge_left, edge_right, center);
+            line_.build(image_shape_, edge_left, edge_right, center);
+            line_.valid = valid;
+            line_bin_ = -1;
+            return line_;
+        }
+
+        if (bin == line_bin_)
+            return line_;
+
+        // A bin built here is walked into line_ already
+        if (bins_[bin].state == BIN_EMPTY)
+            buildBin(bin, projector, line_);
+        else
+            copyBin(bin, line_);
+        line_bin_ = bin;
+        return line_;
+    }
+
+    int HorizonLineCache::builtLines() const
+    {
+        return n_built_;
+    }
+
+    int HorizonLineCache::binOf(double roll, double pitch) const
+    {
+        if (half_rolls_ < 0)
+            return -1;
+
+        int roll_bin = int(floor(roll / resolution_ + 0.5)) + half_rolls_;
+        int pitch_bin = int(floor(pitch / resolution_ + 0.5)) + half_pitches_;
+        if (roll_bin < 0 || roll_bin > 2 * half_rolls_ || pitch_bin < 0 || pitch_bin > 2 * half_pitches_)
+            return -1;
+        return roll_bin * (2 * half_pitches_ + 1) + pitch_bin;
+    }
+
+    void HorizonLineCache::buildBin(int bin, const HorizonProjector& projector, HorizonLine& line)
+    {
+        // Center attitude of the bin
+        int n_pitches = 2 * half_pitches_ + 1;
+        double roll = (bin / n_pitches - half_rolls_) * resolution_;
+        double pitch = (bin % n_pitches - half_pitches_) * resolution_;
+
+        cv::Point edge_left;
+        cv::Point edge_right;
+        cv::Point center;
+        line.valid = projector.projectHorizon(roll, pitch, image_size_, edge_left, edge_right, center);
+        line.build(image_shape_, edge_left, edge_right, center);
+        CV_Assert(int(line.pixel.size()) <= max_samples_);
+
+        // The edges lie in the image, a center far outside of it is saturated
+        Bin& entry = bins_[bin];
+        entry.edge_left_x = cv::saturate_cast<short>(line.edge_left.x);
+        entry.edge_left_y = cv::saturate_cast<short>(line.edge_left.y);
+        entry.edge_right_x = cv::saturate_cast<short>(line.edge_right.x);
+        entry.edge_right_y = cv::saturate_cast<short>(line.edge_right.y);
+        entry.center_x = cv::saturate_cast<short>(line.center.x);
+        entry.center_y = cv::saturate_cast<short>(line.center.y);
+        entry.n_samples = (unsigned short)line.pixel.size();
+        entry.state = line.valid ? BIN_BUILT_VALID : BIN_BUILT;
+        std::copy(line.pixel.begin(), line.pixel.end(), pixels_.begin() + size_t(bin) * max_samples_);
+        ++n_built_;
+    }
+
+    void HorizonLineCache::copyBin(int bin, HorizonLine& line) const
+    {
+        const Bin& entry = bins_[bin];
+        const int* pixel = &pixels_[size_t(bin) * max_samples_];
+        const int width = image_size_.width;
+
+        line.edge_left = cv::Point(entry.edge_left_x, entry.edge_left_y);
+        line.edge_right = cv::Point(entry.edge_right_x, entry.edge_right_y);
+        line.center = cv::Point(entry.center_x, entry.center_y);
+        line.valid = entry.state == BIN_BUILT_VALID;
+        line.pixel.assign(pixel, pixel + entry.n_samples);
+        line.position.resize(entry.n_samples);
+        for (int i = 0; i < entry.n_samples; ++i)
+        {
+            int v = pixel[i] / width;
+            line.position[i] = cv::Point(pixel[i] - v * width, v);
+        }
+    }
+}
@@ -3,9 +3,17 @@
 
 namespace depth_flight_controller {
 
-    ImageClipper::ImageClipper()
-            : it_(nh_)
+    ImageClipper::ImageClipper(const ros::NodeHandle& nh, const ros::NodeHandle& pnh)
+            : nh_(nh),
+              it_(nh_)
     {
+        pnh.param<std::string>("depth_encoding", depth_encoding_, "32FC1");
+        if (!isDepthEncoding(depth_encoding_))
+        {
+            ROS_WARN("Unknown depth_encoding %s, using 32FC1", depth_encoding_.c_str());
+            depth_encoding_ = "32FC1";
+        }
+
         image_sub_ = it_.subscribe("/hummingbird/vi_sensor/camera_depth/depth/disparity", 1,
                                    &ImageClipper::imageCallback, this);
         image_pub_ = it_.advertise("/hummingbird/vi_sensor/camera_depth/depth/clipped", 1);
@@ -18,11 +26,11 @@ namespace depth_flight_controller {
 
     void ImageClipper::imageCallback(const sensor_msgs::ImageConstPtr& msg)
     {
-        cv_bridge::CvImagePtr cv_ptr_clipped;
+        cv_bridge::CvImageConstPtr cv_ptr_original;
 
         try
         {
-            cv_ptr_clipped = cv_bridge::toCvCopy(msg);
+            cv_ptr_original = cv_bridge::toCvShare(msg);
         }
         catch (cv_bridge::Exception& e)
         {
@@ -30,24 +38,30 @@ namespace depth_flight_controller {
             return;
         }
 
-        depth_float_img_clipped_ = cv_ptr_clipped->image;
-        cv::Mat mask = cv::Mat(depth_float_img_clipped_ != depth_float_img_clipped_);
-        depth_float_img_clipped_.setTo(4.99, mask);
-
-        image_pub_.publish(cv_ptr_clipped->toImageMsg());
-    }
-}
+        const cv::Mat& depth_img_original = cv_ptr_original->image;
+        if (depth_img_original.type() != CV_32FC1)
+        {
+            ROS_ERROR_THROTTLE(5.0, "Expected a 32FC1 depth image, got %s", cv_ptr_original->encoding.c_str());
+            return;
+        }
 
-int main(int argc, char** argv)
-{
-    ros::init(argc, argv, "image_clipper");
+        // The shared frame is read only: fill the NaNs while copying it into the outgoing message
+        depth_img_clipped_ = clipped_msg_.acquire(msg->header, depth_img_original.rows, depth_img_original.cols,
+                                                  depth_encoding_);
+        clipImage(depth_img_original, depth_img_clipped_);
 
-    depth_flight_controller::ImageClipper ic;
+        image_pub_.publish(clipped_msg_.message());
+    }
 
-    ros::spin();
+    void ImageClipper::clipImage(const cv::Mat& depth_float_img, cv::Mat& depth_img_clipped)
+    {
+        if (depth_img_clipped.type() == CV_16UC1 && depth_img_clipped.size() == depth_float_img.size())
+        {
+            fillNanDepthMillimetres(depth_float_img, 4.99, depth_img_clipped);
+            return;
+        }
 
-    return 0;
+        depth_img_clipped.create(depth_float_img.rows, depth_float_img.cols, CV_32FC1);
+        fillNanDepth(depth_float_img, 4.99, depth_img_clipped);
+    }
 }
-
-
-
@@ -0,0 +1,12 @@
+#include "image_clipper.h"
+
+int main(int argc, char** argv)
+{
+    ros::init(argc, argv, "image_clipper");
+
+    depth_flight_controller::ImageClipper ic;
+
+    ros::spin();
+
+    return 0;
+}
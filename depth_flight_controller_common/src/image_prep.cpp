@@ -2,8 +2,9 @@
 
 namespace depth_flight_controller
 {
-    ImagePrep::ImagePrep()
-            : it_(nh_)
+    ImagePrep::ImagePrep(const ros::NodeHandle& nh)
+            : nh_(nh),
+              it_(nh_)
     {
         expanded_image_sub_ = it_.subscribe("/hummingbird/vi_sensor/camera_depth/depth/expanded", 1, &ImagePrep::expandedImageCallback, this);
         original_image_sub_ = it_.subscribe("/hummingbird/vi_sensor/camera_depth/depth/clipped", 1, &ImagePrep::originalImageCallback, this);
@@ -33,14 +34,14 @@ namespace depth_flight_controller
 
     void ImagePrep::expandedImageCallback(const sensor_msgs::ImageConstPtr& msg)
     {
-        cv_bridge::CvImagePtr cv_ptr_expanded;
+        cv_bridge::CvImageConstPtr cv_ptr_expanded;
         cv_bridge::CvImage cv_horizon;
         cv_bridge::CvImage cv_expended_top;
         cv_bridge::CvImage cv_original_top;
 
         try
         {
-            cv_ptr_expanded = cv_bridge::toCvCopy(msg);
+            cv_ptr_expanded = cv_bridge::toCvShare(msg);
         }
         catch (cv_bridge::Exception& e)
         {
@@ -48,7 +49,7 @@ namespace depth_flight_controller
             return;
         }
 
-        cv::Mat depth_expanded_img_ = cv_ptr_expanded->image;
+        const cv::Mat& depth_expanded_img_ = cv_ptr_expanded->image;
         cv::Mat depth_original_img = depth_original_img_;
 
         cv::Mat depth_mono8_img;
@@ -70,8 +71,8 @@ namespace depth_flight_controller
 
             float dist_horizon = euclideanDist(current_pos, horizon_center_);
 
-            float expanded_depth_val = depth_expanded_img_.at<float>(it.pos());
-            float original_depth_val = depth_original_img.at<float>(it.pos());
+            float expanded_depth_val = depthAt(depth_expanded_img_, it.pos());
+            float original_depth_val = depthAt(depth_original_img, it.pos());
 
             int original_x_pos = int(original_depth_val * dist_horizon / 1.5180765 +265);
             int expanded_x_pos = int(expanded_depth_val * dist_horizon / 1.5180765 +265);
@@ -156,11 +157,9 @@ namespace depth_flight_controller
 
     void ImagePrep::originalImageCallback(const sensor_msgs::ImageConstPtr& msg)
     {
-        cv_bridge::CvImagePtr cv_ptr_original;
-
         try
         {
-            cv_ptr_original = cv_bridge::toCvCopy(msg);
+            cv_ptr_original_ = cv_bridge::toCvShare(msg);
         }
         catch (cv_bridge::Exception& e)
         {
@@ -168,7 +167,7 @@ namespace depth_flight_controller
             return;
         }
 
-        depth_original_img_ = cv_ptr_original->image;
+        depth_original_img_ = cv_ptr_original_->image;
     }
 
     void ImagePrep::horizonPointsCallback(const depth_flight_controller_msgs::HorizonPoints& msg)
@@ -193,16 +192,6 @@ namespace depth_flight_controller
         //Process images
         if(mono8_img.rows != float_img.rows || mono8_img.cols != float_img.cols){
             mono8_img = cv::Mat(float_img.size(), CV_8UC1);}
-        cv::convertScaleAbs(float_img, mono8_img, 100, 0.0);
+        cv::convertScaleAbs(float_img, mono8_img, 100 * metresPerUnit(float_img), 0.0);
     }
 }
-
-int main(int argc, char** argv)
-{
-    ros::init(argc, argv, "image_prep");
-
-    depth_flight_controller::ImagePrep ip;
-    ros::spin();
-
-    return 0;
-}
\ No newline at end of file
@@ -0,0 +1,11 @@
+#include "image_prep.h"
+
+int main(int argc, char** argv)
+{
+    ros::init(argc, argv, "image_prep");
+
+    depth_flight_controller::ImagePrep ip;
+    ros::spin();
+
+    return 0;
+}
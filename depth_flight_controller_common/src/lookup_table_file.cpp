@@ -0,0 +1,212 @@
+#include "lookup_table_file.h"
+#include "c_space_expansion_engine.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <sstream>
+
+
+namespace depth_flight_controller {
+
+    namespace
+    {
+        const char file_magic[8] = {'D', 'F', 'C', 'L', 'U', 'T', '\0', '\0'};
+        const unsigned int file_version = 1; // Bump whenever the span computation changes
+
+        // Padded to 128 bytes so the tables that follow are cache-line aligned in the mapping
+        struct FileHeader
+        {
+            char magic[8];
+            unsigned int version;
+            unsigned int header_bytes;
+            int image_width;
+            int image_height;
+            int max_depth;
+            int precision;
+            double focal_length_u;
+            double focal_length_v;
+            double center_u;
+            double center_v;
+            double drone_radius;
+            char padding[56];
+        };
+
+        FileHeader makeHeader(const LookupTableConfig& config, int precision)
+        {
+            FileHeader header;
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, file_magic, sizeof(file_magic));
+            header.version = file_version;
+            header.header_bytes = sizeof(FileHeader);
+            header.image_width = config.image_width;
+            header.image_height = config.image_height;
+            header.max_depth = config.max_depth;
+            header.precision = precision;
+            header.focal_length_u = config.focal_length_u;
+            header.focal_length_v = config.focal_length_v;
+            header.center_u = config.center_u;
+            header.center_v = config.center_v;
+            header.drone_radius = config.drone_radius;
+            return header;
+        }
+
+        size_t tableBytes(const LookupTableConfig& config)
+        {
+            return sizeof(int) * 2 * size_t(config.image_width + config.image_height) * config.max_depth;
+        }
+
+        bool writeAll(int fd, const void* data, size_t n_bytes)
+        {
+            const char* p = static_cast<const char*>(data);
+            while (n_bytes > 0)
+            {
+                ssize_t n = ::write(fd, p, n_bytes);
+                if (n <= 0)
+                    return false;
+                p += n;
+                n_bytes -= n;
+            }
+            return true;
+        }
+
+        // Makes a rename within the directory of path durable. Best effort: not every file
+        // system lets a directory be opened and synced.
+        void syncDirectory(const std::string& path)
+        {
+            size_t slash = path.rfind('/');
+            std::string directory = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+
+            int fd = ::open(directory.c_str(), O_RDONLY);
+            if (fd < 0)
+                return;
+            fsync(fd);
+            ::close(fd);
+        }
+    }
+
+    LookupTableFile::LookupTableFile()
+            : data_(NULL), size_(0)
+    {
+    }
+
+    LookupTableFile::~LookupTableFile()
+    {
+        close();
+    }
+
+    bool LookupTableFile::open(const std::string& path, const LookupTableConfig& config, int precision)
+    {
+        close();
+
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat file_stat;
+        size_t expected_size = sizeof(FileHeader) + tableBytes(config);
+        if (fstat(fd, &file_stat) != 0 || size_t(file_stat.st_size) != expected_size)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        void* data = mmap(NULL, expected_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED)
+            return false;
+
+        // Compare field by field, the padding of the header is not part of the key
+        const FileHeader* stored = static_cast<const FileHeader*>(data);
+        FileHeader wanted = makeHeader(config, precision);
+        bool is_match = memcmp(stored->magic, wanted.magic, sizeof(wanted.magic)) == 0 &&
+                        stored->version == wanted.version &&
+                        stored->header_bytes == wanted.header_bytes &&
+                        stored->image_width == wanted.image_width &&
+                        stored->image_height == wanted.image_height &&
+                        stored->max_depth == wanted.max_depth &&
+                        stored->precision == wanted.precision &&
+                        stored->focal_length_u == wanted.focal_length_u &&
+                        stored->focal_length_v == wanted.focal_length_v &&
+                        stored->center_u == wanted.center_u &&
+                        stored->center_v == wanted.center_v &&
+                        stored->drone_radius == wanted.drone_radius;
+
+        if (!is_match)
+        {
+            munmap(data, expected_size);
+            return false;
+        }
+
+        data_ = data;
+        size_ = expected_size;
+        return true;
+    }
+
+    void LookupTableFile::close()
+    {
+        if (data_ != NULL)
+            munmap(data_, size_);
+        data_ = NULL;
+        size_ = 0;
+    }
+
+    bool LookupTableFile::isOpen() const
+    {
+        return data_ != NULL;
+    }
+
+    const int* LookupTableFile::utable() const
+    {
+        return reinterpret_cast<const int*>(static_cast<const char*>(data_) + sizeof(FileHeader));
+    }
+
+    const int* LookupTableFile::vtable() const
+    {
+        const FileHeader* header = static_cast<const FileHeader*>(data_);
+        return utable() + 2 * header->image_width * header->max_depth;
+    }
+
+    bool LookupTableFile::write(const std::string& path, const LookupTableConfig& config, int precision,
+                                const int* utable, const int* vtable)
+    {
+        std::ostringstream tmp_path;
+        tmp_path << path << ".tmp." << getpid();
+
+        int fd = ::open(tmp_path.str().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+
+        FileHeader header = makeHeader(config, precision);
+        bool is_written = writeAll(fd, &header, sizeof(header)) &&
+                          writeAll(fd, utable, sizeof(int) * 2 * size_t(config.image_width) * config.max_depth) &&
+                          writeAll(fd, vtable, sizeof(int) * 2 * size_t(config.image_height) * config.max_depth);
+
+        // The data must reach the disk before the rename does: after a crash in between, the
+        // file under path would otherwise have a valid header over truncated tables
+        is_written = is_written && fsync(fd) == 0;
+        is_written = (::close(fd) == 0) && is_written;
+
+        if (!is_written || rename(tmp_path.str().c_str(), path.c_str()) != 0)
+        {
+            unlink(tmp_path.str().c_str());
+            return false;
+        }
+        syncDirectory(path);
+        return true;
+    }
+
+    std::string LookupTableFile::defaultPath(const std::string& file_name)
+    {
+        const char* ros_home = getenv("ROS_HOME");
+        if (ros_home != NULL)
+            return std::string(ros_home) + "/" + file_name;
+
+        const char* home = getenv("HOME");
+        return std::string(home != NULL ? home : ".") + "/.ros/" + file_name;
+    }
+}
@@ -0,0 +1,62 @@
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <boost/shared_ptr.hpp>
+#include "image_clipper.h"
+#include "c_space_expander.h"
+#include "c_space_expander_horizon.h"
+#include "image_prep.h"
+
+namespace depth_flight_controller
+{
+    // The pipeline stages as nodelets. Stages loaded into the same nodelet manager hand their
+    // images to each other as shared pointers instead of serializing them over TCPROS.
+
+    class ImageClipperNodelet : public nodelet::Nodelet
+    {
+    private:
+        virtual void onInit()
+        {
+            image_clipper_.reset(new ImageClipper(getNodeHandle(), getPrivateNodeHandle()));
+        }
+
+        boost::shared_ptr<ImageClipper> image_clipper_;
+    };
+
+    class CSpaceExpanderNodelet : public nodelet::Nodelet
+    {
+    private:
+        virtual void onInit()
+        {
+            c_space_expander_.reset(new CSpaceExpander(getNodeHandle(), getPrivateNodeHandle()));
+        }
+
+        boost::shared_ptr<CSpaceExpander> c_space_expander_;
+    };
+
+    class CSpaceExpanderHorizonNodelet : public nodelet::Nodelet
+    {
+    private:
+        virtual void onInit()
+        {
+            c_space_expander_.reset(new CSpaceExpanderHorizon(getNodeHandle(), getPrivateNodeHandle()));
+        }
+
+        boost::shared_ptr<CSpaceExpanderHorizon> c_space_expander_;
+    };
+
+    class ImagePrepNodelet : public nodelet::Nodelet
+    {
+    private:
+        virtual void onInit()
+        {
+            image_prep_.reset(new ImagePrep(getNodeHandle()));
+        }
+
+        boost::shared_ptr<ImagePrep> image_prep_;
+    };
+}
+
+PLUGINLIB_EXPORT_CLASS(depth_flight_controller::ImageClipperNodelet, nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(depth_flight_controller::CSpaceExpanderNodelet, nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(depth_flight_controller::CSpaceExpanderHorizonNodelet, nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(depth_flight_controller::ImagePrepNodelet, nodelet::Nodelet)
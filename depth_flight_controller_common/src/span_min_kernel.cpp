@@ -0,0 +1,94 @@
+#include "span_min_kernel.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+namespace depth_flight_controller
+{
+    void spanMinScalar(float* dst, int n, float value)
+    {
+        for (int i = 0; i < n; ++i)
+            dst[i] = std::min(dst[i], value);
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    __attribute__((target("avx2")))
+    void spanMinAvx2(float* dst, int n, float value)
+    {
+        // _mm256_min_ps(a, b) returns b if either operand is NaN, so keep dst second
+        const __m256 v_value = _mm256_set1_ps(value);
+
+        int i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            __m256 d0 = _mm256_loadu_ps(dst + i);
+            __m256 d1 = _mm256_loadu_ps(dst + i + 8);
+            _mm256_storeu_ps(dst + i, _mm256_min_ps(v_value, d0));
+            _mm256_storeu_ps(dst + i + 8, _mm256_min_ps(v_value, d1));
+        }
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(dst + i, _mm256_min_ps(v_value, _mm256_loadu_ps(dst + i)));
+        for (; i < n; ++i)
+            dst[i] = std::min(dst[i], value);
+    }
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    void spanMinNeon(float* dst, int n, float value)
+    {
+        const float32x4_t v_value = vdupq_n_f32(value);
+
+        int i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            float32x4_t d0 = vld1q_f32(dst + i);
+            float32x4_t d1 = vld1q_f32(dst + i + 4);
+            float32x4_t d2 = vld1q_f32(dst + i + 8);
+            float32x4_t d3 = vld1q_f32(dst + i + 12);
+            vst1q_f32(dst + i, vminq_f32(d0, v_value));
+            vst1q_f32(dst + i + 4, vminq_f32(d1, v_value));
+            vst1q_f32(dst + i + 8, vminq_f32(d2, v_value));
+            vst1q_f32(dst + i + 12, vminq_f32(d3, v_value));
+        }
+        for (; i + 4 <= n; i += 4)
+            vst1q_f32(dst + i, vminq_f32(vld1q_f32(dst + i), v_value));
+        for (; i < n; ++i)
+            dst[i] = std::min(dst[i], value);
+    }
+#endif
+
+    SpanMinKernel selectSpanMinKernel(bool allow_simd)
+    {
+        if (!allow_simd)
+            return &spanMinScalar;
+
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return &spanMinAvx2;
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+        return &spanMinNeon;
+#endif
+        return &spanMinScalar;
+    }
+
+    const char* spanMinKernelName(SpanMinKernel kernel)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        if (kernel == &spanMinAvx2)
+            return "avx2";
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+        if (kernel == &spanMinNeon)
+            return "neon";
+#endif
+        return "scalar";
+    }
+}
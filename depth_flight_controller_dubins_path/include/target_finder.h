@@ -12,13 +12,19 @@
 #include <sensor_msgs/image_encodings.h>
 #include "opencv2/core/core.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
-#include "opencv2/calib3d/calib3d.hpp"
 #include "opencv2/highgui/highgui.hpp"
 #include "geometry_msgs/TwistStamped.h"
 #include "geometry_msgs/Quaternion.h"
 #include "quad_msgs/QuadStateEstimate.h"
 #include "depth_flight_controller_msgs/HorizonPoints.h"
 #include "depth_flight_controller_msgs/Target.h"
+#include "depth_flight_controller_msgs/FreeSpaceGaps.h"
+#include "depth_image.h"
+#include "horizon_analyzer.h"
+#include "free_space_gap_index.h"
+#include "horizon_geometry.h"
+#include "horizon_line_cache.h"
+#include "target_search.h"
 #include "quad_common/quad_state.h"
 #include <iostream>
 #include <string>
@@ -35,25 +41,36 @@ namespace depth_flight_controller
 {
     using namespace quad_common;
 
-    class TargetFinder
+    class TargetFinder : public HorizonProjector, public TargetSearch
     {
     public:
-        TargetFinder();
+        // Without connect_topics only Target and HorizonPoints are advertised: frames are
+        // handed to findTarget by the owner (see DepthPipeline)
+        explicit TargetFinder(const ros::NodeHandle& nh = ros::NodeHandle(), const ros::NodeHandle& pnh = ros::NodeHandle("~"),
+                              bool connect_topics = true);
         ~TargetFinder();
 
         void expandedImageCallback(const sensor_msgs::ImageConstPtr& msg);
+        // depth_expanded_img: CV_32FC1 in [m] or CV_16UC1 in [mm]
+        virtual void findTarget(const cv::Mat& depth_expanded_img, const QuadState& state_estimate_image,
+                                const quad_msgs::QuadStateEstimate& state_estimate_image_msg);
         void stateEstimateCallback(const quad_msgs::QuadStateEstimate::ConstPtr &msg);
 
         Eigen::Matrix3d tiltCalculator(const QuadState &state_estimate);
         Eigen::Vector3d toEulerAngle(const Eigen::Quaterniond& q);
-        double Slope(int x0, int y0, int x1, int y1);
+        double Slope(int x0, int y0, int x1, int y1) const;
         std::vector<cv::Point> fullLine(cv::Point a, cv::Point b, cv::Point center_pos);
         float euclideanDistSign(cv::Point& p, cv::Point& q);
         float euclideanDist(cv::Point& p, cv::Point& q);
         int leftOfSecArg(cv::Point& p, cv::Point& q);
         void horizonAnalyze(std::vector<cv::Point> horizon_points, quad_msgs::QuadStateEstimate state_estimate_image_msg);
+        void horizonAnalyze(const HorizonLine& horizon_line, quad_msgs::QuadStateEstimate state_estimate_image_msg);
         std::vector<cv::Point> buildHorizon(const QuadState state_estimate);
 
+        // The horizon for roll and pitch: projection of the world horizon points, clipped to the image
+        virtual bool projectHorizon(double roll, double pitch, const cv::Size& image_size, cv::Point& edge_left,
+                                    cv::Point& edge_right, cv::Point& center) const;
+
     protected:
         ros::NodeHandle nh_;
         image_transport::ImageTransport it_;
@@ -63,23 +80,28 @@ namespace depth_flight_controller
         ros::Subscriber state_estimate_sub_;
         ros::Publisher horizon_points_pub_;
         ros::Publisher target_pub_;
+        ros::Publisher free_space_gaps_pub_;
 
     private:
+        // Line through a and b across the image, clipped to it. False if it is too short or
+        // misses the center.
+        bool projectTilt(const Eigen::Matrix3d& tilt, const cv::Size& image_size, cv::Point& edge_left,
+                         cv::Point& edge_right, cv::Point& center) const;
+        bool clipHorizon(cv::Point a, cv::Point b, const cv::Point& center_pos, const cv::Size& image_size,
+                         cv::Point& edge_left_pos, cv::Point& edge_right_pos) const;
+        void configureHorizonCache(const cv::Size& image_size);
+        void publishFreeSpaceGaps(const HorizonLine& horizon_line, int band_offset,
+                                  const quad_msgs::QuadStateEstimate& state_estimate_image_msg);
+        int selectBand(const std::vector<HorizonStats>& band_stats) const;
+        static bool isBetterBand(const HorizonStats& a, const HorizonStats& b);
+
         // Image information
+        cv_bridge::CvImageConstPtr cv_ptr_expanded_; // Shared with the subscription, read only
         cv::Mat depth_expanded_img_;
         quad_msgs::QuadStateEstimate state_estimate_msg_;
 
         // Camera intrinsic and extrinsic information
-        cv::Mat K;
-        cv::Mat rvecR;
-        cv::Mat T;
-        cv::Mat distCoeffs;
-
-        Eigen::Matrix3d body_cam_rot_;
-        Eigen::Vector3d horizon_center_point_world_;
-        Eigen::Vector3d horizon_left_point_world_;
-        Eigen::Vector3d horizon_right_point_world_;
-        cv::Mat rvec;
+        HorizonGeometry horizon_geometry_;
 
         // State information
         QuadState state_estimate_;
@@ -92,6 +114,18 @@ namespace depth_flight_controller
         std::vector<cv::Point2f> projected_horizon_points;
 
         // Horizon analysis information
+        HorizonLineCache horizon_cache_;
+        bool use_horizon_cache_;
+        bool prebuild_horizon_cache_;
+        double horizon_cache_resolution_; // [deg]
+        double horizon_cache_max_roll_;
+        double horizon_cache_max_pitch_;
+        HorizonLine horizon_line_; // Without the cache
+        HorizonAnalyzer horizon_analyzer_;
+        std::vector<int> horizon_band_offset_; // [px] down from the horizon line, one per band
+        std::vector<HorizonStats> band_stats_;
+        FreeSpaceGapIndex free_space_gaps_;
+        depth_flight_controller_msgs::FreeSpaceGaps free_space_gaps_msg_;
         bool is_max_valid_;
         double yaw_;
     };
@@ -6,26 +6,57 @@
 
 namespace depth_flight_controller
 {
-    TargetFinder::TargetFinder()
-            : it_(nh_)
+    TargetFinder::TargetFinder(const ros::NodeHandle& nh, const ros::NodeHandle& pnh, bool connect_topics)
+            : nh_(nh),
+              it_(nh_)
     {
-        expanded_image_sub_ = it_.subscribe("/hummingbird/vi_sensor/camera_depth/depth/expanded", 1, &TargetFinder::expandedImageCallback, this);
+        if (connect_topics)
+        {
+            expanded_image_sub_ = it_.subscribe("/hummingbird/vi_sensor/camera_depth/depth/expanded", 1, &TargetFinder::expandedImageCallback, this);
 
-        state_estimate_sub_ = nh_.subscribe("/hummingbird/state_estimate_original_img", 1, &TargetFinder::stateEstimateCallback, this);
+            state_estimate_sub_ = nh_.subscribe("/hummingbird/state_estimate_original_img", 1, &TargetFinder::stateEstimateCallback, this);
+        }
 
         target_pub_ = nh_.advertise<depth_flight_controller_msgs::Target>("/hummingbird/target", 1);
 
         horizon_points_pub_ =  nh_.advertise<depth_flight_controller_msgs::HorizonPoints>("/hummingbird/horizon_points", 1);
 
-        K = (cv::Mat_<double>(3,3)<<151.8076510090423, 0.0, 80.5, 0.0, 151.8076510090423, 60.5, 0.0, 0.0, 1.0);
-        T = (cv::Mat_<double>(3,1) <<  0, 0, 0);
-        distCoeffs = (cv::Mat_<double>(4,1) <<  0, 0, 0, 0);
-
-        body_cam_rot_ << 0, -1, 0, 0, 0, 1, 1, 0, 0;
-        horizon_center_point_world_ << 100, 0, 0;
-        horizon_left_point_world_ << 1000, 100, 0;
-        horizon_right_point_world_ << 1000, -100, 0;
-        rvec = (cv::Mat_<double>(3,3) << 1, 0, 0, 0, 1, 0, 0, 0, 1);
+        free_space_gaps_pub_ = nh_.advertise<depth_flight_controller_msgs::FreeSpaceGaps>("/hummingbird/free_space_gaps", 1);
+
+        Eigen::Matrix3d body_cam_rot;
+        body_cam_rot << 0, -1, 0, 0, 0, 1, 1, 0, 0;
+        horizon_geometry_.setIntrinsics(151.8076510090423, 151.8076510090423, 80.5, 60.5);
+        horizon_geometry_.setBodyToCamera(body_cam_rot);
+        horizon_geometry_.setHorizonPoints(Eigen::Vector3d(1000, 100, 0), Eigen::Vector3d(1000, -100, 0),
+                                           Eigen::Vector3d(100, 0, 0));
+
+        // Ready-made horizon pixel lists by quantised roll and pitch instead of a projection and
+        // a line walk per frame. 1 deg bins over +-45 deg roll and +-30 deg pitch take 3.6 MB at
+        // 160x120; finer ones are coarsened to HorizonLineCache::kDefaultMaxBytes.
+        pnh.param("use_horizon_cache", use_horizon_cache_, true);
+        pnh.param("horizon_cache_resolution", horizon_cache_resolution_, 1.0); // [deg]
+        pnh.param("horizon_cache_max_roll", horizon_cache_max_roll_, 45.0);
+        pnh.param("horizon_cache_max_pitch", horizon_cache_max_pitch_, 30.0);
+        pnh.param("prebuild_horizon_cache", prebuild_horizon_cache_, true);
+        if (use_horizon_cache_)
+            configureHorizonCache(cv::Size(160, 120)); // The camera of the intrinsics, until a frame tells otherwise
+
+        // Parallel horizon bands, horizon_band_spacing px apart with the horizon line in the middle
+        int n_horizon_bands;
+        int horizon_band_spacing;
+        pnh.param("horizon_bands", n_horizon_bands, 1);
+        pnh.param("horizon_band_spacing", horizon_band_spacing, 8);
+        n_horizon_bands = std::max(1, n_horizon_bands);
+        if (n_horizon_bands % 2 == 0)
+        {
+            ROS_WARN("~horizon_bands must be odd, scanning %d bands", n_horizon_bands + 1);
+            ++n_horizon_bands;
+        }
+        for (int b = 0; b < n_horizon_bands; ++b)
+            horizon_band_offset_.push_back((b - n_horizon_bands / 2) * horizon_band_spacing);
+        if (n_horizon_bands > 1)
+            ROS_INFO("Scanning %d horizon bands %d px apart, gather kernel: %s", n_horizon_bands,
+                     horizon_band_spacing, horizon_analyzer_.gatherKernelName());
     }
 
     TargetFinder::~TargetFinder()
@@ -46,25 +77,18 @@ namespace depth_flight_controller
 
     Eigen::Matrix3d TargetFinder::tiltCalculator(const QuadState &state_estimate)
     {
-        Eigen::Quaterniond q = state_estimate.orientation;
-        Eigen::Vector3d euler_angles = TargetFinder::toEulerAngle(q);
-        Eigen::Matrix3d state_estimate_rot_mat = eulerAnglesZYXToRotationMatrix(euler_angles);
-        Eigen::Matrix3d state_estimate_rot_mat_inv = state_estimate_rot_mat.inverse();
-        return state_estimate_rot_mat;
+        return HorizonGeometry::tilt(state_estimate.orientation);
     }
 
     void TargetFinder::expandedImageCallback(const sensor_msgs::ImageConstPtr& msg)
     {
-        is_max_valid_ = true;
         QuadState state_estimate_image = state_estimate_;
         quad_msgs::QuadStateEstimate state_estimate_image_msg = state_estimate_msg_;
 
 
-        cv_bridge::CvImagePtr cv_ptr_expanded;
-
         try
         {
-            cv_ptr_expanded = cv_bridge::toCvCopy(msg);
+            cv_ptr_expanded_ = cv_bridge::toCvShare(msg);
 
         }
         catch (cv_bridge::Exception& e)
@@ -73,174 +97,176 @@ namespace depth_flight_controller
             return;
         }
 
-        depth_expanded_img_ = cv_ptr_expanded->image;
+        TargetFinder::findTarget(cv_ptr_expanded_->image, state_estimate_image, state_estimate_image_msg);
+    }
+
+    void TargetFinder::findTarget(const cv::Mat& depth_expanded_img, const QuadState& state_estimate_image,
+                                  const quad_msgs::QuadStateEstimate& state_estimate_image_msg)
+    {
+        is_max_valid_ = true;
+        depth_expanded_img_ = depth_expanded_img;
+
+        if (use_horizon_cache_)
+        {
+            if (depth_expanded_img_.size() != horizon_cache_.imageSize())
+                configureHorizonCache(depth_expanded_img_.size());
+
+            // toEulerAngle also keeps the yaw for the target
+            Eigen::Vector3d euler_angles = TargetFinder::toEulerAngle(state_estimate_image.orientation);
+            const HorizonLine& horizon_line = horizon_cache_.lookup(euler_angles(0), euler_angles(1), *this);
+            is_max_valid_ = horizon_line.valid;
+
+            TargetFinder::horizonAnalyze(horizon_line, state_estimate_image_msg);
+            return;
+        }
+
         std::vector<cv::Point> horizon_points = TargetFinder::buildHorizon(state_estimate_image);
 
         TargetFinder::horizonAnalyze(horizon_points, state_estimate_image_msg);
     }
 
-    std::vector<cv::Point> TargetFinder::buildHorizon(const QuadState state_estimate)
+    void TargetFinder::configureHorizonCache(const cv::Size& image_size)
     {
-        // Calculate edge points of line
-        Eigen::Matrix3d rvec_state_estimate = TargetFinder::tiltCalculator(state_estimate);
+        horizon_cache_.configure(image_size, horizon_cache_resolution_ * M_PI / 180, horizon_cache_max_roll_ * M_PI / 180,
+                                 horizon_cache_max_pitch_ * M_PI / 180);
+        ROS_INFO("Horizon cache: %.2f deg bins, %.1f KB", horizon_cache_.resolution() * 180 / M_PI,
+                 horizon_cache_.bytes() / 1024.0);
+        if (horizon_cache_.resolution() * 180 / M_PI > horizon_cache_resolution_ + 1e-6)
+            ROS_WARN("~horizon_cache_resolution of %.2f deg does not fit the cache, using %.2f deg",
+                     horizon_cache_resolution_, horizon_cache_.resolution() * 180 / M_PI);
+        if (!prebuild_horizon_cache_)
+            return;
 
-        Eigen::Vector3d horizon_center_point_cam = body_cam_rot_ * rvec_state_estimate *horizon_center_point_world_;
-        Eigen::Vector3d horizon_left_point_cam = body_cam_rot_ * rvec_state_estimate * horizon_left_point_world_;
-        Eigen::Vector3d horizon_right_point_cam = body_cam_rot_ * rvec_state_estimate * horizon_right_point_world_;
+        ros::WallTime start = ros::WallTime::now();
+        horizon_cache_.build(*this);
+        ROS_INFO("Built %d horizon lines for %dx%d in %.1f ms", horizon_cache_.builtLines(), image_size.width,
+                 image_size.height, (ros::WallTime::now() - start).toSec() * 1000);
+    }
 
-        std::vector<cv::Point3f> horizon_3D_points;
-        std::vector<cv::Point2f> projected_horizon_points;
+    std::vector<cv::Point> TargetFinder::buildHorizon(const QuadState state_estimate)
+    {
+        TargetFinder::toEulerAngle(state_estimate.orientation); // Keeps the yaw for the target
 
-        horizon_3D_points.push_back(cv::Point3d(horizon_left_point_cam(0),horizon_left_point_cam(1),horizon_left_point_cam(2)));
-        horizon_3D_points.push_back(cv::Point3d(horizon_right_point_cam(0),horizon_right_point_cam(1),horizon_right_point_cam(2)));
-        horizon_3D_points.push_back(cv::Point3d(horizon_center_point_cam(0),horizon_center_point_cam(1),horizon_center_point_cam(2)));
+        cv::Point edge_left_pos;
+        cv::Point edge_right_pos;
+        cv::Point center_pos;
+        if (!projectTilt(TargetFinder::tiltCalculator(state_estimate), depth_expanded_img_.size(), edge_left_pos,
+                         edge_right_pos, center_pos))
+        {
+            is_max_valid_ = false;
+        }
 
+        std::vector<cv::Point> horizon_points;
+        horizon_points.push_back(edge_left_pos);
+        horizon_points.push_back(edge_right_pos);
+        horizon_points.push_back(center_pos);
 
-        cv::Rodrigues(rvec, rvecR);
-        cv::projectPoints( cv::Mat(horizon_3D_points), rvecR, T, K, distCoeffs, projected_horizon_points);
+        return horizon_points;
+    }
+
+    bool TargetFinder::projectHorizon(double roll, double pitch, const cv::Size& image_size, cv::Point& edge_left,
+                                      cv::Point& edge_right, cv::Point& center) const
+    {
+        return projectTilt(HorizonGeometry::tilt(roll, pitch), image_size, edge_left, edge_right, center);
+    }
 
-        cv::Point pt1 = cv::Point(projected_horizon_points[0].x,projected_horizon_points[0].y);
-        cv::Point pt2 = cv::Point(projected_horizon_points[1].x,projected_horizon_points[1].y);
-        cv::Point horizon_center = cv::Point(projected_horizon_points[2].x,projected_horizon_points[2].y);
+    bool TargetFinder::projectTilt(const Eigen::Matrix3d& tilt, const cv::Size& image_size, cv::Point& edge_left,
+                                   cv::Point& edge_right, cv::Point& center) const
+    {
+        // Calculate edge points of line
+        cv::Point2d projected_left;
+        cv::Point2d projected_right;
+        cv::Point2d projected_center;
+        horizon_geometry_.project(tilt, projected_left, projected_right, projected_center);
 
-        std::vector<cv::Point> horizon_points = TargetFinder::fullLine(pt1, pt2, horizon_center);
+        cv::Point pt1 = cv::Point(projected_left.x,projected_left.y);
+        cv::Point pt2 = cv::Point(projected_right.x,projected_right.y);
+        center = cv::Point(projected_center.x,projected_center.y);
 
-        return horizon_points;
+        return clipHorizon(pt1, pt2, center, image_size, edge_left, edge_right);
     }
 
     void TargetFinder::horizonAnalyze(std::vector<cv::Point> horizon_points, quad_msgs::QuadStateEstimate state_estimate_image_msg)
+    {
+        horizon_line_.build(depth_expanded_img_, horizon_points.at(0), horizon_points.at(1), horizon_points.at(2));
+        horizon_line_.valid = is_max_valid_;
+
+        TargetFinder::horizonAnalyze(horizon_line_, state_estimate_image_msg);
+    }
+
+    void TargetFinder::horizonAnalyze(const HorizonLine& horizon_line, quad_msgs::QuadStateEstimate state_estimate_image_msg)
     {
         cv::Point min_depth_left_pos;
         cv::Point min_depth_right_pos;
         cv::Point min_depth_ib_pos;
-        cv::Point edge_left_pos = horizon_points.at(0);
-        cv::Point edge_right_pos = horizon_points.at(1);
-        cv::Point center_pos = horizon_points.at(2);
+        cv::Point edge_left_pos = horizon_line.edge_left;
+        cv::Point edge_right_pos = horizon_line.edge_right;
+        cv::Point center_pos = horizon_line.center;
         cv::Point max_depth_pos;
         double max_depth = -1;
+        int band_offset = 0; // [px] down from the horizon line
 
         if (is_max_valid_ == true)
         {
-            cv::LineIterator it2(depth_expanded_img_, edge_left_pos, edge_right_pos, 8);
-            std::vector<cv::Point> free_space_points;
-
-            double depth_edge_left = depth_expanded_img_.at<float>(edge_left_pos);
-            double depth_edge_right = depth_expanded_img_.at<float>(edge_right_pos);
-            double depth_center = depth_expanded_img_.at<float>(center_pos);
-
-            // Reset values
-            double min_depth_left = 6.0;
-            double min_depth_right = 6.0;
-            double min_depth_ib = 6.0;
-            double min_dist_center_max = 180;
-            double max_dist_center_ib_min = 180;
-            double max_dist_center_left_min = 180;
-            double max_dist_center_right_min = 180;
-            bool in_free_space = false;
-
-            // Iterate over line
-            for(int i = 0; i < it2.count; i++, ++it2)
+            double depth_edge_left;
+            double depth_edge_right;
+
+            // Max depth, minima left / right of the center and between the center and the max
+            // depth, and the free space run, in one sweep over the horizon samples. With
+            // several bands, the band with the best target is taken.
+            HorizonStats stats;
+            const float* sample_depths;
+            if (horizon_band_offset_.size() > 1)
             {
-                float expanded_depth = depth_expanded_img_.at<float>(it2.pos());
-
-                // Creat position point
-                int x_pos = it2.pos().x;
-                int y_pos = it2.pos().y;
-                cv::Point current_pos(x_pos,y_pos);
-
-                // Calc dist to center (e.g. needed change of orientation)
-                float current_dist_center = euclideanDist(current_pos, center_pos);
-
-                int side = leftOfSecArg(current_pos, center_pos);
-
-                if (side == -1 && (expanded_depth < min_depth_left || (expanded_depth == min_depth_left && current_dist_center > max_dist_center_left_min)))
-                {
-                    max_dist_center_left_min = current_dist_center;
-                    min_depth_left = expanded_depth;
-                    min_depth_left_pos = current_pos;
-
-                } else if (side == +1 && (expanded_depth < min_depth_right || (expanded_depth == min_depth_right && current_dist_center > max_dist_center_right_min)))
-                {
-                    max_dist_center_right_min = current_dist_center;
-                    min_depth_right = expanded_depth;
-                    min_depth_right_pos = current_pos;
-                }
-
-                if (expanded_depth < 4.5)
-                {
-                    in_free_space = false;
-                }
-
-                if (expanded_depth > max_depth || (expanded_depth == max_depth && current_dist_center < min_dist_center_max) || in_free_space == true)
-                {
-                    if (in_free_space == false)
-                    {
-                        free_space_points.erase(free_space_points.begin(), free_space_points.end());
-                    }
-
-                    if (expanded_depth >= 4.5)
-                    {
-                        in_free_space = true;
-                        free_space_points.push_back(current_pos);
-                    }
-                    min_dist_center_max = current_dist_center;
-                    max_depth = expanded_depth;
-                    max_depth_pos = current_pos;
-                }
+                horizon_analyzer_.analyzeBands(depth_expanded_img_, horizon_line, horizon_band_offset_, band_stats_);
+                int band = selectBand(band_stats_);
+                stats = band_stats_[band];
+                band_offset = horizon_band_offset_[band];
+                sample_depths = horizon_analyzer_.bandSampleDepths(band);
+                depth_edge_left = horizon_analyzer_.bandSampleDepth(band, 0);
+                depth_edge_right = horizon_analyzer_.bandSampleDepth(band, horizon_line.position.size() - 1);
+            } else
+            {
+                depth_edge_left = depthAt(depth_expanded_img_, edge_left_pos);
+                depth_edge_right = depthAt(depth_expanded_img_, edge_right_pos);
+                horizon_analyzer_.analyze(depth_expanded_img_, horizon_line, stats);
+                sample_depths = horizon_analyzer_.sampleDepths();
             }
 
+            // Every free space run of the band, as candidates for the planners
+            free_space_gaps_.build(sample_depths, horizon_line, 4.5f, 151.18);
 
-            // This part allows to find the minimum depth between the center and the max depth pos
+            const cv::Point band_shift(0, band_offset);
+            edge_left_pos += band_shift;
+            edge_right_pos += band_shift;
+            center_pos += band_shift;
 
-            int max_left_of_horizon = leftOfSecArg(max_depth_pos, center_pos); // -1 := true ; 0 := is horizon ; 1 := false
-
-            if (max_left_of_horizon == 0)
-            {
-                min_depth_ib = max_depth;
-                min_depth_ib_pos = max_depth_pos;
-            } else
-            {
-                // Iterate over line
-                for(int i = 0; i < it2.count; i++, ++it2)
-                {
-                    float expanded_depth = depth_expanded_img_.at<float>(it2.pos());
-
-                    // Creat position point
-                    int x_pos = it2.pos().x;
-                    int y_pos = it2.pos().y;
-                    cv::Point pos(x_pos,y_pos);
-
-                    // Calc dist to center (e.g. needed change of orientation)
-                    float dist_center = euclideanDist(pos, center_pos);
-                    int pos_left_of_horizon = leftOfSecArg(pos, center_pos);
-                    int pos_right_of_max = leftOfSecArg(max_depth_pos, pos);
-
-                    if ((pos_right_of_max == -1 && pos_left_of_horizon == -1) || (pos_right_of_max == -1 && pos_left_of_horizon == 0) || (pos_right_of_max == 1 && pos_left_of_horizon == 0) || (pos_right_of_max == 1 && pos_left_of_horizon == 1) || (pos_right_of_max == 0 && pos_left_of_horizon == 0))
-                    {
-                        if (expanded_depth < min_depth_ib || (expanded_depth == min_depth_ib && dist_center > max_dist_center_ib_min))
-                        {
-                            max_dist_center_ib_min = dist_center;
-                            min_depth_ib = expanded_depth;
-                            min_depth_ib_pos = pos;
-                        }
-                    }
-                }
-            }
+            max_depth = stats.max_depth;
+            max_depth_pos = stats.max_depth_pos;
+            min_depth_left_pos = stats.min_depth_left_pos;
+            min_depth_right_pos = stats.min_depth_right_pos;
+            min_depth_ib_pos = stats.min_depth_ib_pos;
 
             if (max_depth >= 4.5)
             {
-                int length_free_space = free_space_points.size();
-                if ((length_free_space >= 90) && depth_expanded_img_.at<float>(center_pos) > 4.5)
+                int length_free_space = stats.free_space_length;
+                const cv::Rect image_rect(0, 0, depth_expanded_img_.cols, depth_expanded_img_.rows);
+                if ((length_free_space >= 90) && image_rect.contains(center_pos) &&
+                    depthAt(depth_expanded_img_, center_pos) > 4.5)
                 {
                     max_depth_pos = center_pos;
                 } else
                 {
-                    int take_pos = int(depth_edge_right/(depth_edge_left+ depth_edge_right)*length_free_space);
-                    max_depth_pos = free_space_points[take_pos];
+                    // A band may leave the image at its edges, which then read 0 m
+                    double depth_edges = depth_edge_left + depth_edge_right;
+                    int take_pos = depth_edges > 0 ? int(depth_edge_right/depth_edges*length_free_space) : length_free_space/2;
+                    take_pos = std::min(take_pos, length_free_space - 1);
+                    max_depth_pos = horizon_line.position[stats.free_space_begin + take_pos] + band_shift;
                 }
             }
         } else
         {
+            free_space_gaps_.clear();
             max_depth_pos = cv::Point(-50,-50);
             center_pos = cv::Point(-50,-50);
 
@@ -258,6 +284,7 @@ namespace depth_flight_controller
 
         target.depth = max_depth;
         target.Y = target_dist_center / 151.18 * max_depth;
+        target.Z = -band_offset / 151.18 * max_depth;
 
         /*
         std::cout << "max depth pos: " << max_depth_pos << std::endl;
@@ -286,6 +313,7 @@ namespace depth_flight_controller
         }
 
         target_pub_.publish(target);
+        publishFreeSpaceGaps(horizon_line, band_offset, state_estimate_image_msg);
 
         depth_flight_controller_msgs::HorizonPoints hps;
 
@@ -337,49 +365,109 @@ namespace depth_flight_controller
     }
 
 
-    double TargetFinder::Slope(int x0, int y0, int x1, int y1)
+    double TargetFinder::Slope(int x0, int y0, int x1, int y1) const
     {
         return (double)(y1-y0)/(x1-x0);
     }
 
 
     std::vector<cv::Point> TargetFinder::fullLine(cv::Point a, cv::Point b, cv::Point center_pos)
+    {
+        cv::Point edge_left_pos;
+        cv::Point edge_right_pos;
+        if (!clipHorizon(a, b, center_pos, depth_expanded_img_.size(), edge_left_pos, edge_right_pos))
+        {
+            is_max_valid_ = false;
+        }
+
+        std::vector<cv::Point> horizon_points;
+        horizon_points.push_back(edge_left_pos);
+        horizon_points.push_back(edge_right_pos);
+        horizon_points.push_back(center_pos);
+
+        return horizon_points;
+    }
+
+    bool TargetFinder::clipHorizon(cv::Point a, cv::Point b, const cv::Point& center_pos, const cv::Size& image_size,
+                                   cv::Point& edge_left_pos, cv::Point& edge_right_pos) const
     {
         double slope = Slope(a.x, a.y, b.x, b.y);
 
-        cv::Point edge_left_pos = cv::Point(0,0);
-        cv::Point edge_right_pos = cv::Point(depth_expanded_img_.cols-1,depth_expanded_img_.rows-1);
+        edge_left_pos = cv::Point(0,0);
+        edge_right_pos = cv::Point(image_size.width-1,image_size.height-1);
 
         edge_left_pos.y = -(a.x - edge_left_pos.x) * slope + a.y;
         edge_right_pos.y = -(b.x - edge_right_pos.x) * slope + b.y;
 
-        cv::LineIterator it(depth_expanded_img_, edge_left_pos, edge_right_pos, 8);
-
-        for(int i = 0; i < it.count; i++, ++it)
+        // The part of the line inside the image, as cv::LineIterator walks it
+        int count = 0;
+        cv::Point clipped_left_pos = edge_left_pos;
+        cv::Point clipped_right_pos = edge_right_pos;
+        if (cv::clipLine(image_size, clipped_left_pos, clipped_right_pos))
         {
-            if(i == 0)
-            {
-                edge_left_pos = it.pos();
-            }
-
-            if(i == (it.count - 1))
-            {
-                edge_right_pos = it.pos();
-            }
+            edge_left_pos = clipped_left_pos;
+            edge_right_pos = clipped_right_pos;
+            count = std::max(std::abs(edge_right_pos.x - edge_left_pos.x), std::abs(edge_right_pos.y - edge_left_pos.y)) + 1;
         }
 
-        if (it.count < 150 || center_pos.x < edge_left_pos.x || center_pos.x > edge_right_pos.x )
-        {
+        return !(count < 150 || center_pos.x < edge_left_pos.x || center_pos.x > edge_right_pos.x);
+    }
 
-            is_max_valid_ = false;
+    void TargetFinder::publishFreeSpaceGaps(const HorizonLine& horizon_line, int band_offset,
+                                            const quad_msgs::QuadStateEstimate& state_estimate_image_msg)
+    {
+        // The message arrays are fixed-size like the index, so nothing is allocated here
+        depth_flight_controller_msgs::FreeSpaceGaps& msg = free_space_gaps_msg_;
+        int n_gaps = std::min(free_space_gaps_.size(), int(msg.min_depth.size()));
+
+        msg.header.stamp = state_estimate_image_msg.header.stamp;
+        msg.n_gaps = n_gaps;
+        msg.n_dropped = std::min(free_space_gaps_.dropped() + free_space_gaps_.size() - n_gaps, 255);
+        for (int k = 0; k < n_gaps; ++k)
+        {
+            const FreeSpaceGap& gap = free_space_gaps_[k];
+            msg.start_u[k] = horizon_line.position[gap.begin].x;
+            msg.start_v[k] = horizon_line.position[gap.begin].y + band_offset;
+            msg.end_u[k] = horizon_line.position[gap.end].x;
+            msg.end_v[k] = horizon_line.position[gap.end].y + band_offset;
+            msg.min_depth[k] = gap.min_depth;
+            msg.width[k] = gap.width;
+            msg.bearing[k] = gap.bearing;
         }
+        msg.yaw = yaw_;
+        msg.position = state_estimate_image_msg.position;
 
-        std::vector<cv::Point> horizon_points;
-        horizon_points.push_back(edge_left_pos);
-        horizon_points.push_back(edge_right_pos);
-        horizon_points.push_back(center_pos);
+        free_space_gaps_pub_.publish(msg);
+    }
 
-        return horizon_points;
+    int TargetFinder::selectBand(const std::vector<HorizonStats>& band_stats) const
+    {
+        // From the horizon line outwards, upper band first, so that ties go to the band
+        // nearest to the altitude of the drone
+        int center_band = band_stats.size() / 2;
+        int best_band = center_band;
+        for (int k = 1; k <= center_band; ++k)
+        {
+            int bands[2] = {center_band - k, center_band + k};
+            for (int j = 0; j < 2; ++j)
+            {
+                if (isBetterBand(band_stats[bands[j]], band_stats[best_band]))
+                    best_band = bands[j];
+            }
+        }
+        return best_band;
+    }
+
+    bool TargetFinder::isBetterBand(const HorizonStats& a, const HorizonStats& b)
+    {
+        // Free space first, then the longer free space run or else the farther maximum
+        bool a_free = a.max_depth >= 4.5;
+        bool b_free = b.max_depth >= 4.5;
+        if (a_free != b_free)
+            return a_free;
+        if (a_free)
+            return a.free_space_length > b.free_space_length;
+        return a.max_depth > b.max_depth;
     }
 
     void TargetFinder::stateEstimateCallback(const quad_msgs::QuadStateEstimate::ConstPtr &msg)
@@ -389,13 +477,3 @@ namespace depth_flight_controller
 
     }
 }
-
-int main(int argc, char** argv)
-{
-    ros::init(argc, argv, "target_finder");
-
-    depth_flight_controller::TargetFinder hp;
-    ros::spin();
-
-    return 0;
-}
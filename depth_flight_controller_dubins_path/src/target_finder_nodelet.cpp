@@ -0,0 +1,22 @@
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <boost/shared_ptr.hpp>
+#include "target_finder.h"
+
+namespace depth_flight_controller
+{
+    // TargetFinder as a nodelet. Loaded into the manager of the depth pipeline it receives the
+    // expanded image as a shared pointer instead of a serialized copy.
+    class TargetFinderNodelet : public nodelet::Nodelet
+    {
+    private:
+        virtual void onInit()
+        {
+            target_finder_.reset(new TargetFinder(getNodeHandle(), getPrivateNodeHandle()));
+        }
+
+        boost::shared_ptr<TargetFinder> target_finder_;
+    };
+}
+
+PLUGINLIB_EXPORT_CLASS(depth_flight_controller::TargetFinderNodelet, nodelet::Nodelet)
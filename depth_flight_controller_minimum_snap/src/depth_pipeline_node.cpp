@@ -0,0 +1,16 @@
+#include "depth_pipeline.h"
+#include "target_finder.h"
+
+int main(int argc, char** argv)
+{
+    ros::init(argc, argv, "depth_pipeline");
+
+    ros::NodeHandle nh;
+    ros::NodeHandle pnh("~");
+    depth_flight_controller::TargetFinder target_finder(nh, pnh, false);
+    depth_flight_controller::DepthPipeline dp(target_finder, nh, pnh);
+
+    ros::spin();
+
+    return 0;
+}
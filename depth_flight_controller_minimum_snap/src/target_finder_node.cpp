@@ -0,0 +1,11 @@
+#include "target_finder.h"
+
+int main(int argc, char** argv)
+{
+    ros::init(argc, argv, "target_finder");
+
+    depth_flight_controller::TargetFinder hp;
+    ros::spin();
+
+    return 0;
+}
@@ -11,13 +11,13 @@
 #include <sensor_msgs/image_encodings.h>
 #include "opencv2/core/core.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
-#include "opencv2/calib3d/calib3d.hpp"
 #include "opencv2/highgui/highgui.hpp"
 #include "geometry_msgs/TwistStamped.h"
 #include "geometry_msgs/Quaternion.h"
 #include "quad_msgs/QuadStateEstimate.h"
 #include "depth_flight_controller_msgs/HorizonPoints.h"
 #include "quad_common/quad_state.h"
+#include "horizon_geometry.h"
 #include <iostream>
 #include <string>
 #include "quad_common/geometry_eigen_conversions.h"
@@ -43,7 +43,6 @@ namespace depth_flight_controller
         void stateEstimateCallback(const quad_msgs::QuadStateEstimate::ConstPtr &msg);
 
         Eigen::Matrix3d tiltCalculator(const QuadState &state_estimate);
-        void toEulerAngle(const Eigen::Quaterniond& q, double& roll, double& pitch, double& yaw);
         double Slope(int x0, int y0, int x1, int y1);
         void fullLine(cv::Point a, cv::Point b);
         float euclideanDistSign(cv::Point& p, cv::Point& q);
@@ -67,25 +66,19 @@ namespace depth_flight_controller
 
     private:
         // Image information
+        cv_bridge::CvImageConstPtr cv_ptr_expanded_; // Shared with the subscription, read only
         cv::Mat depth_expanded_img_;
 
         // Camera intrinsic and extrinsic information
-        cv::Mat K;
-        cv::Mat rvecR;
-        cv::Mat T;
-        cv::Mat distCoeffs;
+        HorizonGeometry horizon_geometry_;
 
         // State information
-        double roll_, pitch_, yaw_;
         QuadState state_estimate_;
         Eigen::Vector3d body_velocities_;
 
         // Horizon build information
         cv::Point pt1_; // Horizon point left edge
         cv::Point pt2_; // Horizon point right edge
-        std::vector<cv::Point3f> generate3DPoints();
-        std::vector<cv::Point3f> horizonPoints;
-        std::vector<cv::Point2f> projectedHorizonPoints;
 
         // Horizon analysis information
         std::vector<cv::Point> free_space_points;
@@ -16,10 +16,10 @@ namespace depth_flight_controller
         rotate_right_ = false;
         close_to_wall_ = false;
 
-        horizonPoints = HorizonPlotter::generate3DPoints();
-        K = (cv::Mat_<double>(3,3)<<151.8076510090423, 0.0, 80.5, 0.0, 151.8076510090423, 60.5, 0.0, 0.0, 1.0);
-        T = (cv::Mat_<double>(3,1) <<  0, 0, 0);
-        distCoeffs = (cv::Mat_<double>(4,1) <<  0, 0, 0, 0);
+        // Horizon points in the camera frame, tilted by the attitude directly
+        horizon_geometry_.setIntrinsics(151.8076510090423, 151.8076510090423, 80.5, 60.5);
+        horizon_geometry_.setHorizonPoints(Eigen::Vector3d(10, 0, 100), Eigen::Vector3d(-10, 0, 100),
+                                           Eigen::Vector3d(0, 0, 100));
     }
 
 
@@ -29,52 +29,18 @@ namespace depth_flight_controller
     }
 
 
-    void HorizonPlotter::toEulerAngle(const Eigen::Quaterniond& q, double& roll, double& pitch, double& yaw)
-    {
-        // roll (x-axis rotation)
-        double sinr = +2.0 * (q.w() * q.x() + q.y() * q.z());
-        double cosr = +1.0 - 2.0 * (q.x() * q.x() + q.y() * q.y());
-        roll = atan2(sinr, cosr);
-
-        // pitch (y-axis rotation)
-        double sinp = +2.0 * (q.w() * q.y() - q.z() * q.x());
-        if (fabs(sinp) >= 1)
-            pitch = copysign(M_PI / 2, sinp); // use 90 degrees if out of range
-        else
-            pitch = asin(sinp);
-
-        // yaw (z-axis rotation)
-        double siny = +2.0 * (q.w() * q.z() + q.x() * q.y());
-        double cosy = +1.0 - 2.0 * (q.y() * q.y() + q.z() * q.z());
-        yaw = atan2(siny, cosy);
-    }
-
-
     Eigen::Matrix3d HorizonPlotter::tiltCalculator(const QuadState &state_estimate)
     {
-        Eigen::Quaterniond q = state_estimate.orientation;
-
-        HorizonPlotter::toEulerAngle(q, roll_, pitch_, yaw_);
-
-        Eigen::Vector3d euler_angles(roll_, pitch_, 0);
-
-        Eigen::Matrix3d state_estimate_rot_mat = eulerAnglesZYXToRotationMatrix(euler_angles);
-
-        double a1 = sqrt(pow(state_estimate_rot_mat(0,0),2)+pow(state_estimate_rot_mat(0,1),2)+pow(state_estimate_rot_mat(0,2),2));
-        double a2 = sqrt(pow(state_estimate_rot_mat(0,0),2)+pow(state_estimate_rot_mat(1,0),2)+pow(state_estimate_rot_mat(2,0),2));
-
-        return state_estimate_rot_mat;
+        return HorizonGeometry::tilt(state_estimate.orientation);
     }
 
     void HorizonPlotter::expandedImageCallback(const sensor_msgs::ImageConstPtr& msg)
     {
         ros::Time start = ros::Time::now();
 
-        cv_bridge::CvImagePtr cv_ptr_expanded;
-
         try
         {
-            cv_ptr_expanded = cv_bridge::toCvCopy(msg);
+            cv_ptr_expanded_ = cv_bridge::toCvShare(msg);
 
         }
         catch (cv_bridge::Exception& e)
@@ -83,7 +49,7 @@ namespace depth_flight_controller
             return;
         }
 
-        depth_expanded_img_ = cv_ptr_expanded->image;
+        depth_expanded_img_ = cv_ptr_expanded_->image;
 
         HorizonPlotter::buildHorizon();
 
@@ -98,20 +64,15 @@ namespace depth_flight_controller
     void HorizonPlotter::buildHorizon()
     {
         // Calculate edge points of line
-        Eigen::Matrix3d rvec_state_estimate = HorizonPlotter::tiltCalculator(state_estimate_);
-
-        cv::Mat rvec = (cv::Mat_<double>(3,3) << rvec_state_estimate(0,0), rvec_state_estimate(0,1), rvec_state_estimate(0,2),
-        rvec_state_estimate(1,0), rvec_state_estimate(1,1), rvec_state_estimate(1,2),
-        rvec_state_estimate(2,0), rvec_state_estimate(2,1), rvec_state_estimate(2,2));
+        cv::Point2d projected_left;
+        cv::Point2d projected_right;
+        cv::Point2d projected_center;
+        horizon_geometry_.project(HorizonPlotter::tiltCalculator(state_estimate_), projected_left, projected_right,
+                                  projected_center);
 
-        cv::Rodrigues(rvec, rvecR);
-
-        cv::projectPoints( cv::Mat(horizonPoints), rvecR, T, K,
-        distCoeffs, projectedHorizonPoints);
-
-        cv::Point pt1 = cv::Point(projectedHorizonPoints[0].x,projectedHorizonPoints[0].y);
-        cv::Point pt2 = cv::Point(projectedHorizonPoints[1].x,projectedHorizonPoints[1].y);
-        horizon_center_ = cv::Point(projectedHorizonPoints[2].x,projectedHorizonPoints[2].y);
+        cv::Point pt1 = cv::Point(projected_left.x,projected_left.y);
+        cv::Point pt2 = cv::Point(projected_right.x,projected_right.y);
+        horizon_center_ = cv::Point(projected_center.x,projected_center.y);
 
         HorizonPlotter::fullLine(pt1, pt2);
     }
@@ -596,25 +557,6 @@ namespace depth_flight_controller
 
         cmd_vel_base_frame_pub_.publish(msg_cmd);
     }
-
-
-    std::vector<cv::Point3f> HorizonPlotter::generate3DPoints()
-    {
-        std::vector<cv::Point3f> points;
-
-        double x,y,z;
-
-        x=10;y=0;z=100;
-        points.push_back(cv::Point3d(x,y,z));
-
-        x=-10;y=0;z=100;
-        points.push_back(cv::Point3d(x,y,z));
-
-        x=0;y=0;z=100;
-        points.push_back(cv::Point3d(x,y,z));
-
-        return points;
-    }
 }
 
 int main(int argc, char** argv)